@@ -2,7 +2,10 @@
 #define __AcquisitionManager__
 //#include <opencv2/opencv.hpp>
 
+#include <cctype>
 #include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <mutex>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgcodecs.hpp>
@@ -15,87 +18,238 @@
 
 #include "Plots.hpp"
 #include "SERProcessor.hpp"
+#include "SERStripedWriter.hpp"
 #include "asi_base.hpp"
+#include "preview.hpp"
+#include "spill_tier.hpp"
+#include "thread_profile.hpp"
+#include "write_scheduler.hpp"
 #include "hello_imgui/hello_imgui.h"
 #include "imgui_md_wrapper/imgui_md_wrapper.h"
 #include "spdlog/fmt/bundled/chrono.h"
 
+// Every camera gets a pipeline of its own: a recorder thread draining its
+// ring to disk and a preview thread making images of it, so several cameras
+// can stream and record at once. The recorders share each disk fairly (see
+// WriteScheduler); the viewport shows the camera selected in the camera
+// window.
 class AcqManager {
  public:
   AcqManager() {
     abort_view = false;
-    viewingThread = std::thread(AcqManager::HelperUpdateView, this);
-    recordingThread = std::thread(AcqManager::HelperRecordStream, this);
+    for (const auto& camera : CameraWindow::Cameras()) {
+      pipelines.push_back(std::make_unique<Pipeline>());
+      Pipeline* p = pipelines.back().get();
+      p->camera = camera;
+      p->viewingThread = std::thread(AcqManager::HelperUpdateView, this, p);
+      p->recordingThread =
+          std::thread(AcqManager::HelperRecordStream, this, p);
+    }
   }
   void close_threads() {
     abort_view = true;
     spdlog::info("Waiting for AcqManager threads to end");
-    recordingThread.join();
-    viewingThread.join();
+    for (auto& p : pipelines) {
+      if (p->recordingThread.joinable()) p->recordingThread.join();
+      if (p->viewingThread.joinable()) p->viewingThread.join();
+    }
     spdlog::info("AcqManager threads to closed");
   }
   ~AcqManager() { close_threads(); }
 
  protected:
+  struct Pipeline {
+    std::shared_ptr<CameraBase> camera;
+    // The preview's latest image and when its frame was published (0 for
+    // a still), until the viewport takes it.
+    std::mutex mutex;
+    cv::Mat image;
+    uint64_t published = 0;
+    bool fresh = false;
+    // Preview thread only.
+    Timer timer;
+    float triggerBaseline = -1;
+    std::thread recordingThread;
+    std::thread viewingThread;
+  };
+  // The image the viewport shows; GUI thread only.
   cv::Mat mImage;
-  std::mutex updatingFrame;
   int targetFPS = 0;
   int recordFPS = 1;
 
-  static void HelperRecordStream(AcqManager* acq) {
-    spdlog::info("RecordStream Thread started");
-    acq->RecordStream();
+  // The pipeline of the camera selected in the camera window.
+  Pipeline* Selected() {
+    for (auto& p : pipelines)
+      if (p->camera == CameraWindow::pCamera) return p.get();
+    return nullptr;
+  }
+  // Puts p's image in mImage if the preview made a new one, or the viewport
+  // has just switched to p. Returns when the new frame was published, to
+  // time its display by, or 0.
+  uint64_t TakeImage(Pipeline& p) {
+    std::lock_guard<std::mutex> lock(p.mutex);
+    const bool switched = &p != shown;
+    shown = &p;
+    if (!p.fresh && !(switched && !p.image.empty())) return 0;
+    mImage = p.image;
+    if (!p.fresh) return 0;
+    p.fresh = false;
+    return p.published;
+  }
+
+  static void HelperRecordStream(AcqManager* acq, Pipeline* p) {
+    spdlog::info("RecordStream Thread started for {}",
+                 p->camera->getDevName());
+    acq->RecordStream(p);
   }
-  static void HelperUpdateView(AcqManager* acq) {
-    spdlog::info("UpdateView Thread started");
-    acq->UpdateView();
+  static void HelperUpdateView(AcqManager* acq, Pipeline* p) {
+    spdlog::info("UpdateView Thread started for {}", p->camera->getDevName());
+    acq->UpdateView(p);
   }
 
-  void RecordStream() {
+  void RecordStream(Pipeline* p) {
     auto now = std::chrono::system_clock::now();
     std::string fn;
+    uint32_t profile = 0;
+    const auto cam = p->camera;
+    cameraStat_t& stats = cam->Stats();
     while (!abort_view) {
-      if (CameraWindow::pCamera != nullptr) {
-        if (CameraWindow::pCamera->is_connected) {
-          if (CameraWindow::pCamera->is_running) {
-            if (!CameraWindow::pCamera->is_still) {
-              auto ptrS = CameraWindow::pCamera->getStreamingFramePtr();
-              if (ptrS->do_record && ptrS->buffer != nullptr) {
+      ThreadProfile::Refresh(ThreadProfile::Role::Writer, profile);
+      if (cam != nullptr) {
+        if (cam->is_connected) {
+          if (cam->is_running) {
+            if (!cam->is_still) {
+              auto ptrS = cam->getStreamingFramePtr();
+              auto ring = ptrS->buffer;
+              if (ptrS->do_record && ring != nullptr) {
                 now = std::chrono::system_clock::now();
-                fn = fmt::format("{}\{:%Y-%m-%d_%H-%M-%S}.ser",
-                                 ptrS->selectedFilename, now);
-                spdlog::info("Starting recording to {}", fn);
+                // Cameras started together must not share a name.
+                fn = fmt::format("{:%Y-%m-%d_%H-%M-%S}_{}", now,
+                                 FileName(cam->getDevName()));
+                std::vector<std::string> dirs{ptrS->selectedFilename};
+                const auto stripes = ptrS->Stripes();
+                dirs.insert(dirs.end(), stripes.begin(), stripes.end());
+                spdlog::info("Starting recording of {} to {}",
+                             cam->getDevName(), fn);
+                // The recorder must see every frame, so it registers as a
+                // lossless reader for the duration of the recording only.
+                // The spill tier owns that reader and hands frames back in
+                // order, from the ring or from its scratch file. Neither
+                // failure below goes away by itself, so Record is turned
+                // off rather than retried.
+                int reader = AddRecordReader(ptrS, ring);
+                if (reader < 0) {
+                  spdlog::critical("No reader free on the buffer of {}; not "
+                                   "recording",
+                                   cam->getDevName());
+                  ptrS->do_record = false;
+                  continue;
+                }
                 ptrS->nCaptured = 0;
-                std::unique_ptr<SER::SERWriter> writer =
-                    std::make_unique<SER::SERWriter>(fn);
+                auto writer = std::make_unique<SER::SERStripedWriter>(
+                    dirs, fn, ptrS->writer_backend, ptrS->stripe_mode,
+                    ptrS->rotate_mb, ptrS->adc_bits);
                 std::array<size_t, 2> dims{ptrS->dim[0], ptrS->dim[1]};
                 std::array<std::string, 3> strs{"ds", "dds", "asdwad"};
+                writer->set_byte_order(ptrS->byte_order);
                 writer->prepare_header(dims, strs, ptrS->byte_channel,
                                        ptrS->format);
                 if (!writer->isOpen()) {
                   spdlog::critical("VideoWriter failed to open {}", fn);
+                  ring->remove_reader(reader);
+                  ptrS->do_record = false;
                   continue;
                 }
-                while (ptrS->is_active && writer->isOpen()) {
-                  auto buf = ptrS->buffer->dequeue();
-                  if (buf != nullptr) {
-                    if (ptrS->do_record) {
-                      writer->write_frame(buf);
-                      ptrS->nCaptured++;
+                auto spill = std::make_unique<SpillTier>(
+                    ring, reader, ptrS->SpillDirectory(), ptrS->spill_mb,
+                    ptrS->spill_high_water);
+                WriteScheduler::Client disk(ptrS->selectedFilename);
+                ptrS->is_recording = true;
+                RecordingSummary summary(stats.diag);
+                Timer statTimer;
+                statTimer.Start();
+                uint64_t lastDrained = 0;
+                uint64_t written = 0;
+                std::vector<SpillTier::Frame> batch;
+                std::vector<const uint8_t*> data;
+                std::vector<uint64_t> utc;
+                while (ptrS->is_active && ptrS->do_record &&
+                       writer->isOpen()) {
+                  // Take everything that is ready, up to the batch limit, and
+                  // hand it to the writer in one go. Frames held for a batch
+                  // stay pinned in the ring, so at most half of it is held.
+                  spill->wait(100);
+                  const size_t limit = std::clamp<size_t>(
+                      ptrS->max_batch_bytes / ring->frame_size(), 1,
+                      std::max<size_t>(ring->capacity() / 2, 1));
+                  batch.clear();
+                  SpillTier::Frame frame;
+                  while (batch.size() < limit && spill->acquire(frame))
+                    batch.push_back(frame);
+                  if (!batch.empty()) {
+                    data.clear();
+                    utc.clear();
+                    const uint64_t gaps = summary.gaps;
+                    for (const auto& f : batch) {
+                      data.push_back(f.data);
+                      utc.push_back(f.meta.utc_ns);
+                      summary.add(f.meta);
                     }
-                    ptrS->buffer->move_tail();
-                  } else
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-                  std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                  if (abort_view) {
-                    spdlog::info("Stopped recording");
-                    writer.reset();
-                    break;
+                    stats.diag.writer_lost += summary.gaps - gaps;
+                    // One turn at the disk per slice; see WriteScheduler.
+                    const size_t slice = std::max<size_t>(
+                        disk.quantum() / ring->frame_size(), 1);
+                    uint64_t done = 0;
+                    for (size_t i = 0; i < batch.size(); i += slice) {
+                      const size_t n = std::min(slice, batch.size() - i);
+                      const size_t bytes = n * ring->frame_size();
+                      summary.disk_wait_ns += disk.acquire(bytes);
+                      const uint64_t t = monotonic_ns();
+                      writer->write_frames(data.data() + i, utc.data() + i, n);
+                      done = monotonic_ns();
+                      disk.release();
+                      stats.diag.at(LatencyStage::WriteCall).record(done - t);
+                      written += bytes;
+                    }
+                    ptrS->nCaptured += batch.size();
+                    for (const auto& f : batch) {
+                      stats.diag.at(LatencyStage::Written)
+                          .record(done - std::min(done, f.meta.publish_ns));
+                      if (!spill->release())
+                        spdlog::warn("Frame {} was overwritten while recording",
+                                     f.meta.seq);
+                    }
+                  }
+
+                  const uint32_t elapsed = statTimer.Finish();
+                  if (elapsed > 500) {
+                    auto st = spill->stats();
+                    stats.spill.update(st, st.drained - lastDrained, elapsed);
+                    lastDrained = st.drained;
+                    stats.writeMBps.push(written * 1000.f / elapsed /
+                                         (1024.f * 1024.f));
+                    written = 0;
+                    statTimer.Start();
                   }
+                  const uint64_t until = ptrS->trigger_until_ns;
+                  if (until != 0 && monotonic_ns() > until) {
+                    spdlog::info("Automatic trigger expired");
+                    ptrS->trigger_until_ns = 0;
+                    ptrS->do_record = false;
+                  }
+                  if (abort_view) break;
                 }
-                spdlog::info("Stopped recording");
+                const SpillStats spilled = spill->stats();
+                spill.reset();
+                ring->remove_reader(reader);
+                stats.writeMBps.push(0);
+                spdlog::info("Stopped recording of {}", cam->getDevName());
+                const auto summaryPath =
+                    std::filesystem::path(writer->directory()) / (fn + ".json");
                 writer.reset();
+                WriteSummary(summaryPath.string(), summary, stats.diag, *ring,
+                             spilled, ptrS->overflow_policy);
+                ptrS->is_recording = false;
               }
             }
           }
@@ -105,24 +259,37 @@ class AcqManager {
     }
   }
 
-  void UpdateView() {
+  void UpdateView(Pipeline* p) {
+    uint32_t profile = 0;
+    const auto cam = p->camera;
+    Timer& timer = p->timer;
     while (!abort_view) {
-      if (CameraWindow::pCamera != nullptr) {
-        if (CameraWindow::pCamera->is_connected) {
-          auto ptr = CameraWindow::pCamera->getImageFramePtr();
-          if (CameraWindow::pCamera->is_running) {
-            if (!CameraWindow::pCamera->is_still) {
-              auto ptrS = CameraWindow::pCamera->getStreamingFramePtr();
-              while (ptrS->is_active) {
+      ThreadProfile::Refresh(ThreadProfile::Role::Preview, profile);
+      if (cam != nullptr) {
+        if (cam->is_connected) {
+          auto ptr = cam->getImageFramePtr();
+          if (cam->is_running) {
+            if (!cam->is_still) {
+              auto ptrS = cam->getStreamingFramePtr();
+              // The preview only wants the newest frame and may skip.
+              auto ring = ptrS->buffer;
+              int reader = -1;
+              if (ring != nullptr)
+                reader = ring->add_reader(ReaderPolicy::Latest);
+              p->triggerBaseline = -1;
+              while (ptrS->is_active && reader >= 0) {
                 if (targetFPS == 0 ||
                     timer.Finish() > (1 / ((uint32_t)(targetFPS)*10)) * 1000) {
                   timer.Start();
-                  if (ptrS->buffer != nullptr) {
-                    auto buf = ptrS->buffer->last();
-                    if (buf != nullptr) {
-                      updateImage<STILL_STREAMING_STRUCT>(ptrS, buf,
-                                                          "VideoFrame");
-                    }
+                  auto buf = ring->acquire(reader);
+                  if (buf != nullptr) {
+                    if (ptrS->auto_trigger)
+                      CheckTrigger(ptrS, buf, p->triggerBaseline);
+                    updateImage<STILL_STREAMING_STRUCT>(
+                        *p, ptrS, buf, "VideoFrame",
+                        ring->meta(buf).publish_ns);
+                    ring->release(reader);
+                    cam->Stats().diag.preview_skipped = ring->skipped(reader);
                   }
                 } else {
                   std::this_thread::sleep_for(
@@ -133,11 +300,12 @@ class AcqManager {
                 std::this_thread::sleep_for(std::chrono::milliseconds(1));
                 if (abort_view) break;
               }
+              if (reader >= 0) ring->remove_reader(reader);
             }
           } else if (ptr->is_new) {
             if (ptr->mutex.try_lock()) {
               u_int8_t* buf = ptr->buffer.get();
-              updateImage(ptr, buf);
+              updateImage(*p, ptr, buf);
               ptr->is_new = false;
               ptr->mutex.unlock();
             }
@@ -149,31 +317,161 @@ class AcqManager {
   }
 
  private:
-  Timer timer;
-  bool abort_view = false;
+  std::atomic_bool abort_view = false;
+  std::vector<std::unique_ptr<Pipeline>> pipelines;
+  // The pipeline mImage was last taken from.
+  Pipeline* shown = nullptr;
+
+  // name with anything but letters, digits, '-' and '.' made '_'.
+  static std::string FileName(std::string name) {
+    for (char& c : name)
+      if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '.')
+        c = '_';
+    return name;
+  }
+
+  // Register the recorder's lossless reader, reaching back into the ring for
+  // the pre-trigger window if one is set.
+  int AddRecordReader(STILL_STREAMING_STRUCT* ptrS,
+                      const std::shared_ptr<Circular_Buffer<uint8_t>>& ring) {
+    const uint32_t frames = ptrS->pretrigger_frames;
+    const float seconds = ptrS->pretrigger_s;
+    const uint64_t now = monotonic_ns();
+    if (frames == 0 && seconds <= 0)
+      return ring->add_reader(ReaderPolicy::Lossless);
+    int reader = ring->add_reader(ReaderPolicy::Lossless,
+                                  frames ? frames : ring->capacity());
+    if (reader < 0) return reader;
+    if (frames == 0) ring->skip_before(reader, now - uint64_t(seconds * 1e9));
+    const size_t kept = ring->committed() - ring->cursor(reader);
+    if (frames > kept)
+      spdlog::warn("Pre-trigger wants {} frames, the buffer only holds {}",
+                   frames, kept);
+    spdlog::info("Recording starts {} frames before the trigger", kept);
+    return reader;
+  }
+
+  // Automatic trigger on a jump in mean brightness against a slow running
+  // average, for meteors and lightning. Only every 61st pixel is sampled.
+  void CheckTrigger(STILL_STREAMING_STRUCT* ptrS, const uint8_t* buf,
+                    float& triggerBaseline) {
+    const size_t n = ptrS->size / ptrS->byte_channel;
+    if (n == 0) return;
+    double sum = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < n; i += 61, count++)
+      sum += ptrS->byte_channel == 2
+                 ? reinterpret_cast<const uint16_t*>(buf)[i] / 256.
+                 : buf[i];
+    const float mean = sum / count;
+    if (triggerBaseline >= 0 &&
+        mean - triggerBaseline >
+            std::max(triggerBaseline * ptrS->trigger_jump / 100.f, 1.f)) {
+      ptrS->trigger_until_ns =
+          monotonic_ns() + uint64_t(ptrS->trigger_hold_s * 1e9);
+      if (!ptrS->do_record) {
+        spdlog::info("Automatic trigger: brightness {:.1f} -> {:.1f}",
+                     triggerBaseline, mean);
+        ptrS->do_record = true;
+      }
+    }
+    triggerBaseline =
+        triggerBaseline < 0 ? mean : triggerBaseline * 0.95f + mean * 0.05f;
+  }
+
+  // What one recording went through, for the summary next to its files.
+  struct RecordingSummary {
+    explicit RecordingSummary(const diagStat_t& diag)
+        : latency(diag.snapshot()) {}
+    latencySnapshot_t latency;
+    uint64_t start_ns = monotonic_ns();
+    uint64_t start_utc_ns = realtime_ns();
+    uint64_t frames = 0;
+    uint64_t gaps = 0;  // frames published but missing from the recording
+    uint64_t disk_wait_ns = 0;  // waiting for other cameras' writes
+    FrameMeta first, last;
+
+    void add(const FrameMeta& m) {
+      if (frames++ == 0)
+        first = m;
+      else if (m.seq > last.seq + 1)
+        gaps += m.seq - last.seq - 1;
+      last = m;
+    }
+  };
+
+  // <name>.json next to the recording: how long it ran, the frames lost by
+  // cause (see diagStat_t) and the latency of each stage while it ran.
+  void WriteSummary(const std::string& path, const RecordingSummary& r,
+                    const diagStat_t& diag, Circular_Buffer<uint8_t>& ring,
+                    const SpillStats& spilled, OverflowPolicy policy) {
+    static const char* policies[] = {"drop_newest", "overwrite_oldest",
+                                     "block"};
+    const double seconds = (monotonic_ns() - r.start_ns) / 1e9;
+    const uint64_t camera = r.frames ? r.last.sdk_dropped - r.first.sdk_dropped
+                                     : 0;
+    const uint64_t refused =
+        r.frames ? r.last.ring_dropped - r.first.ring_dropped : 0;
+    const latencySnapshot_t now = diag.snapshot();
+    std::string latency;
+    for (size_t i = 0; i < LATENCY_STAGES; i++)
+      latency += fmt::format("{}\n    \"{}\": {}", i ? "," : "",
+                             LatencyKey(LatencyStage(i)),
+                             now[i].since(r.latency[i]).json());
+    std::ofstream out(path);
+    out << fmt::format(
+        R"({{
+  "start_utc_ns": {},
+  "duration_s": {:.3f},
+  "frames": {},
+  "fps": {:.2f},
+  "frame_bytes": {},
+  "ring": {{"capacity": {}, "policy": "{}"}},
+  "lost": {{"camera": {}, "ring": {}, "writer": {}}},
+  "spill": {{"spilled": {}, "lost": {}}},
+  "disk_wait_ms": {:.1f},
+  "latency": {{{}
+  }}
+}}
+)",
+        r.start_utc_ns, seconds, r.frames, seconds > 0 ? r.frames / seconds : 0,
+        ring.frame_size(), ring.capacity(), policies[int(policy)], camera,
+        refused, r.gaps, spilled.spilled, spilled.lost, r.disk_wait_ns / 1e6,
+        latency);
+    if (!out) {
+      spdlog::warn("Could not write the recording summary {}", path);
+      return;
+    }
+    spdlog::info("Recording summary {}: {} frames, lost {} in the camera, "
+                 "{} at the ring, {} behind the writer",
+                 path, r.frames, camera, refused, r.gaps);
+  }
 
   std::vector<cv::Mat> color_planes;
-  std::thread recordingThread;
-  std::thread viewingThread;
   template <class T = STILL_IMAGE_STRUCT>
-  void updateImage(T* ptr, uint8_t* buf, std::string str = "StillFrame") {
+  void updateImage(Pipeline& p, T* ptr, uint8_t* buf,
+                   std::string str = "StillFrame", uint64_t publish_ns = 0) {
    // static int histSize[] = {0, 256};
    // static int channels[] = {0, 1};
    // static float hranges[] = {0, 180};
    // static float sranges[] = {0, 256};
    // const float* ranges[] = {hranges, sranges};
    // cv::MatND hist;
-    if (updatingFrame.try_lock()) {
+    {
       spdlog::debug("Got new {}, {} KB {} CH, {}x{} {} {}", str,
                     ptr->size / 1024, ptr->ch, ptr->dim[0], ptr->dim[1],
                     (ptr->byte_channel - 1) * 2,
                     CV_MAKETYPE((ptr->byte_channel - 1) * 2, ptr->ch));
-      mImage = cv::Mat(ptr->dim[0], ptr->dim[1],
-                       CV_MAKETYPE((ptr->byte_channel - 1) * 2, ptr->ch), buf);
-      if (ptr->byte_channel == 2) {
-        mImage = mImage / 255;
-        mImage.convertTo(mImage, CV_MAKETYPE(0, ptr->ch));
-      }
+      // The slot goes back to the ring as soon as we return; the GUI
+      // thread renders the image later, so it needs its own pixels. The
+      // pipeline's lock is only held to hand it over.
+      cv::Mat image(ptr->dim[0], ptr->dim[1], CV_MAKETYPE(CV_8U, ptr->ch));
+      Preview::To8Bit(buf, ptr->dim[0] * ptr->dim[1] * ptr->ch,
+                      ptr->byte_channel, image.data);
+      std::lock_guard<std::mutex> lock(p.mutex);
+      p.image = image;
+      p.published = publish_ns;
+      p.fresh = true;
       //if (ptr->ch == 1) {
       //  cv::calcHist(&mImage, 1, channels, cv::Mat(),  // do not use mask
       //               hist /*processStat.hist[0]*/, 1, histSize, ranges,
@@ -184,14 +482,13 @@ class AcqManager {
       //  std::cout << "s" << std::endl;
       //  cv::split(mImage, color_planes);
       //  //        cv::calcHist(&color_planes[0], 1, 0, cv::Mat(),
-      //  //        processStat.histograms[0].get_buffer(), 1, 256, {0, 255},
+      //  //        processStat.histograms[0].data(), 1, 256, {0, 255},
       //  //        false, false); cv::calcHist(&color_planes[1], 1, 0, cv::Mat(),
-      //  //        processStat.histograms[1].get_buffer(), 1, 256, {0, 255},
+      //  //        processStat.histograms[1].data(), 1, 256, {0, 255},
       //  //        false, false); cv::calcHist(&color_planes[2], 1, 0, cv::Mat(),
-      //  //        processStat.histograms[2].get_buffer(), 1, 256, {0, 255},
+      //  //        processStat.histograms[2].data(), 1, 256, {0, 255},
       //  //        false, false);
       //}
-      updatingFrame.unlock();
     }
   }
 };
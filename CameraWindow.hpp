@@ -16,6 +16,8 @@
 #include "ImFileDialog/ImFileDialog.h"
 #include "asi_ccd.hpp"
 #include "hello_imgui/hello_imgui.h"
+#include "ser_playback.hpp"
+#include "thread_profile.hpp"
 class CameraWindow {
  public:
   CameraWindow() : camcurrent(0) {
@@ -28,6 +30,10 @@ class CameraWindow {
                       val->getDefaultName().c_str(), key);
       if (pCamera == nullptr) pCamera = val;
     }
+    // Always offered last, so there is something to run with no camera.
+    names.push_back("SER playback");
+    keys.push_back(PLAYBACK_KEY);
+    if (pCamera == nullptr) pCamera = pPlayback;
     long pages = sysconf(_SC_PHYS_PAGES);
     long page_size = sysconf(_SC_PAGE_SIZE);
     mTSysMem = page_size * pages / 1024 / 1024;
@@ -37,9 +43,21 @@ class CameraWindow {
     mSysMem = 512;
   }
   void gui() { guiHelp(); }
+  // Every camera there is a pipeline for: the loader's, then playback.
+  static std::vector<std::shared_ptr<CameraBase>> Cameras() {
+    std::vector<std::shared_ptr<CameraBase>> all;
+    for (auto const &[key, val] : loader.cameras) all.push_back(val);
+    all.push_back(pPlayback);
+    return all;
+  }
+  static void DisconnectAll() {
+    for (auto &camera : Cameras())
+      if (camera->is_connected) camera->Disconnect();
+  }
   std::vector<std::string> names;
   std::vector<int> keys;
-  static std::shared_ptr<ASICCD> pCamera;
+  static std::shared_ptr<CameraBase> pCamera;
+  static std::shared_ptr<SERPlaybackCamera> pPlayback;
   int camcurrent;
   std::vector<const char *> items_fmt;
   std::vector<const char *> items_bin;
@@ -49,11 +67,22 @@ class CameraWindow {
   std::thread thCapture;
 
  private:
+  // Text being typed into the input boxes below, one set per window.
+  char serFile[512] = "";
+  char newDir[512] = "";
+  char spillDir[512] = "";
+  // The streaming settings spillDir was filled from, to refill it when
+  // another camera is selected.
+  const STILL_STREAMING_STRUCT *spillFor = nullptr;
+  int pretriggerUnit = 0;
+  std::array<std::array<char, 64>, ThreadProfile::ROLES> cpus{};
+  uint32_t shownGeneration = 0;
+
+  // Each camera keeps its connection and capture while another is selected,
+  // so several can capture at once; what follows applies to the selected
+  // one.
   void guiHelp() {
     if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen)) {
-      if (cameraState == CameraState::Connected ||
-          cameraState == CameraState::Running)
-        ImGui::BeginDisabled();
       if (ImGui::Combo("Camera", &camcurrent,
                        reinterpret_cast<const char **>(names.data()),
                        names.size())) {
@@ -61,18 +90,22 @@ class CameraWindow {
           HelloImGui::Log(HelloImGui::LogLevel::Error, "No Camera was found");
           return;
         }
-        HelloImGui::Log(
-            HelloImGui::LogLevel::Info, "Selected %s Camera",
-            loader.cameras[keys[camcurrent]]->getDefaultName().c_str());
-        pCamera = loader.cameras[keys[camcurrent]];
+        if (keys[camcurrent] == PLAYBACK_KEY)
+          pCamera = pPlayback;
+        else
+          pCamera = loader.cameras[keys[camcurrent]];
+        if (pCamera->is_connected) ListFormats();
+        HelloImGui::Log(HelloImGui::LogLevel::Info, "Selected %s Camera",
+                        pCamera->getDefaultName().c_str());
         spdlog::info("Initializeded {} ", __func__);
-        spdlog::debug("Selected {} Camera ",
-                      loader.cameras[keys[camcurrent]]->getDefaultName());
+        spdlog::debug("Selected {} Camera ", pCamera->getDefaultName());
       }
+      guiRunning();
 
-      if (cameraState == CameraState::Connected ||
-          cameraState == CameraState::Running)
-        ImGui::EndDisabled();
+      CameraState cameraState = CameraState::Disconnected;
+      if (pCamera != nullptr && pCamera->is_connected)
+        cameraState = pCamera->is_running ? CameraState::Running
+                                          : CameraState::Connected;
       switch (cameraState) {
         case CameraState::Disconnected:
           if (ImGui::Button(ICON_FA_LINK " Connect")) {
@@ -82,24 +115,15 @@ class CameraWindow {
               spdlog::error("No Camera was found");
               return;
             }
-            pCamera->Connect();
-            cameraState = CameraState::Connected;
+            if (!pCamera->Connect()) {
+              HelloImGui::Log(HelloImGui::LogLevel::Error,
+                              "Failed to connect %s",
+                              names[camcurrent].c_str());
+              break;
+            }
             pCamera->CreateControls();
             pCamera->RetrieveControls(true);
-
-            items_fmt.clear();
-            items_fmt.reserve(pCamera->m_supportedFormat_str.size());
-            for (size_t index = 0;
-                 index < pCamera->m_supportedFormat_str.size(); ++index) {
-              items_fmt.push_back(
-                  pCamera->m_supportedFormat_str[index].c_str());
-            }
-            items_bin.clear();
-            items_bin.reserve(pCamera->m_supportedBin.size());
-            for (size_t index = 0; index < pCamera->m_supportedBin.size();
-                 ++index) {
-              items_bin.push_back(pCamera->m_supportedBin[index].c_str());
-            }
+            ListFormats();
 
             HelloImGui::Log(HelloImGui::LogLevel::Info,
                             "Camera %s (%d) connected",
@@ -110,22 +134,26 @@ class CameraWindow {
           if (ImGui::Button(ICON_FA_STOP_CIRCLE " Disconnect")) {
             pCamera->Disconnect();
             // camera.reset();
-            cameraState = CameraState::Disconnected;
             HelloImGui::Log(HelloImGui::LogLevel::Info,
                             "Camera %s (%d) disconnected",
                             names[camcurrent].c_str(), camcurrent);
           }
-          if (pCamera->is_running) cameraState = CameraState::Running;
           break;
         case CameraState::Running:
           ImGui::BeginDisabled();
           ImGui::Text(ICON_FA_ROCKET " Acquiring");
           ImGui::EndDisabled();
-          if (!pCamera->is_running) cameraState = CameraState::Connected;
           break;
       }
     }
     if (pCamera.get() == nullptr) return;
+    if (pCamera == pPlayback)
+      if (ImGui::CollapsingHeader("Playback", ImGuiTreeNodeFlags_DefaultOpen))
+        guiPlayback();
+    if (auto synth = std::dynamic_pointer_cast<SyntheticCamera>(pCamera))
+      if (ImGui::CollapsingHeader("Synthetic source",
+                                  ImGuiTreeNodeFlags_DefaultOpen))
+        guiSynthetic(*synth);
     if (names.size() > 0)
       if (ImGui::CollapsingHeader("Camera info",
                                   ImGuiTreeNodeFlags_DefaultOpen))
@@ -135,7 +163,7 @@ class CameraWindow {
                                   ImGuiTreeNodeFlags_DefaultOpen))
         guiControl();
     }
-    if (pCamera->is_connected) {
+    if (pCamera->is_connected && pCamera != pPlayback) {
       if (ImGui::CollapsingHeader("Camera Resolution Control",
                                   ImGuiTreeNodeFlags_DefaultOpen))
         guiResolution();
@@ -145,9 +173,33 @@ class CameraWindow {
                                   ImGuiTreeNodeFlags_DefaultOpen))
         guiAcquisition();
     }
+    if (ImGui::CollapsingHeader("Threads")) guiThreads();
   }
   enum class CameraState { Connected, Disconnected, Running };
-  CameraState cameraState = CameraState::Disconnected;
+  static constexpr int PLAYBACK_KEY = -1;
+
+  // The selected camera's formats and bins, for the resolution combos.
+  void ListFormats() {
+    items_fmt.clear();
+    items_fmt.reserve(pCamera->m_supportedFormat_str.size());
+    for (size_t index = 0; index < pCamera->m_supportedFormat_str.size();
+         ++index) {
+      items_fmt.push_back(pCamera->m_supportedFormat_str[index].c_str());
+    }
+    items_bin.clear();
+    items_bin.reserve(pCamera->m_supportedBin.size());
+    for (size_t index = 0; index < pCamera->m_supportedBin.size(); ++index) {
+      items_bin.push_back(pCamera->m_supportedBin[index].c_str());
+    }
+  }
+  // The cameras capturing, the selected one or not.
+  void guiRunning() {
+    std::string running;
+    for (const auto &camera : Cameras())
+      if (camera->is_running)
+        running += (running.empty() ? "" : ", ") + camera->getDevName();
+    if (!running.empty()) ImGui::TextDisabled("Capturing: %s", running.c_str());
+  }
 
   void guiInfo() {
     if (pCamera.get() == nullptr) return;
@@ -162,6 +214,84 @@ class CameraWindow {
     ImGui::Text("PixelSize: %0.3f", pCamera->mCameraInfo.PixelSize);
     ImGui::Text("BitDepth: %d", pCamera->mCameraInfo.BitDepth);
   }
+  // The recording to play back, chosen while disconnected, and its pacing,
+  // which may be changed while it plays.
+  void guiPlayback() {
+    if (pPlayback->is_connected) ImGui::BeginDisabled();
+    ImGui::InputText("Recording", serFile, sizeof(serFile));
+    ImGui::SameLine();
+    if (ImGui::Button(ICON_FA_FOLDER_OPEN "..."))
+      ifd::FileDialog::Instance().Open("SEROpenDialog", "Open a recording",
+                                       "SER file (*.ser){.ser},.*");
+    bool spec = pPlayback->spec_byte_order;
+    if (ImGui::Checkbox("uiLittleEndian follows the spec", &spec))
+      pPlayback->spec_byte_order = spec;
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("Off for 16-bit files from software that uses the\n"
+                        "inverted reading.");
+    if (pPlayback->is_connected) ImGui::EndDisabled();
+    if (ifd::FileDialog::Instance().IsDone("SEROpenDialog")) {
+      if (ifd::FileDialog::Instance().HasResult())
+        snprintf(serFile, sizeof(serFile), "%s",
+                 ifd::FileDialog::Instance().GetResult().string().c_str());
+      ifd::FileDialog::Instance().Close();
+    }
+    if (!pPlayback->is_connected && pPlayback->getFile() != serFile)
+      pPlayback->SetFile(serFile);
+
+    const char *timings[] = {"Original timing", "Fixed rate",
+                             "As fast as possible"};
+    int timing = int(pPlayback->timing.load());
+    if (ImGui::Combo("Pace", &timing, timings, IM_ARRAYSIZE(timings)))
+      pPlayback->timing = PlaybackTiming(timing);
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("Original timing uses the SER trailer, or the fixed\n"
+                        "rate if the file has none.");
+    if (pPlayback->timing != PlaybackTiming::AsFastAsPossible) {
+      float rate = pPlayback->fps;
+      if (ImGui::SliderFloat("Rate (fps)", &rate, 1, 1000, "%.0f",
+                             ImGuiSliderFlags_Logarithmic))
+        pPlayback->fps = rate;
+    }
+    bool loop = pPlayback->loop;
+    if (ImGui::Checkbox("Loop", &loop)) pPlayback->loop = loop;
+  }
+  // The made-up sensor, chosen while disconnected, and the rate, drops and
+  // jitter, which may be changed while capturing.
+  void guiSynthetic(SyntheticCamera &synth) {
+    if (synth.is_connected) ImGui::BeginDisabled();
+    int size[2] = {int(synth.sensor.width), int(synth.sensor.height)};
+    if (ImGui::InputInt2("Sensor (W x H)", size)) {
+      synth.sensor.width = std::clamp(size[0], 8, 16384);
+      synth.sensor.height = std::clamp(size[1], 2, 16384);
+    }
+    const char *patterns[] = {"Mono", "RGGB", "BGGR", "GRBG", "GBRG"};
+    int pattern = synth.sensor.color ? int(synth.sensor.pattern) + 1 : 0;
+    if (ImGui::Combo("Colour filter", &pattern, patterns,
+                     IM_ARRAYSIZE(patterns))) {
+      synth.sensor.color = pattern > 0;
+      if (pattern > 0) synth.sensor.pattern = ASI_BAYER_PATTERN(pattern - 1);
+    }
+    ImGui::SliderInt("ADC bits", &synth.sensor.bit_depth, 8, 16);
+    if (synth.is_connected) ImGui::EndDisabled();
+
+    bool unthrottled = synth.fps == 0;
+    if (ImGui::Checkbox("As fast as possible", &unthrottled))
+      synth.fps = unthrottled ? 0 : 100;
+    if (!unthrottled) {
+      float rate = synth.fps;
+      if (ImGui::SliderFloat("Rate (fps)", &rate, 1, 10000, "%.0f",
+                             ImGuiSliderFlags_Logarithmic))
+        synth.fps = rate;
+    }
+    float drop = synth.drop_percent;
+    if (ImGui::SliderFloat("Dropped frames", &drop, 0, 50, "%.1f %%"))
+      synth.drop_percent = drop;
+    float jitter = synth.jitter_us;
+    if (ImGui::SliderFloat("Timing jitter", &jitter, 0, 10000, "%.0f us",
+                           ImGuiSliderFlags_Logarithmic))
+      synth.jitter_us = jitter;
+  }
   void guiControl() {
     for (auto &cap : pCamera->mControlCaps) {
       if (cap.IsWritable == ASI_FALSE) continue;
@@ -260,6 +390,34 @@ class CameraWindow {
     namespace fs = std::filesystem;
     if (pCamera->is_running) ImGui::BeginDisabled();
     ImGui::SliderInt("Buffer Size", &mSysMem, 256, mTSysMem * 0.6);
+    {
+      auto *ptrS = pCamera->getStreamingFramePtr();
+      int slots = int(ptrS->convert_slots);
+      if (ImGui::SliderInt("Conversion queue", &slots, 0, 64))
+        ptrS->convert_slots = size_t(slots);
+      if (ImGui::IsItemHovered())
+        ImGui::SetTooltip(
+            "Frames RGB24 conversion may lag the camera by, on its own "
+            "thread.\n0 converts on the capture thread.");
+    }
+    if (pCamera->is_running) ImGui::EndDisabled();
+    {
+      // May be changed while capturing; the capture thread reads it per frame.
+      auto *ptrS = pCamera->getStreamingFramePtr();
+      const char *policies[] = {"Drop newest (contiguous recording)",
+                                "Overwrite oldest (fresh live view)",
+                                "Block with timeout (slow sources)"};
+      int policy = int(ptrS->overflow_policy.load());
+      if (ImGui::Combo("When buffer is full", &policy, policies,
+                       IM_ARRAYSIZE(policies)))
+        ptrS->overflow_policy = OverflowPolicy(policy);
+      if (ptrS->overflow_policy == OverflowPolicy::BlockWithTimeout) {
+        int timeout = ptrS->block_timeout_ms;
+        if (ImGui::SliderInt("Block timeout (ms)", &timeout, 1, 1000))
+          ptrS->block_timeout_ms = timeout;
+      }
+    }
+    if (pCamera->is_running) ImGui::BeginDisabled();
     ImGui::InputText("Directory",
                      &(pCamera->getStreamingFramePtr()->selectedFilename[0]),
                      512);
@@ -300,6 +458,8 @@ class CameraWindow {
             std::filesystem::space(path_rec, ec).available / 1024 / 1024;
       }
     }
+    guiSpill();
+    guiTrigger();
     if (!pCamera->is_running) {
       if (ImGui::Button(ICON_FA_TV " Capture Frame")) {
         pCamera->DoCaptureHelper();
@@ -314,12 +474,210 @@ class CameraWindow {
       }
       if (pCamera->getStreamingFramePtr()->fSpace > 1) {
         ImGui::SameLine();
-        ImGui::Checkbox(ICON_FA_STOP " Record",
-                        &(pCamera->getStreamingFramePtr()->do_record));
+        auto *ptrS = pCamera->getStreamingFramePtr();
+        bool record = ptrS->do_record;
+        if (ImGui::Checkbox(ICON_FA_STOP " Record", &record))
+          ptrS->do_record = record;
+      }
+    }
+  }
+  // CPUs and scheduling of the threads by role (ThreadProfile). The capture
+  // and conversion threads take changes at the next start, the rest now;
+  // what each got is on the statistics panel.
+  void guiThreads() {
+    namespace TP = ThreadProfile;
+    const char *presets[] = {"Default", "Capture alone on the last core",
+                             "Custom"};
+    int preset = int(TP::GetPreset());
+    if (ImGui::Combo("Profile", &preset, presets, IM_ARRAYSIZE(presets)) &&
+        TP::Preset(preset) != TP::Preset::Custom)
+      TP::UsePreset(TP::Preset(preset));
+    const char *scheds[] = {"Default", "Nice", "SCHED_FIFO", "SCHED_RR"};
+    const bool reload = shownGeneration != TP::Generation();
+    shownGeneration = TP::Generation();
+    if (!ImGui::BeginTable("##threads", 4, ImGuiTableFlags_SizingFixedFit))
+      return;
+    ImGui::TableSetupColumn("Role");
+    ImGui::TableSetupColumn("CPUs");
+    ImGui::TableSetupColumn("Policy");
+    ImGui::TableSetupColumn("Priority");
+    ImGui::TableHeadersRow();
+    for (size_t i = 0; i < TP::ROLES; i++) {
+      const TP::Role role = TP::Role(i);
+      TP::Profile p = TP::Get(role);
+      bool changed = false;
+      if (reload)
+        snprintf(cpus[i].data(), cpus[i].size(), "%s",
+                 TP::FormatCpus(p.cpus).c_str());
+      ImGui::PushID(int(i));
+      ImGui::TableNextRow();
+      ImGui::TableSetColumnIndex(0);
+      ImGui::Text("%s", TP::RoleName(role));
+      ImGui::TableSetColumnIndex(1);
+      ImGui::SetNextItemWidth(90);
+      uint64_t mask;
+      if (ImGui::InputText("##cpus", cpus[i].data(), cpus[i].size()) &&
+          TP::ParseCpus(cpus[i].data(), mask)) {
+        p.cpus = mask;
+        changed = true;
+      }
+      if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("e.g. 3 or 0-2,5; empty for any");
+      ImGui::TableSetColumnIndex(2);
+      ImGui::SetNextItemWidth(110);
+      int sched = int(p.sched);
+      if (ImGui::Combo("##sched", &sched, scheds, IM_ARRAYSIZE(scheds))) {
+        p.sched = TP::Sched(sched);
+        p.priority = p.sched == TP::Sched::FIFO || p.sched == TP::Sched::RR
+                         ? 50
+                         : 0;
+        changed = true;
+      }
+      ImGui::TableSetColumnIndex(3);
+      ImGui::SetNextItemWidth(90);
+      if (p.sched == TP::Sched::Nice)
+        changed |= ImGui::SliderInt("##prio", &p.priority, -20, 19);
+      else if (p.sched != TP::Sched::Default)
+        changed |= ImGui::SliderInt("##prio", &p.priority, 1, 99);
+      if (changed) TP::Set(role, p);
+      ImGui::PopID();
+    }
+    ImGui::EndTable();
+  }
+  // Recorder settings: the SER writer backend, its batch size and the scratch
+  // space it spills to when the ring fills up. The backend and the spill
+  // settings take effect when a recording starts.
+  void guiSpill() {
+    auto *ptrS = pCamera->getStreamingFramePtr();
+    const char *backends[] = {"Buffered (page cache)",
+                              "Direct (O_DIRECT + io_uring)",
+                              "Compressed (lossless .serz)",
+                              "Bit-packed (ADC depth .serz)"};
+    int backend = int(ptrS->writer_backend.load());
+    if (ImGui::Combo("SER writer", &backend, backends,
+                     IM_ARRAYSIZE(backends)))
+      ptrS->writer_backend = SER::WriterBackend(backend);
+    const char *orders[] = {"Little endian (spec)",
+                            "Little endian (legacy flag)",
+                            "Big endian (legacy flag)"};
+    int order = int(ptrS->byte_order.load());
+    if (ImGui::Combo("16-bit byte order", &order, orders,
+                     IM_ARRAYSIZE(orders)))
+      ptrS->byte_order = SER::SERByteOrder(order);
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip(
+          "Spec: uiLittleEndian = 1 means little endian. Legacy: the\n"
+          "inverted reading older software uses. .serz keeps host order.");
+    int batch = int(ptrS->max_batch_bytes / (1024 * 1024));
+    if (ImGui::SliderInt("Write batch (MB)", &batch, 1, 1024, "%d",
+                         ImGuiSliderFlags_Logarithmic))
+      ptrS->max_batch_bytes = size_t(batch) * 1024 * 1024;
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("Most the recorder writes at once; takes effect now.");
+    if (spillFor != ptrS) {
+      snprintf(spillDir, sizeof(spillDir), "%s",
+               ptrS->SpillDirectory().c_str());
+      spillFor = ptrS;
+    }
+    if (ptrS->is_recording) ImGui::BeginDisabled();
+    guiStripes(ptrS);
+    int mb = int(ptrS->spill_mb);
+    if (ImGui::SliderInt("Spill to disk (MB)", &mb, 0, 64 * 1024))
+      ptrS->spill_mb = mb;
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("0 disables it. Use a fast local disk.");
+    if (ptrS->spill_mb > 0) {
+      if (ImGui::InputText("Spill directory", spillDir, sizeof(spillDir)))
+        ptrS->SetSpillDirectory(spillDir);
+      int hw = int(ptrS->spill_high_water * 100);
+      if (ImGui::SliderInt("Spill above (% of buffer)", &hw, 10, 95))
+        ptrS->spill_high_water = hw / 100.f;
+    }
+    if (ptrS->is_recording) ImGui::EndDisabled();
+  }
+  // Directories a recording is striped across besides the main one, and the
+  // size each SER file is rotated at.
+  void guiStripes(STILL_STREAMING_STRUCT *ptrS) {
+    auto dirs = ptrS->Stripes();
+    for (size_t i = 0; i < dirs.size(); i++) {
+      ImGui::PushID(int(i));
+      if (ImGui::Button(ICON_FA_TRASH)) {
+        dirs.erase(dirs.begin() + i);
+        ptrS->SetStripes(dirs);
+        ImGui::PopID();
+        break;
       }
+      ImGui::SameLine();
+      ImGui::Text("Stripe %d: %s", int(i + 1), dirs[i].c_str());
+      ImGui::PopID();
+    }
+    ImGui::InputText("##stripe", newDir, sizeof(newDir));
+    ImGui::SameLine();
+    if (ImGui::Button("Add stripe") && newDir[0] != '\0') {
+      std::error_code ec;
+      if (!std::filesystem::is_directory(newDir, ec))
+        spdlog::error("{} is not a directory", newDir);
+      else {
+        dirs.push_back(newDir);
+        ptrS->SetStripes(dirs);
+      }
+      newDir[0] = '\0';
+    }
+    if (!dirs.empty()) {
+      const char *modes[] = {"Round robin", "Weighted by disk speed"};
+      int mode = int(ptrS->stripe_mode.load());
+      if (ImGui::Combo("Striping", &mode, modes, IM_ARRAYSIZE(modes)))
+        ptrS->stripe_mode = SER::StripeMode(mode);
+    }
+    int rotate = int(ptrS->rotate_mb);
+    if (ImGui::SliderInt("Rotate files at (MB)", &rotate, 0, 64 * 1024))
+      ptrS->rotate_mb = rotate;
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("0 never rotates; 4095 keeps FAT32 happy.");
+  }
+  // Pre-trigger window and automatic trigger; both can be changed while
+  // capturing and apply to the next recording.
+  void guiTrigger() {
+    auto *ptrS = pCamera->getStreamingFramePtr();
+    const char *units[] = {"seconds", "frames"};
+    ImGui::SetNextItemWidth(100);
+    if (ImGui::Combo("Pre-trigger in", &pretriggerUnit, units,
+                     IM_ARRAYSIZE(units))) {
+      ptrS->pretrigger_s = 0;
+      ptrS->pretrigger_frames = 0;
+    }
+    ImGui::SameLine();
+    if (pretriggerUnit == 0) {
+      float s = ptrS->pretrigger_s;
+      if (ImGui::SliderFloat("Pre-trigger", &s, 0, 30, "%.1f s"))
+        ptrS->pretrigger_s = s;
+    } else {
+      int f = ptrS->pretrigger_frames;
+      if (ImGui::SliderInt("Pre-trigger", &f, 0, 10000))
+        ptrS->pretrigger_frames = f;
+    }
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("Frames already in the buffer when Record is pressed.");
+    bool autoTrigger = ptrS->auto_trigger;
+    if (ImGui::Checkbox("Auto trigger", &autoTrigger))
+      ptrS->auto_trigger = autoTrigger;
+    if (autoTrigger) {
+      ImGui::SameLine();
+      float jump = ptrS->trigger_jump, hold = ptrS->trigger_hold_s;
+      ImGui::SetNextItemWidth(120);
+      if (ImGui::SliderFloat("Jump", &jump, 1, 200, "%.0f %%"))
+        ptrS->trigger_jump = jump;
+      ImGui::SameLine();
+      ImGui::SetNextItemWidth(120);
+      if (ImGui::SliderFloat("Hold", &hold, 1, 60, "%.0f s"))
+        ptrS->trigger_hold_s = hold;
+      if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Recording stops this long after the last trigger.");
     }
   }
 };
-std::shared_ptr<ASICCD> CameraWindow::pCamera = nullptr;
+std::shared_ptr<CameraBase> CameraWindow::pCamera = nullptr;
+std::shared_ptr<SERPlaybackCamera> CameraWindow::pPlayback =
+    std::make_shared<SERPlaybackCamera>();
 
 #endif
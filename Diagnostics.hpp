@@ -0,0 +1,147 @@
+#ifndef __DIAGNOSTICS__
+#define __DIAGNOSTICS__
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include "Plots.hpp"
+#include "hello_imgui/hello_imgui.h"
+#include "implot/implot.h"
+#include "latency.hpp"
+#include "timer.hpp"
+
+// Latency of each stage of a camera's streaming pipeline and the frames lost,
+// by cause, since its capture started or the window was reset; see
+// diagStat_t.
+class DiagnosticsWidget {
+ public:
+  DiagnosticsWidget() { timer.Start(); }
+  void gui() { guiHelp(); }
+
+ private:
+  // Points of the percentile plot, from 0 to NINES nines (99.99 %).
+  static constexpr int NINES = 4;
+  static constexpr int POINTS = NINES * 10 + 1;
+  Timer timer;
+  int camera = 0;
+  const cameraStat_t* watched = nullptr;
+  uint32_t session = 0;
+  latencySnapshot_t baseline;
+  latencySnapshot_t shown;
+  int plotted = int(LatencyStage::Written);
+
+  void guiHelp() {
+    const size_t n = processStat.nCameras;
+    if (n == 0) {
+      ImGui::TextDisabled("No camera has captured yet");
+      return;
+    }
+    std::vector<const char*> names;
+    for (size_t i = 0; i < n; i++)
+      names.push_back(processStat.cameras[i].name.c_str());
+    camera = std::min(camera, int(n) - 1);
+    ImGui::SetNextItemWidth(200);
+    ImGui::Combo("Camera", &camera, names.data(), int(n));
+    cameraStat_t& cam = processStat.cameras[camera];
+    diagStat_t& d = cam.diag;
+    bool refresh = false;
+    if (watched != &cam || session != d.session) {
+      watched = &cam;
+      session = d.session;
+      baseline = d.snapshot();
+      refresh = true;
+    }
+    if (ImGui::Button("Reset")) baseline = d.snapshot();
+    ImGui::SameLine();
+    ImGui::TextDisabled("since the capture started or the last reset");
+    if (refresh || timer.Finish() > 250) {
+      const latencySnapshot_t now = d.snapshot();
+      for (size_t i = 0; i < LATENCY_STAGES; i++)
+        shown[i] = now[i].since(baseline[i]);
+      timer.Start();
+    }
+
+    ImGui::Text("Frames lost: %lu in the camera, %lu at the ring, %lu behind "
+                "the writer",
+                (unsigned long)d.sdk_dropped,
+                (unsigned long)cam.ring.dropped,
+                (unsigned long)d.writer_lost);
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip(
+          "camera: dropped by the camera or its SDK\n"
+          "ring: refused as the streaming buffer was full\n"
+          "writer: in the buffer, but gone before the recorder got them");
+    ImGui::Text("Preview skipped %lu frames",
+                (unsigned long)d.preview_skipped);
+
+    LatencyTable();
+    PercentilePlot();
+  }
+
+  void LatencyTable() {
+    static const char* columns[] = {"Stage", "Frames", "Mean", "p50", "p90",
+                                    "p99",   "p99.9",  "Max"};
+    if (!ImGui::BeginTable("##latency", 8,
+                           ImGuiTableFlags_BordersOuter |
+                               ImGuiTableFlags_BordersV |
+                               ImGuiTableFlags_RowBg |
+                               ImGuiTableFlags_SizingFixedFit))
+      return;
+    for (const char* c : columns) ImGui::TableSetupColumn(c);
+    ImGui::TableHeadersRow();
+    for (size_t i = 0; i < LATENCY_STAGES; i++) {
+      const LatencyHistogram::Snapshot& s = shown[i];
+      const double ns[] = {s.mean_ns(),         double(s.percentile(0.5)),
+                           double(s.percentile(0.9)),
+                           double(s.percentile(0.99)),
+                           double(s.percentile(0.999)), double(s.max_ns)};
+      ImGui::TableNextRow();
+      ImGui::TableSetColumnIndex(0);
+      ImGui::Text("%s", LatencyLabel(LatencyStage(i)));
+      ImGui::TableSetColumnIndex(1);
+      ImGui::Text("%lu", (unsigned long)s.count);
+      for (size_t c = 0; c < 6; c++) {
+        ImGui::TableSetColumnIndex(int(c) + 2);
+        if (s.count)
+          ImGui::Text("%.2f ms", ns[c] / 1e6);
+        else
+          ImGui::TextDisabled("-");
+      }
+    }
+    ImGui::EndTable();
+  }
+
+  // Latency against percentile, the percentiles spaced by their nines as
+  // HdrHistogram plots them, so the tail gets as much room as the median.
+  void PercentilePlot() {
+    static const char* labels[] = {"0%", "90%", "99%", "99.9%", "99.99%"};
+    static const double ticks[] = {0, 1, 2, 3, 4};
+    const char* stages[LATENCY_STAGES];
+    for (size_t i = 0; i < LATENCY_STAGES; i++)
+      stages[i] = LatencyLabel(LatencyStage(i));
+    ImGui::SetNextItemWidth(200);
+    ImGui::Combo("Plotted", &plotted, stages, int(LATENCY_STAGES));
+    const LatencyHistogram::Snapshot& s = shown[plotted];
+    if (s.count == 0) return;
+    std::array<float, POINTS> x, y;
+    for (int i = 0; i < POINTS; i++) {
+      x[i] = float(i) / 10;
+      y[i] = s.percentile(1 - std::pow(10., -x[i])) / 1e6f;
+    }
+    if (ImPlot::BeginPlot("##percentiles", ImVec2(-1, 200))) {
+      ImPlot::SetupAxes("percentile", "ms");
+      ImPlot::SetupAxisTicks(ImAxis_X1, ticks, NINES + 1, labels);
+      ImPlot::SetupAxesLimits(0, NINES, 0,
+                              std::max(y[POINTS - 1] * 1.1f, 0.01f),
+                              ImGuiCond_Always);
+      ImPlot::PlotLine(LatencyLabel(LatencyStage(plotted)), x.data(),
+                       y.data(), POINTS);
+      ImPlot::EndPlot();
+    }
+  }
+};
+
+#endif
@@ -1,8 +1,15 @@
 #ifndef __PLOTS__
 #define __PLOTS__
 #include <spdlog/spdlog.h>
+
+#include <list>
+#include <mutex>
+#include <string>
+
 #include "SystemInformation.hpp"
 #include "circular_buffer.hpp"
+#include "latency.hpp"
+#include "spill_tier.hpp"
 #include "hello_imgui/hello_imgui.h"
 #include "imgui_md_wrapper/imgui_md_wrapper.h"
 #include "implot/implot.h"
@@ -11,20 +18,178 @@
 #include "sys/sysinfo.h"
 #include "sys/times.h"
 #include "sys/types.h"
+#include "telemetry.hpp"
+#include "thread_profile.hpp"
 #include "timer.hpp"
 
+// Snapshot of the streaming ring's overflow counters, published by the
+// capture thread and shown in the statistics panel.
+typedef struct {
+  std::atomic<OverflowPolicy> policy = OverflowPolicy::DropNewest;
+  std::atomic<uint64_t> dropped = 0;
+  std::atomic<uint64_t> overwritten = 0;
+  std::atomic<uint64_t> blocked = 0;
+  std::atomic<uint64_t> block_timeouts = 0;
+  std::atomic<uint64_t> blocked_us = 0;
+
+  void update(const RingCounters& c, OverflowPolicy p) {
+    policy = p;
+    dropped = c.dropped.load();
+    overwritten = c.overwritten.load();
+    blocked = c.blocked.load();
+    block_timeouts = c.block_timeouts.load();
+    blocked_us = c.blocked_us.load();
+  }
+} ringStat_t;
+
+// Spill tier state, published by the recorder thread while recording.
+typedef struct {
+  std::atomic<size_t> depth = 0;
+  std::atomic<size_t> capacity = 0;
+  std::atomic<uint64_t> spilled = 0;
+  std::atomic<uint64_t> lost = 0;
+  std::atomic<float> drain_fps = 0;
+  std::atomic_bool spilling = false;
+  TelemetrySeries depthSeries{500};
+  TelemetrySeries drainSeries{500};
+
+  void update(const SpillStats& s, uint64_t drained, uint32_t elapsed_ms) {
+    depth = s.depth;
+    capacity = s.capacity;
+    spilled = s.spilled;
+    lost = s.lost;
+    spilling = s.spilling;
+    drain_fps = elapsed_ms ? drained * 1000.f / elapsed_ms : 0.f;
+    depthSeries.push(float(s.depth));
+    drainSeries.push(drain_fps);
+  }
+} spillStat_t;
+
+// Where frames spend their time and where they get lost, for the
+// diagnostics panel and the recording summaries. Each histogram has one
+// writer: the streaming ring's producer (capture to publication), the
+// recorder (publication to written, and each call into the SER writer) or
+// the GUI thread (publication to shown in the viewport). The losses, by
+// cause, are since the capture started:
+//  - camera: frames the camera or SDK reports it dropped before we had them
+//  - ring: frames refused by the streaming ring or the conversion stage as
+//    they were full (ringStat_t::dropped)
+//  - writer: frames that were in the ring but never reached the recording,
+//    overwritten before the recorder read them or lost by the spill tier
+//  - preview: frames the preview skipped, which only matters to the eye
+enum class LatencyStage { Captured, Written, Displayed, WriteCall, COUNT };
+constexpr size_t LATENCY_STAGES = size_t(LatencyStage::COUNT);
+// Label for the panel and key for the JSON summary.
+inline const char* LatencyLabel(LatencyStage s) {
+  static const char* labels[] = {"capture > publish", "publish > written",
+                                 "publish > displayed", "write call"};
+  return labels[int(s)];
+}
+inline const char* LatencyKey(LatencyStage s) {
+  static const char* keys[] = {"capture_to_publish", "publish_to_written",
+                               "publish_to_displayed", "write_call"};
+  return keys[int(s)];
+}
+typedef std::array<LatencyHistogram::Snapshot, LATENCY_STAGES>
+    latencySnapshot_t;
+
+typedef struct {
+  std::array<LatencyHistogram, LATENCY_STAGES> latency;
+  std::atomic<uint64_t> sdk_dropped = 0;
+  std::atomic<uint64_t> writer_lost = 0;
+  std::atomic<uint64_t> preview_skipped = 0;
+  // Bumped by start(); the panel starts its window over when it changes.
+  std::atomic<uint32_t> session = 0;
+
+  LatencyHistogram& at(LatencyStage s) { return latency[size_t(s)]; }
+  latencySnapshot_t snapshot() const {
+    latencySnapshot_t s;
+    for (size_t i = 0; i < LATENCY_STAGES; i++) s[i] = latency[i].snapshot();
+    return s;
+  }
+  // By the capture thread with a new streaming ring, before it publishes.
+  void start(Circular_Buffer<uint8_t>& ring) {
+    ring.set_publish_latency(&at(LatencyStage::Captured));
+    sdk_dropped = 0;
+    writer_lost = 0;
+    preview_skipped = 0;
+    session++;
+  }
+} diagStat_t;
+
+// One camera's statistics. fps, capture rate, ring and diagnostics are
+// published by its capture thread, the write rate and spill by its recorder,
+// every 500 ms.
+typedef struct {
+  std::string name;  // set before the slot is counted, never changed
+  TelemetrySeries fps{500};
+  TelemetrySeries captureMBps{500};
+  TelemetrySeries writeMBps{500};
+  ringStat_t ring;
+  spillStat_t spill;
+  diagStat_t diag;
+  // When the capture thread last published; 0 before it ever did.
+  std::atomic<uint64_t> published_ns = 0;
+
+  // Capturing video: published within the last second.
+  bool active() const {
+    const uint64_t t = published_ns;
+    return t != 0 && monotonic_ns() - t < 1000000000ull;
+  }
+  // By the capture thread.
+  void update(float _fps, const Circular_Buffer<uint8_t>& buffer,
+              OverflowPolicy p) {
+    fps.push(_fps);
+    captureMBps.push(_fps * buffer.frame_size() / (1024.f * 1024.f));
+    ring.update(buffer.get_counters(), p);
+    published_ns = monotonic_ns();
+  }
+} cameraStat_t;
+
+constexpr size_t MAX_CAMERAS = 8;
+
+// The cameras' slots are published by the cameras' threads, as above; the
+// rest is pushed by the GUI thread every 100 ms, the totals over the
+// cameras that are capturing included. Each series has exactly one writer.
 typedef struct {
-  CircularBuffer<float, 100> totalPhysMem;
-  CircularBuffer<float, 100> processMemUsage;
-  CircularBuffer<float, 100> totalCPUseage;
-  CircularBuffer<float, 100> processCPUseage;
-  std::array<CircularBuffer<float, 256>, 3> histograms_accumulated;
-  std::array<CircularBuffer<float, 256>, 3> histograms;
+  TelemetrySeries totalPhysMem{100};
+  TelemetrySeries processMemUsage{100};
+  TelemetrySeries totalCPUseage{100};
+  TelemetrySeries processCPUseage{100};
+  TelemetrySeries captureMBps{100};
+  TelemetrySeries writeMBps{100};
+  std::array<std::array<float, 256>, 3> histograms_accumulated;
+  std::array<std::array<float, 256>, 3> histograms;
   std::array<cv::MatND, 3> hist;
-  CircularBuffer<float, 100> fps;
   float max_phy;
   float max_fps;
   float max_buf;
+  // Slots [0, nCameras) are in use; they are never given back, so readers
+  // may walk them without a lock.
+  std::array<cameraStat_t, MAX_CAMERAS> cameras;
+  std::atomic<size_t> nCameras = 0;
+  std::mutex camerasMutex;
+  // Slots of the cameras beyond MAX_CAMERAS, one each, which no plot shows.
+  std::list<cameraStat_t> overflow;
+
+  // The slot of the camera called name, taken on first use.
+  cameraStat_t& camera(const std::string& name) {
+    std::lock_guard<std::mutex> lock(camerasMutex);
+    const size_t n = nCameras;
+    for (size_t i = 0; i < n; i++)
+      if (cameras[i].name == name) return cameras[i];
+    if (n == MAX_CAMERAS) {
+      for (auto& cam : overflow)
+        if (cam.name == name) return cam;
+      spdlog::warn("More than {} cameras; the statistics of {} are not shown",
+                   MAX_CAMERAS, name);
+      overflow.emplace_back().name = name;
+      return overflow.back();
+    }
+    cameras[n].name = name;
+    nCameras = n + 1;
+    return cameras[n];
+  }
 } processMem_t;
 processMem_t processStat;
 
@@ -39,30 +204,51 @@ class PlotWidget {
 
  private:
   Timer timer;
+  TelemetryRes history = TelemetryRes::Full;
   template <typename T>
   inline T RandomRange(T min, T max) {
     T scale = rand() / (T)RAND_MAX;
     return min + scale * (max - min);
   }
   void guiHelp() {
-    static int offset = 30 % 100;
-    offset = (offset + 1) % 100;
+    static const char* histories[] = {"Last 10 s", "Last 10 min", "Session"};
+    int h = int(history);
+    ImGui::SetNextItemWidth(150);
+    if (ImGui::Combo("History", &h, histories, IM_ARRAYSIZE(histories)))
+      history = TelemetryRes(h);
     static ImGuiTableFlags flags =
         ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV |
         ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable |
         ImGuiTableFlags_Reorderable;
     ImPlot::PushColormap(ImPlotColormap_Deep);
     if (ImGui::BeginTable("##table", 2, flags, ImVec2(-1, 0))) {
-      ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_WidthFixed, 50.0f);
+      ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_WidthFixed,
+                              120.0f);
       ImGui::TableSetupColumn("Trace");
       ImGui::TableHeadersRow();
       ImPlot::PushColormap(ImPlotColormap_Cool);
-      TablePlot("FPS", processStat.fps.get_buffer(), 0, 100); 
-      TablePlot("Total CPU", processStat.totalCPUseage.get_buffer(), 0); 
-      TablePlot("Free RAM", processStat.totalPhysMem.get_buffer(), 0, processStat.max_phy); 
-      TablePlot("Self CPU", processStat.processCPUseage.get_buffer(), 0); 
-      TablePlot("Self RAM", processStat.processMemUsage.get_buffer(), 0, processStat.max_phy); 
+      const size_t n = processStat.nCameras;
+      for (size_t i = 0; i < n; i++) {
+        cameraStat_t& cam = processStat.cameras[i];
+        if (!cam.active()) continue;
+        ImGui::PushID(int(i));
+        TablePlot(cam.name + " FPS", cam.fps, 0, 0);
+        if (cam.spill.capacity > 0) {
+          TablePlot("Spill", cam.spill.depthSeries, 0, cam.spill.capacity);
+          TablePlot("Drain", cam.spill.drainSeries, 0, 100);
+        }
+        ImGui::PopID();
+      }
+      TablePlot("Capture MB/s", processStat.captureMBps, 1, 0);
+      TablePlot("Write MB/s", processStat.writeMBps, 2, 0);
+      TablePlot("Total CPU", processStat.totalCPUseage, 0); 
+      TablePlot("Free RAM", processStat.totalPhysMem, 0, processStat.max_phy); 
+      TablePlot("Self CPU", processStat.processCPUseage, 0); 
+      TablePlot("Self RAM", processStat.processMemUsage, 0, processStat.max_phy); 
       ImPlot::PopColormap();
+      ThroughputRow();
+      RingRow();
+      ThreadsRow();
       ImGui::EndTable();
     }
     if (timer.Finish() > 100) {
@@ -70,29 +256,104 @@ class PlotWidget {
       timer.Start();
     }
   }
-  template <typename T>
-  void TablePlot(std::string str, T* data, int row, float _max = 100) {
+  // Frames and bytes per second of each camera that is capturing, and the
+  // totals.
+  void ThroughputRow() {
+    ImGui::TableNextRow();
+    ImGui::TableSetColumnIndex(0);
+    ImGui::Text("Throughput");
+    ImGui::TableSetColumnIndex(1);
+    const size_t n = processStat.nCameras;
+    for (size_t i = 0; i < n; i++) {
+      const cameraStat_t& cam = processStat.cameras[i];
+      if (!cam.active()) continue;
+      ImGui::Text("%s: %.1f fps, %.1f MB/s captured, %.1f MB/s written",
+                  cam.name.c_str(), cam.fps.last(), cam.captureMBps.last(),
+                  cam.writeMBps.last());
+    }
+    ImGui::Text("all: %.1f MB/s captured, %.1f MB/s written",
+                processStat.captureMBps.last(), processStat.writeMBps.last());
+  }
+  void RingRow() {
+    static const char* policies[] = {"drop newest", "overwrite oldest",
+                                     "block"};
+    ImGui::TableNextRow();
+    ImGui::TableSetColumnIndex(0);
+    ImGui::Text("Ring");
+    ImGui::TableSetColumnIndex(1);
+    const size_t n = processStat.nCameras;
+    for (size_t i = 0; i < n; i++) {
+      const cameraStat_t& cam = processStat.cameras[i];
+      if (!cam.active()) continue;
+      ImGui::Text("%s, %s: dropped %lu, overwritten %lu", cam.name.c_str(),
+                  policies[int(cam.ring.policy.load())],
+                  (unsigned long)cam.ring.dropped,
+                  (unsigned long)cam.ring.overwritten);
+      ImGui::Text("blocked %lu times (%lu timed out), %.1f ms total",
+                  (unsigned long)cam.ring.blocked,
+                  (unsigned long)cam.ring.block_timeouts,
+                  cam.ring.blocked_us / 1000.);
+      if (cam.spill.capacity > 0)
+        ImGui::Text("spill %s: %lu/%lu frames on disk, draining %.1f fps, "
+                    "%lu spilled, %lu lost",
+                    cam.spill.spilling ? "active" : "idle",
+                    (unsigned long)cam.spill.depth,
+                    (unsigned long)cam.spill.capacity,
+                    cam.spill.drain_fps.load(),
+                    (unsigned long)cam.spill.spilled,
+                    (unsigned long)cam.spill.lost);
+    }
+  }
+  // What each thread role got of its CPUs and scheduling settings.
+  void ThreadsRow() {
+    ImGui::TableNextRow();
+    ImGui::TableSetColumnIndex(0);
+    ImGui::Text("Threads");
+    ImGui::TableSetColumnIndex(1);
+    for (size_t i = 0; i < ThreadProfile::ROLES; i++) {
+      const auto role = ThreadProfile::Role(i);
+      const ThreadProfile::Status s = ThreadProfile::GetStatus(role);
+      if (!s.applied) continue;
+      ImGui::Text("%s (%d): %s%s%s", ThreadProfile::RoleName(role),
+                  int(s.tid), s.got.c_str(), s.error.empty() ? "" : " - ",
+                  s.error.c_str());
+    }
+  }
+  // _max <= 0 scales the plot to the samples shown.
+  void TablePlot(std::string str, const TelemetrySeries& series, int row,
+                 float _max = 100) {
     ImGui::TableNextRow();
     ImGui::TableSetColumnIndex(0);
     ImGui::Text("%s", str.c_str());
     ImGui::TableSetColumnIndex(1);
     ImGui::PushID(row);
-    Sparkline("##spark", data, 100, 0, _max, 
+    TelemetryView v = series.view(history);
+    if (_max <= 0)
+      _max = std::max(v.count ? *std::max_element(v.data, v.data + v.count)
+                              : 0.f,
+                      1.f) *
+             1.2f;
+    Sparkline("##spark", v.data, v.count, series.window(history), 0, _max,
               ImPlot::GetColormapColor(row), ImVec2(-1, 35));
     ImGui::PopID();
   }
-  void Sparkline(const char* id, const float* values, int count, float min_v,
-                 float max_v, const ImVec4& col,
+  // Plots `count` samples right-aligned in a window of `span` samples, so a
+  // series that is still filling up grows in from the right.
+  void Sparkline(const char* id, const float* values, int count, int span,
+                 float min_v, float max_v, const ImVec4& col,
                  const ImVec2& size) {
     ImPlot::PushStyleVar(ImPlotStyleVar_PlotPadding, ImVec2(0, 0));
     if (ImPlot::BeginPlot(id, size,
                           ImPlotFlags_CanvasOnly | ImPlotFlags_NoChild)) {
       ImPlot::SetupAxes(nullptr, nullptr, ImPlotAxisFlags_NoDecorations,
                         ImPlotAxisFlags_NoDecorations);
-      ImPlot::SetupAxesLimits(0, count - 1, min_v, max_v, ImGuiCond_Always);
-      ImPlot::SetNextLineStyle(col);
-      ImPlot::SetNextFillStyle(col, 0.25);
-      ImPlot::PlotLine(id, values, count, 1, 0, ImPlotLineFlags_Shaded, 0);
+      ImPlot::SetupAxesLimits(0, span - 1, min_v, max_v, ImGuiCond_Always);
+      if (count > 0) {
+        ImPlot::SetNextLineStyle(col);
+        ImPlot::SetNextFillStyle(col, 0.25);
+        ImPlot::PlotLine(id, values, count, 1, span - count,
+                         ImPlotLineFlags_Shaded, 0);
+      }
       ImPlot::EndPlot();
     }
     ImPlot::PopStyleVar();
@@ -108,6 +369,17 @@ class PlotWidget {
     processStat.processMemUsage.push(process.GetMemoryUsage());
 
     processStat.max_phy = sys_info.GetTotalMemory();
+
+    float captured = 0, written = 0;
+    const size_t n = processStat.nCameras;
+    for (size_t i = 0; i < n; i++) {
+      const cameraStat_t& cam = processStat.cameras[i];
+      if (!cam.active()) continue;
+      captured += cam.captureMBps.last();
+      written += cam.writeMBps.last();
+    }
+    processStat.captureMBps.push(captured);
+    processStat.writeMBps.push(written);
   }
 
 };
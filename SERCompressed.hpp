@@ -0,0 +1,475 @@
+#ifndef __SER_COMPRESSED__
+#define __SER_COMPRESSED__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SERProcessor.hpp"
+#include "bitpack.hpp"
+#include "ser_codec.hpp"
+#include "thread_profile.hpp"
+#include "worker_pool.hpp"
+
+namespace SER {
+
+//-------------------------------------------------------------------
+// .serz: SER with every frame losslessly compressed (see SliceCodec) or
+// bit-packed to the depth the sensor actually uses (see BitPack).
+//
+//   magic[8] "ACSERZ\0\1"
+//   SERHeader               as in a SER file
+//   records                 one per frame, in order
+//   u64 offset[frames]      index: where each record starts
+//   footer                  u64 index offset, u32 frames, u32 0, "ACSERZIX"
+//
+// A record is a SERZRecord followed by the raw frame (SERZ_RAW, used when
+// coding does not pay), by u32 bytes[slices] and the coded slices
+// (SERZ_SLICED), or by u8 bits, u8 shift, 2 reserved and the packed samples
+// (SERZ_PACKED). The
+// timestamp sits in the record, so a file that lost its index and footer to
+// a crash can still be read by walking the records. All fields are in host
+// byte order, i.e. little endian on the platforms we build for.
+//-------------------------------------------------------------------
+static constexpr char SERZ_MAGIC[8] = {'A', 'C', 'S', 'E', 'R', 'Z', 0, 1};
+static constexpr char SERZ_INDEX_MAGIC[8] = {'A', 'C', 'S', 'E',
+                                             'R', 'Z', 'I', 'X'};
+
+enum SERZMethod : uint8_t { SERZ_RAW = 0, SERZ_SLICED = 1, SERZ_PACKED = 2 };
+
+#pragma pack(push, 1)
+struct SERZRecord {
+  uint32_t bytes;    // after this header
+  uint8_t method;    // SERZMethod
+  uint8_t reserved;
+  uint16_t slices;
+  uint64_t datetime;  // SER ticks
+};
+struct SERZFooter {
+  uint64_t index_offset;
+  uint32_t frames;
+  uint32_t reserved;
+  char magic[8];
+};
+#pragma pack(pop)
+
+// Codec layout of frames with the given header.
+inline CodecLayout SERZLayout(const SERHeader &h) {
+  CodecLayout l;
+  l.width = h.uiImageWidth;
+  l.height = h.uiImageHeight;
+  l.planes = h.uiColorID >= COLOR_RGB ? 3 : 1;
+  l.bytes = SERSampleBytes(h);
+  l.bayer = h.uiColorID >= COLOR_BAYER_RGGB && h.uiColorID < COLOR_RGB;
+  return l;
+}
+// Slices per frame: about SLICE_BYTES of raw data each.
+inline uint32_t SERZSlices(const CodecLayout &l) {
+  constexpr size_t SLICE_BYTES = 512 * 1024;
+  return uint32_t(std::clamp<size_t>(l.frame_bytes() / SLICE_BYTES, 1,
+                                     std::min<size_t>(l.height, 65535)));
+}
+
+// Threads shared by every compressing writer and reader: half the cores,
+// the capture and recorder threads need the rest.
+inline WorkerPool &CompressionPool() {
+  static WorkerPool pool(
+      std::max(std::thread::hardware_concurrency() / 2, 1u) - 1,
+      [] { ThreadProfile::RefreshThread(ThreadProfile::Role::Worker); });
+  return pool;
+}
+
+//-------------------------------------------------------------------
+// Writer backend for .serz. A batch of frames is cut into slices that the
+// compression pool codes in parallel, while the recorder thread waits; the
+// coded batch then goes out with one pwritev(). Frames are read in place,
+// so nothing is copied on the way.
+//
+// With SERZ_PACKED, 16-bit frames are bit-packed instead, one frame per
+// pool task, which costs little more than a copy. The depth starts at the
+// ADC's (adc_bits, data at the top of the word) or else at the first frame's
+// and widens when a frame needs more, so nothing is ever lost.
+//-------------------------------------------------------------------
+class SERCompressedWriter : public SERWriterBase {
+ public:
+  SERCompressedWriter(std::string _fn, SERZMethod _method = SERZ_SLICED,
+                      int adc_bits = 0, WorkerPool &_pool = CompressionPool())
+      : pool(_pool), method(_method) {
+    fn = _fn;
+    if (adc_bits > 0 && adc_bits < 16) {
+      pack_shift = 16 - adc_bits;
+      pack_bits = adc_bits;
+    }
+    fd = open(fn.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      spdlog::critical("failed to open file: {}: {}", fn,
+                       std::strerror(errno));
+    }
+  }
+  ~SERCompressedWriter() {
+    spdlog::info("closing writter for: {}", fn);
+    if (isOpen()) close();
+    if (fd >= 0) ::close(fd);
+  }
+  bool isOpen() { return fd >= 0 && !failed; }
+  // Samples are kept in host order; serz_to_ser picks the SER's byte order.
+  void set_byte_order(SERByteOrder) {}
+
+ private:
+  struct Slice {
+    std::unique_ptr<uint8_t[]> data;
+    size_t capacity = 0;
+    size_t bytes = 0;
+  };
+  static constexpr size_t PACK_HEADER = 4;  // bits, shift, 2 reserved
+
+  WorkerPool &pool;
+  const SERZMethod method;
+  int fd = -1;
+  bool failed = false;
+  off_t pos = sizeof(SERZ_MAGIC) + sizeof(SERHeader);
+  std::vector<uint64_t> index;
+  std::vector<Slice> slices;  // of the batch being written
+  std::vector<SERZRecord> records;
+  std::vector<uint32_t> sizes;
+  std::vector<uint16_t> ors;  // of each packed frame
+  std::vector<iovec> iov;
+  uint64_t raw_bytes = 0;
+  uint64_t stored_bytes = 0;
+  int pack_shift = 0;
+  int pack_bits = 0;  // 0 until known
+
+  bool write_all(iovec *v, int n, off_t off) {
+    if (PwritevAll(fd, v, n, off)) return true;
+    spdlog::critical("Write to {} failed: {}", fn, std::strerror(errno));
+    failed = true;
+    return false;
+  }
+  void put_header(const SERHeader &h) {
+    iovec v[2] = {{const_cast<char *>(SERZ_MAGIC), sizeof(SERZ_MAGIC)},
+                  {const_cast<SERHeader *>(&h), sizeof(h)}};
+    write_all(v, 2, 0);
+  }
+  void append(const uint8_t *data, size_t bytes) {
+    iovec v{const_cast<uint8_t *>(data), bytes};
+    if (write_all(&v, 1, pos)) pos += bytes;
+  }
+  void reserve(size_t count, size_t cap) {
+    if (slices.size() < count) slices.resize(count);
+    for (size_t i = 0; i < count; i++)
+      if (slices[i].capacity < cap) {
+        slices[i].data.reset(new uint8_t[cap]);
+        slices[i].capacity = cap;
+      }
+  }
+  // Codes the batch into slices; per frame ns of them.
+  uint32_t code(const uint8_t *const *data, size_t n) {
+    const CodecLayout l = SERZLayout(*header);
+    const uint32_t ns = SERZSlices(l);
+    reserve(n * ns, SliceCodec::MaxEncoded(l, (l.height + ns - 1) / ns));
+    pool.run(n * ns, [&](size_t t) {
+      uint32_t first, rows;
+      l.slice_rows(t % ns, ns, first, rows);
+      slices[t].bytes = SliceCodec::Encode(l, data[t / ns], first, rows,
+                                           slices[t].data.get());
+    });
+    return ns;
+  }
+  // Packs the batch, one slice per frame.
+  void pack(const uint8_t *const *data, size_t n) {
+    const size_t samples = sz / 2;
+    reserve(n, PACK_HEADER + BitPack::PackedBytes(samples, 16));
+    if (pack_bits == 0)
+      BitPack::DepthOf(
+          BitPack::OrAll(reinterpret_cast<const uint16_t *>(data[0]), samples),
+          pack_shift, pack_bits);
+    ors.resize(n);
+    auto run = [&](size_t f) {
+      Slice &s = slices[f];
+      s.data[0] = uint8_t(pack_bits);
+      s.data[1] = uint8_t(pack_shift);
+      s.data[2] = s.data[3] = 0;
+      ors[f] = BitPack::Pack(reinterpret_cast<const uint16_t *>(data[f]),
+                             samples, pack_shift, pack_bits,
+                             s.data.get() + PACK_HEADER);
+      s.bytes = PACK_HEADER + BitPack::PackedBytes(samples, pack_bits);
+    };
+    pool.run(n, run);
+    // Frames that did not fit: widen the depth to cover them and redo them.
+    uint16_t wider = 0;
+    for (size_t f = 0; f < n; f++)
+      if (!BitPack::Fits(ors[f], pack_shift, pack_bits)) wider |= ors[f];
+    if (wider == 0) return;
+    int shift, bits;
+    BitPack::DepthOf(wider, shift, bits);
+    const int top = std::max(shift + bits, pack_shift + pack_bits);
+    pack_shift = std::min(shift, pack_shift);
+    pack_bits = top - pack_shift;
+    spdlog::info("{}: packing at {} bits from now on", fn, pack_bits);
+    std::vector<size_t> redo;
+    for (size_t f = 0; f < n; f++)
+      if (!BitPack::Fits(ors[f], slices[f].data[1], slices[f].data[0]))
+        redo.push_back(f);
+    pool.run(redo.size(), [&](size_t i) { run(redo[i]); });
+  }
+  void append_frames(const uint8_t *const *data, size_t n) {
+    const bool packed = method == SERZ_PACKED && SERSampleBytes(*header) == 2;
+    uint32_t ns = 1;
+    if (packed)
+      pack(data, n);
+    else
+      ns = code(data, n);
+
+    records.resize(n);
+    sizes.resize(n * ns);
+    iov.clear();
+    const uint64_t *dates = timestamp.data() + timestamp.size() - n;
+    off_t at = pos;
+    for (size_t f = 0; f < n; f++) {
+      SERZRecord &r = records[f];
+      size_t coded = packed ? 0 : ns * sizeof(uint32_t);
+      for (uint32_t s = 0; s < ns; s++) coded += slices[f * ns + s].bytes;
+      r.method = coded >= sz ? SERZ_RAW : packed ? SERZ_PACKED : SERZ_SLICED;
+      r.reserved = 0;
+      r.slices = r.method == SERZ_SLICED ? ns : 0;
+      r.bytes = r.method == SERZ_RAW ? sz : coded;
+      r.datetime = dates[f];
+      index.push_back(at);
+      at += sizeof(r) + r.bytes;
+      iov.push_back({&r, sizeof(r)});
+      if (r.method == SERZ_RAW) {
+        iov.push_back({const_cast<uint8_t *>(data[f]), sz});
+        continue;
+      }
+      if (r.method == SERZ_SLICED) {
+        for (uint32_t s = 0; s < ns; s++)
+          sizes[f * ns + s] = slices[f * ns + s].bytes;
+        iov.push_back({&sizes[f * ns], ns * sizeof(uint32_t)});
+      }
+      for (uint32_t s = 0; s < ns; s++) {
+        Slice &c = slices[f * ns + s];
+        iov.push_back({c.data.get(), c.bytes});
+      }
+    }
+    if (write_all(iov.data(), int(iov.size()), pos)) {
+      raw_bytes += n * sz;
+      stored_bytes += at - pos;
+      pos = at;
+    }
+  }
+  void append_trailer() {
+    SERZFooter f;
+    f.index_offset = pos;
+    f.frames = index.size();
+    f.reserved = 0;
+    std::memcpy(f.magic, SERZ_INDEX_MAGIC, sizeof(f.magic));
+    iovec v[2] = {{index.data(), index.size() * sizeof(uint64_t)},
+                  {&f, sizeof(f)}};
+    if (write_all(v, 2, pos))
+      pos += index.size() * sizeof(uint64_t) + sizeof(f);
+  }
+  void finish() {
+    spdlog::info("Closing file: {}: {} bytes written, {:.2f}x smaller than "
+                 "SER",
+                 fn, pos,
+                 stored_bytes ? double(raw_bytes) / stored_bytes : 1.0);
+    ::close(fd);
+    fd = -1;
+  }
+};
+
+//-------------------------------------------------------------------
+// Reader for .serz. ReadFrames() is thread-safe; it decodes the slices, or
+// unpacks the frames, of a whole request on the compression pool.
+//-------------------------------------------------------------------
+class SERCompressedReader : public SERBase {
+ public:
+  SERCompressedReader(std::string _fn) {
+    fn = _fn;
+    fd = open(fn.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      spdlog::critical("{}: {} could not be opened: {}", __func__, fn,
+                       std::strerror(errno));
+      return;
+    }
+    struct stat st;
+    char magic[sizeof(SERZ_MAGIC)];
+    if (fstat(fd, &st) != 0 || pread(fd, magic, sizeof(magic), 0) !=
+                                   ssize_t(sizeof(magic)) ||
+        std::memcmp(magic, SERZ_MAGIC, sizeof(magic)) != 0 ||
+        pread(fd, header.get(), sizeof(SERHeader), sizeof(magic)) !=
+            ssize_t(sizeof(SERHeader))) {
+      spdlog::critical("{}: {} is not a .serz file", __func__, fn);
+      return;
+    }
+    if (is_sysbig_endian) swapEndiannessHeader();
+    filesize = st.st_size;
+    layout = SERZLayout(*header);
+    frame_size = layout.frame_bytes();
+    if (!read_index() && !scan_records()) return;
+    spdlog::info("{}: {} frames of {} bytes in {}", __func__, offsets.size(),
+                 frame_size, fn);
+    ok = true;
+  }
+  ~SERCompressedReader() {
+    if (fd >= 0) close(fd);
+  }
+  SERCompressedReader(const SERCompressedReader &) = delete;
+  SERCompressedReader &operator=(const SERCompressedReader &) = delete;
+
+  bool isOpen() const { return ok; }
+  uint32_t FrameCount() const { return offsets.size(); }
+  size_t FrameSize() const { return frame_size; }
+  // Byte-swapped to host order.
+  const SERHeader &Header() const { return *header; }
+
+  // Decodes frames [first, first + n) into out[i], each FrameSize() bytes,
+  // and their capture times into utc_ns[i] (ns since the Unix epoch).
+  bool ReadFrames(uint32_t first, uint32_t n, uint8_t *const *out,
+                  uint64_t *utc_ns, WorkerPool &pool = CompressionPool()) {
+    if (!ok || n == 0 || first >= offsets.size() ||
+        n > offsets.size() - first)
+      return false;
+    // The records are back to back: one read for all of them.
+    const uint64_t begin = offsets[first];
+    const uint64_t end = first + n < offsets.size() ? offsets[first + n]
+                                                    : records_end;
+    std::vector<uint8_t> buf(end - begin);
+    if (!read_at(buf.data(), buf.size(), begin)) return false;
+
+    struct Task {
+      const uint8_t *in;
+      size_t len;
+      uint32_t frame, slice, slices;
+      uint8_t method;
+    };
+    std::vector<Task> tasks;
+    for (uint32_t f = 0; f < n; f++) {
+      const uint64_t at = offsets[first + f] - begin;
+      SERZRecord r;
+      if (at + sizeof(r) > buf.size()) return damaged(first + f);
+      std::memcpy(&r, buf.data() + at, sizeof(r));
+      const uint8_t *p = buf.data() + at + sizeof(r);
+      if (at + sizeof(r) + r.bytes > buf.size()) return damaged(first + f);
+      utc_ns[f] = r.datetime ? SERVideotimeToUnixNano(r.datetime) : 0;
+      if (r.method == SERZ_RAW) {
+        if (r.bytes != frame_size) return damaged(first + f);
+        tasks.push_back({p, r.bytes, f, 0, 1, SERZ_RAW});
+        continue;
+      }
+      if (r.method == SERZ_PACKED) {
+        // bits, shift, 2 reserved, then the samples
+        if (layout.bytes != 2 || r.bytes < 4 || p[0] == 0 ||
+            p[0] + p[1] > 16 ||
+            r.bytes - 4 != BitPack::PackedBytes(frame_size / 2, p[0]))
+          return damaged(first + f);
+        tasks.push_back({p, r.bytes, f, 0, 1, SERZ_PACKED});
+        continue;
+      }
+      const size_t table = size_t(r.slices) * sizeof(uint32_t);
+      if (r.method != SERZ_SLICED || r.slices == 0 ||
+          r.slices > layout.height || table > r.bytes)
+        return damaged(first + f);
+      size_t off = table;
+      for (uint32_t s = 0; s < r.slices; s++) {
+        uint32_t len;
+        std::memcpy(&len, p + s * sizeof(uint32_t), sizeof(len));
+        if (off + len > r.bytes) return damaged(first + f);
+        tasks.push_back({p + off, len, f, s, r.slices, SERZ_SLICED});
+        off += len;
+      }
+    }
+    std::atomic_bool good = true;
+    pool.run(tasks.size(), [&](size_t i) {
+      const Task &t = tasks[i];
+      if (t.method == SERZ_RAW) {
+        std::memcpy(out[t.frame], t.in, t.len);
+        return;
+      }
+      if (t.method == SERZ_PACKED) {
+        BitPack::Unpack(t.in + 4, frame_size / 2, t.in[1], t.in[0],
+                        reinterpret_cast<uint16_t *>(out[t.frame]));
+        return;
+      }
+      uint32_t row0, rows;
+      layout.slice_rows(t.slice, t.slices, row0, rows);
+      if (!SliceCodec::Decode(layout, t.in, t.len, out[t.frame], row0, rows))
+        good = false;
+    });
+    if (!good) spdlog::error("{}: damaged frame in {}-{}", fn, first,
+                             first + n - 1);
+    return good;
+  }
+
+ private:
+  int fd = -1;
+  bool ok = false;
+  uint64_t filesize = 0;
+  CodecLayout layout;
+  size_t frame_size = 0;
+  std::vector<uint64_t> offsets;
+  uint64_t records_end = 0;
+
+  bool read_at(void *p, size_t len, uint64_t off) {
+    size_t got = 0;
+    while (got < len) {
+      ssize_t r = pread(fd, static_cast<uint8_t *>(p) + got, len - got,
+                        off + got);
+      if (r < 0 && errno == EINTR) continue;
+      if (r <= 0) return false;
+      got += r;
+    }
+    return true;
+  }
+  bool damaged(uint32_t idx) {
+    spdlog::error("{}: record of frame {} is damaged", fn, idx);
+    return false;
+  }
+  bool read_index() {
+    SERZFooter f;
+    const uint64_t first = sizeof(SERZ_MAGIC) + sizeof(SERHeader);
+    if (filesize < first + sizeof(f) ||
+        !read_at(&f, sizeof(f), filesize - sizeof(f)) ||
+        std::memcmp(f.magic, SERZ_INDEX_MAGIC, sizeof(f.magic)) != 0 ||
+        f.index_offset < first ||
+        f.index_offset + uint64_t(f.frames) * sizeof(uint64_t) + sizeof(f) !=
+            filesize)
+      return false;
+    offsets.resize(f.frames);
+    records_end = f.index_offset;
+    return read_at(offsets.data(), offsets.size() * sizeof(uint64_t),
+                   f.index_offset);
+  }
+  // No usable index, e.g. after a crash: walk the records instead.
+  bool scan_records() {
+    spdlog::warn("{}: no index in {}, scanning the records", __func__, fn);
+    offsets.clear();
+    uint64_t at = sizeof(SERZ_MAGIC) + sizeof(SERHeader);
+    const uint64_t max = frame_size + 65536 * sizeof(uint32_t);
+    SERZRecord r;
+    while (at + sizeof(r) <= filesize && read_at(&r, sizeof(r), at) &&
+           r.method <= SERZ_PACKED && r.bytes <= max &&
+           at + sizeof(r) + r.bytes <= filesize) {
+      offsets.push_back(at);
+      at += sizeof(r) + r.bytes;
+    }
+    records_end = at;
+    spdlog::warn("{}: recovered {} frames", __func__, offsets.size());
+    return true;
+  }
+};
+
+}  // namespace SER
+
+#endif
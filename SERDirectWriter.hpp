@@ -0,0 +1,429 @@
+#ifndef __SER_DIRECT_WRITER__
+#define __SER_DIRECT_WRITER__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SERCompressed.hpp"
+#include "SERProcessor.hpp"
+
+namespace SER {
+
+// Positional writes of aligned buffers, several in flight. submit() queues
+// buf[0, len) for file offset off; reap() waits for one write to finish and
+// returns its tag and result (bytes written or -errno).
+class AsyncWriteQueue {
+ public:
+  virtual ~AsyncWriteQueue() {}
+  virtual bool submit(const void *buf, size_t len, off_t off,
+                      uint32_t tag) = 0;
+  virtual bool reap(uint32_t &tag, int64_t &res) = 0;
+  virtual const char *name() = 0;
+};
+
+// io_uring through the raw syscalls, so no liburing is needed. One
+// IORING_OP_WRITEV per buffer, which every io_uring kernel (5.1+) supports.
+class UringWriteQueue : public AsyncWriteQueue {
+ public:
+  // Tags must be below depth.
+  UringWriteQueue(int _fd, uint32_t depth) : fd(_fd), iovs(depth) {
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    ring_fd = int(syscall(__NR_io_uring_setup, depth, &p));
+    if (ring_fd < 0) {
+      error = errno;
+      return;
+    }
+
+    sq_bytes = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    cq_bytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+      sq_bytes = cq_bytes = std::max(sq_bytes, cq_bytes);
+    sq_ptr = mmap(nullptr, sq_bytes, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    cq_ptr = (p.features & IORING_FEAT_SINGLE_MMAP)
+                 ? sq_ptr
+                 : mmap(nullptr, cq_bytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd,
+                        IORING_OFF_CQ_RING);
+    sqe_bytes = p.sq_entries * sizeof(io_uring_sqe);
+    void *s = mmap(nullptr, sqe_bytes, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sq_ptr == MAP_FAILED || cq_ptr == MAP_FAILED || s == MAP_FAILED) {
+      error = errno;
+      ::close(ring_fd);
+      ring_fd = -1;
+      return;
+    }
+    sqes = static_cast<io_uring_sqe *>(s);
+    auto *sq = static_cast<uint8_t *>(sq_ptr);
+    auto *cq = static_cast<uint8_t *>(cq_ptr);
+    sq_tail = reinterpret_cast<std::atomic<uint32_t> *>(sq + p.sq_off.tail);
+    sq_mask = *reinterpret_cast<uint32_t *>(sq + p.sq_off.ring_mask);
+    sq_array = reinterpret_cast<uint32_t *>(sq + p.sq_off.array);
+    cq_head = reinterpret_cast<std::atomic<uint32_t> *>(cq + p.cq_off.head);
+    cq_tail = reinterpret_cast<std::atomic<uint32_t> *>(cq + p.cq_off.tail);
+    cq_mask = *reinterpret_cast<uint32_t *>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+  }
+  ~UringWriteQueue() {
+    if (ring_fd < 0) return;
+    munmap(sqes, sqe_bytes);
+    if (cq_ptr != sq_ptr) munmap(cq_ptr, cq_bytes);
+    munmap(sq_ptr, sq_bytes);
+    ::close(ring_fd);
+  }
+  bool ok() { return ring_fd >= 0; }
+  int setup_error() { return error; }
+
+  bool submit(const void *buf, size_t len, off_t off, uint32_t tag) {
+    const uint32_t tail = sq_tail->load(std::memory_order_relaxed);
+    const uint32_t idx = tail & sq_mask;
+    iovs[tag] = {const_cast<void *>(buf), len};
+    io_uring_sqe *sqe = &sqes[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&iovs[tag]);
+    sqe->len = 1;
+    sqe->off = off;
+    sqe->user_data = tag;
+    sq_array[idx] = idx;
+    sq_tail->store(tail + 1, std::memory_order_release);
+    while (syscall(__NR_io_uring_enter, ring_fd, 1, 0, 0, nullptr, 0) < 0) {
+      if (errno == EINTR) continue;
+      spdlog::critical("io_uring_enter failed: {}", std::strerror(errno));
+      return false;
+    }
+    return true;
+  }
+  bool reap(uint32_t &tag, int64_t &res) {
+    while (true) {
+      const uint32_t head = cq_head->load(std::memory_order_relaxed);
+      if (head != cq_tail->load(std::memory_order_acquire)) {
+        const io_uring_cqe &cqe = cqes[head & cq_mask];
+        tag = uint32_t(cqe.user_data);
+        res = cqe.res;
+        cq_head->store(head + 1, std::memory_order_release);
+        return true;
+      }
+      if (syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS,
+                  nullptr, 0) < 0 &&
+          errno != EINTR) {
+        spdlog::critical("io_uring_enter failed: {}", std::strerror(errno));
+        return false;
+      }
+    }
+  }
+  const char *name() { return "io_uring"; }
+
+ private:
+  const int fd;
+  int ring_fd = -1;
+  int error = 0;
+  std::vector<iovec> iovs;  // one per tag; must outlive the request
+  void *sq_ptr = MAP_FAILED;
+  void *cq_ptr = MAP_FAILED;
+  size_t sq_bytes = 0, cq_bytes = 0, sqe_bytes = 0;
+  io_uring_sqe *sqes = nullptr;
+  std::atomic<uint32_t> *sq_tail = nullptr;
+  uint32_t sq_mask = 0;
+  uint32_t *sq_array = nullptr;
+  std::atomic<uint32_t> *cq_head = nullptr;
+  std::atomic<uint32_t> *cq_tail = nullptr;
+  uint32_t cq_mask = 0;
+  io_uring_cqe *cqes = nullptr;
+};
+
+// Fallback for kernels (or sandboxes) without io_uring: one thread doing
+// pwrite(), so the copy into the next buffer still overlaps the disk.
+class PwriteWriteQueue : public AsyncWriteQueue {
+ public:
+  explicit PwriteWriteQueue(int _fd) : fd(_fd) {
+    worker = std::thread(&PwriteWriteQueue::Run, this);
+  }
+  ~PwriteWriteQueue() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    cv.notify_all();
+    worker.join();
+  }
+  bool submit(const void *buf, size_t len, off_t off, uint32_t tag) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.push_back({buf, len, off, tag, 0});
+    }
+    cv.notify_all();
+    return true;
+  }
+  bool reap(uint32_t &tag, int64_t &res) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return !done.empty(); });
+    tag = done.front().tag;
+    res = done.front().res;
+    done.pop_front();
+    return true;
+  }
+  const char *name() { return "pwrite thread"; }
+
+ private:
+  struct Request {
+    const void *buf;
+    size_t len;
+    off_t off;
+    uint32_t tag;
+    int64_t res;
+  };
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      cv.wait(lock, [this] { return stop || !pending.empty(); });
+      if (pending.empty()) return;
+      Request r = pending.front();
+      pending.pop_front();
+      lock.unlock();
+      size_t n = 0;
+      while (n < r.len) {
+        ssize_t w = pwrite(fd, static_cast<const uint8_t *>(r.buf) + n,
+                           r.len - n, r.off + n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+          r.res = w < 0 ? -errno : -EIO;
+          break;
+        }
+        n += w;
+      }
+      if (r.res == 0) r.res = int64_t(n);
+      lock.lock();
+      done.push_back(r);
+      cv.notify_all();
+    }
+  }
+
+  const int fd;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Request> pending;
+  std::deque<Request> done;
+  bool stop = false;
+  std::thread worker;
+};
+
+//-------------------------------------------------------------------
+// SER writer that bypasses the page cache.
+//
+// The file is opened with O_DIRECT and written in large, aligned chunks, with
+// `depth` chunks in flight through io_uring (or a pwrite thread). Frames are
+// copied once into the current chunk: SER frames start 178 bytes into the
+// file, so their file offsets are never block aligned and cannot be handed to
+// the disk straight from the ring. That copy replaces the page cache copy,
+// and nothing is left for writeback or cache eviction to do.
+//
+// The header at offset 0 is patched from a saved copy of the first block on
+// close(), and the rounded-up last chunk is truncated to the exact length, so
+// the file is byte-identical to SERWriter's. If the filesystem refuses
+// O_DIRECT (tmpfs, some FUSE mounts) the same scheme runs through the page
+// cache.
+//-------------------------------------------------------------------
+class SERDirectWriter : public SERWriterBase {
+ public:
+  static constexpr size_t BLOCK = 4096;
+
+  SERDirectWriter(std::string _fn, size_t chunk_mb = 8, uint32_t _depth = 4)
+      : chunk(std::max<size_t>(chunk_mb, 1) * 1024 * 1024),
+        depth(std::max<uint32_t>(_depth, 2)) {
+    fn = _fn;
+    fd = open(fn.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT,
+              0644);
+    if (fd < 0 && errno == EINVAL) {
+      fd = open(fn.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (fd >= 0)
+        spdlog::warn("{} does not support O_DIRECT, using the page cache",
+                     fn);
+    }
+    if (fd < 0) {
+      spdlog::critical("failed to open file: {}: {}", fn,
+                       std::strerror(errno));
+      return;
+    }
+    lengths.resize(depth + 1);
+    for (uint32_t i = 0; i < depth + 1; i++) {
+      buffers.emplace_back(
+          static_cast<uint8_t *>(std::aligned_alloc(BLOCK, chunk)), std::free);
+      if (i > 0) free_list.push_back(i);
+    }
+    first_block.reset(static_cast<uint8_t *>(std::aligned_alloc(BLOCK, BLOCK)));
+    auto uring = std::make_unique<UringWriteQueue>(fd, depth + 1);
+    if (uring->ok())
+      queue = std::move(uring);
+    else {
+      spdlog::warn("io_uring unavailable ({}), falling back to pwrite",
+                   std::strerror(uring->setup_error()));
+      queue = std::make_unique<PwriteWriteQueue>(fd);
+    }
+    spdlog::info("Direct writer for {}: {} x {} MB chunks via {}", fn, depth,
+                 chunk / 1024 / 1024, queue->name());
+  }
+  ~SERDirectWriter() {
+    spdlog::info("closing writter for: {}", fn);
+    if (isOpen()) close();
+    if (fd >= 0) {
+      drain();
+      ::close(fd);
+    }
+  }
+  bool isOpen() { return fd >= 0 && !failed; }
+  const char *backend() { return queue ? queue->name() : "none"; }
+
+ private:
+  const size_t chunk;
+  const uint32_t depth;
+  int fd = -1;
+  bool failed = false;
+  std::vector<std::unique_ptr<uint8_t, decltype(&std::free)>> buffers;
+  std::unique_ptr<uint8_t, decltype(&std::free)> first_block{nullptr,
+                                                              std::free};
+  bool header_dirty = false;
+  std::vector<size_t> lengths;  // of the write in flight from each buffer
+  std::deque<uint32_t> free_list;
+  uint32_t cur = 0;    // buffer being filled
+  size_t fill = 0;     // bytes in it
+  off_t pos = 0;       // file offset of its first byte
+  uint32_t in_flight = 0;
+  std::unique_ptr<AsyncWriteQueue> queue;
+
+  void put_header(const SERHeader &h) {
+    if (pos == 0) {
+      // Still in the first chunk; patch it in memory.
+      std::memcpy(buffers[cur].get(), &h, sizeof(h));
+      fill = std::max(fill, sizeof(h));
+    } else {
+      std::memcpy(first_block.get(), &h, sizeof(h));
+      header_dirty = true;
+    }
+  }
+  void append(const uint8_t *data, size_t bytes) {
+    fill_from(data, bytes, false);
+  }
+  // Frames are copied into the chunks anyway, so they are swapped on the way
+  // if the file wants the other byte order.
+  void append_frames(const uint8_t *const *data, size_t n) {
+    for (size_t i = 0; i < n && !failed; i++) fill_from(data[i], sz, true);
+  }
+  void fill_from(const uint8_t *data, size_t bytes, bool samples) {
+    while (bytes > 0 && !failed) {
+      const size_t n = std::min(chunk - fill, bytes);
+      if (samples)
+        copy_samples(buffers[cur].get() + fill, data, n);
+      else
+        std::memcpy(buffers[cur].get() + fill, data, n);
+      fill += n;
+      data += n;
+      bytes -= n;
+      if (fill == chunk) submit_current(chunk);
+    }
+  }
+  // Queue the current chunk and move on to a free buffer.
+  void submit_current(size_t len) {
+    if (pos == 0) std::memcpy(first_block.get(), buffers[cur].get(), BLOCK);
+    lengths[cur] = len;
+    if (!queue->submit(buffers[cur].get(), len, pos, cur)) {
+      failed = true;
+      return;
+    }
+    in_flight++;
+    pos += chunk;
+    fill = 0;
+    while (free_list.empty() && !failed) reap_one();
+    if (failed) return;
+    cur = free_list.front();
+    free_list.pop_front();
+  }
+  void reap_one() {
+    uint32_t tag;
+    int64_t res;
+    if (!queue->reap(tag, res)) {
+      failed = true;
+      return;
+    }
+    in_flight--;
+    free_list.push_back(tag);
+    if (res < 0) {
+      spdlog::critical("Write to {} failed: {}", fn, std::strerror(-res));
+      failed = true;
+    } else if (size_t(res) != lengths[tag]) {
+      spdlog::critical("Short write to {}: {} of {} bytes", fn, res,
+                       lengths[tag]);
+      failed = true;
+    }
+  }
+  void drain() {
+    while (in_flight > 0) {
+      uint32_t tag;
+      int64_t res;
+      if (!queue->reap(tag, res)) break;
+      in_flight--;
+      free_list.push_back(tag);
+    }
+  }
+  void finish() {
+    const off_t end = pos + off_t(fill);
+    if (fill > 0) {
+      // O_DIRECT wants whole blocks; the tail is cut off again below.
+      const size_t len = (fill + BLOCK - 1) / BLOCK * BLOCK;
+      std::memset(buffers[cur].get() + fill, 0, len - fill);
+      submit_current(len);
+    }
+    while (in_flight > 0 && !failed) reap_one();
+    drain();
+    if (!failed && header_dirty &&
+        pwrite(fd, first_block.get(), BLOCK, 0) != ssize_t(BLOCK)) {
+      spdlog::critical("Failed to rewrite the header of {}: {}", fn,
+                       std::strerror(errno));
+      failed = true;
+    }
+    if (ftruncate(fd, end) != 0)
+      spdlog::critical("Failed to truncate {}: {}", fn, std::strerror(errno));
+    spdlog::info("Closing file: {}: {} bytes written", fn, end);
+    ::close(fd);
+    fd = -1;
+  }
+};
+
+// Writer for the given backend. adc_bits, the depth of the camera's ADC if
+// known, is where the Packed backend starts.
+inline std::unique_ptr<SERWriterBase> MakeSERWriter(WriterBackend backend,
+                                                    std::string fn,
+                                                    int adc_bits = 0) {
+  if (backend == WriterBackend::Direct)
+    return std::make_unique<SERDirectWriter>(fn);
+  if (backend == WriterBackend::Compressed)
+    return std::make_unique<SERCompressedWriter>(fn);
+  if (backend == WriterBackend::Packed)
+    return std::make_unique<SERCompressedWriter>(fn, SERZ_PACKED, adc_bits);
+  return std::make_unique<SERWriter>(fn);
+}
+
+}  // namespace SER
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef __SER_MAPPED_READER__
+#define __SER_MAPPED_READER__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+#include "SERProcessor.hpp"
+
+namespace SER {
+
+//-------------------------------------------------------------------
+// SER reader over a read-only mapping of the whole file.
+//
+// Everything is parsed and checked once in the constructor; after that the
+// reader is immutable, so GetFrame() can be called from any number of threads
+// at once. It allocates nothing, copies nothing and does not log: a frame is
+// a pointer into the page cache, and the kernel's readahead does the I/O.
+//
+// Truncated recordings are opened with as many frames as the file holds, and
+// frames get no timestamp if the trailer is missing or short, as SERReader.
+// So are files whose header still counts 0 frames: writers only fill the
+// count in on close, so that is a recording that was cut short.
+// Frames come as stored; CopyFrame() also puts 16-bit samples in host order.
+//-------------------------------------------------------------------
+class SERMappedReader : public SERBase {
+ public:
+  // invert: files whose uiLittleEndian follows the spec, see SERHeader.
+  SERMappedReader(std::string _fn, bool invert = false) : SERBase(invert) {
+    fn = _fn;
+    fd = open(fn.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      spdlog::critical("{}: {} could not be opened: {}", __func__, fn,
+                       std::strerror(errno));
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(SERHeader)) {
+      spdlog::critical("{}: {} is too short for a SER header", __func__, fn);
+      return;
+    }
+    filesize = st.st_size;
+    void *p = mmap(nullptr, filesize, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      spdlog::critical("{}: failed to map {}: {}", __func__, fn,
+                       std::strerror(errno));
+      return;
+    }
+    base = static_cast<const uint8_t *>(p);
+    std::memcpy(header.get(), base, sizeof(SERHeader));
+    if (is_sysbig_endian) swapEndiannessHeader();
+    if (std::memcmp(header->sFileID, SER_FILE_ID, sizeof(header->sFileID))) {
+      spdlog::critical("{}: {} is not a SER file", __func__, fn);
+      return;
+    }
+    frame_size = SERGetFrameSize();
+    if (frame_size == 0) {
+      spdlog::critical("{}: {} has empty frames", __func__, fn);
+      return;
+    }
+    frame_count = header->uiFrameCount;
+    const size_t fit = (filesize - sizeof(SERHeader)) / frame_size;
+    if (frame_count == 0 && fit > 0) {
+      spdlog::warn("{}: {} was never closed, taking the {} frames it holds",
+                   __func__, fn, fit);
+      frame_count = fit;
+    } else if (fit < frame_count) {
+      spdlog::warn("{}: incomplete file {}, only {} of {} frames", __func__,
+                   fn, fit, frame_count);
+      frame_count = fit;
+    } else if (filesize - SERGetTrailerOffset() >=
+               frame_count * sizeof(uint64_t)) {
+      trailer = base + SERGetTrailerOffset();
+    } else {
+      spdlog::warn("{}: {} has no complete timestamp trailer", __func__, fn);
+    }
+    spdlog::info("{}: mapped {}, {} frames of {} bytes", __func__, fn,
+                 frame_count, frame_size);
+    ok = true;
+  }
+  ~SERMappedReader() {
+    if (base != nullptr) munmap(const_cast<uint8_t *>(base), filesize);
+    if (fd >= 0) close(fd);
+  }
+  SERMappedReader(const SERMappedReader &) = delete;
+  SERMappedReader &operator=(const SERMappedReader &) = delete;
+
+  bool isOpen() const { return ok; }
+  uint32_t FrameCount() const { return frame_count; }
+  size_t FrameSize() const { return frame_size; }
+  // Byte-swapped to host order, as in the file otherwise.
+  const SERHeader &Header() const { return *header; }
+
+  // Thread-safe; false if idx is out of range.
+  bool GetFrame(uint32_t idx, SERFrameView &v) const {
+    if (!ok || idx >= frame_count) return false;
+    v.data = base + sizeof(SERHeader) + size_t(idx) * frame_size;
+    v.size = frame_size;
+    v.index = idx;
+    v.width = header->uiImageWidth;
+    v.height = header->uiImageHeight;
+    v.pixelDepth = header->uiPixelDepth;
+    v.colorID = header->uiColorID;
+    v.bigEndian = SERIsBigEndian();
+    v.datetime = FrameDate(idx);
+    v.utc_ns = v.datetime ? SERVideotimeToUnixNano(v.datetime) : 0;
+    return true;
+  }
+
+  // Copies frame idx into dst, FrameSize() bytes, with the samples in host
+  // byte order if to_host. Thread-safe.
+  bool CopyFrame(uint32_t idx, uint8_t *dst, bool to_host = true) const {
+    if (!ok || idx >= frame_count) return false;
+    const uint8_t *src = base + sizeof(SERHeader) + size_t(idx) * frame_size;
+    if (to_host && SERNeedsSwap())
+      ByteSwap::Swap16(dst, src, frame_size);
+    else
+      std::memcpy(dst, src, frame_size);
+    return true;
+  }
+
+  // Tell the kernel frames [first, first + n) are wanted soon, or, with
+  // sequential, that the file will be read front to back.
+  void Advise(uint32_t first, uint32_t n, bool sequential = false) const {
+    if (!ok || first >= frame_count) return;
+    n = std::min(n, frame_count - first);
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t start = sizeof(SERHeader) + size_t(first) * frame_size;
+    const size_t aligned = start / page * page;
+    madvise(const_cast<uint8_t *>(base) + aligned,
+            start - aligned + size_t(n) * frame_size,
+            sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+  }
+
+ private:
+  int fd = -1;
+  const uint8_t *base = nullptr;
+  size_t filesize = 0;
+  size_t frame_size = 0;
+  uint32_t frame_count = 0;
+  const uint8_t *trailer = nullptr;  // null without a complete trailer
+  bool ok = false;
+
+  uint64_t FrameDate(uint32_t idx) const {
+    if (trailer == nullptr) return 0;
+    uint64_t date;
+    std::memcpy(&date, trailer + size_t(idx) * sizeof(uint64_t), sizeof(date));
+    if (is_sysbig_endian) date = __builtin_bswap64(date);
+    return date;
+  }
+};
+
+}  // namespace SER
+
+#endif
@@ -1,17 +1,32 @@
 #ifndef __SER_PROC__
 #define __SER_PROC__
 
+#include <fcntl.h>
 #include <spdlog/spdlog.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include <climits>
 #include <time.h>
 #include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
 #include <fstream>
 #include <ios>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
 
+#include "byteswap.hpp"
+
 #define NANOSEC_PER_SEC 1000000000
 #define MICROSEC_PER_SEC 1000000
 #define TIMEUNITS_PER_SEC (NANOSEC_PER_SEC / 100)
@@ -79,6 +94,13 @@ typedef struct {
 } SERFrame;
 
 enum Endianness { LittleEndian = 0, BigEndian = 1 };
+// Byte order of the 16-bit samples in a SER file we write, and the
+// uiLittleEndian value that goes with it (see the note in SERHeader).
+enum class SERByteOrder {
+  TrueLittleEndian,    // little endian, uiLittleEndian = 1 as in the spec
+  LegacyLittleEndian,  // little endian, uiLittleEndian = 0, the usual quirk
+  LegacyBigEndian,     // big endian, uiLittleEndian = 1 read the quirky way
+};
 enum BAYER {
   /* Monochromatic (one channel) formats */
   COLOR_MONO = 0,
@@ -96,6 +118,14 @@ enum BAYER {
 
 };
 
+// Bytes of one sample of one plane, 1 or 2. uiPixelDepth is the depth of a
+// plane; older versions of this writer summed it over the planes.
+inline size_t SERSampleBytes(const SERHeader &h) {
+  uint32_t depth = h.uiPixelDepth;
+  if (depth > 16) depth /= h.uiColorID >= COLOR_RGB ? 3 : 1;
+  return depth > 8 ? 2 : 1;
+}
+
 class SERBase {
  public:
   SERBase(bool invert = false)
@@ -125,11 +155,10 @@ class SERBase {
     swap_endian<uint64_t>(&header->ulDateTime);
     swap_endian<uint64_t>(&header->ulDateTime_UTC);
   }
+  // Header fields and timestamps are always little endian; invert_endianness
+  // only changes what uiLittleEndian says about the samples.
   template <typename T>
   void swap_endian(T *u) {
-    if (invert_endianness) {
-      return;
-    }
     static_assert(CHAR_BIT == 8, "CHAR_BIT != 8");
 
     union {
@@ -151,13 +180,8 @@ class SERBase {
   }
 
   size_t SERGetBytesPerPixel() {
-    uint32_t depth = header->uiPixelDepth;
-    if (depth < 1) return 0;
-    int planes = SERGetNumberOfPlanes();
-    if (depth <= 8)
-      return planes;
-    else
-      return (2 * planes);
+    if (header->uiPixelDepth < 1) return 0;
+    return SERSampleBytes(*header) * SERGetNumberOfPlanes();
   }
   size_t SERGetTrailerOffset() {
     uint32_t frame_idx = header->uiFrameCount;
@@ -217,11 +241,29 @@ class SERBase {
     return reinterpret_cast<uint64_t>(TIMEUNITS_PER_SEC *
                                       (video_t + SECS_UNTIL_UNIXTIME));
   }
+  // Nanoseconds since the Unix epoch to SER ticks (100 ns since 0001-01-01).
+  uint64_t SERUnixNanoToVideotime(uint64_t unix_ns) {
+    return unix_ns / (NANOSEC_PER_SEC / TIMEUNITS_PER_SEC) +
+           uint64_t(SECS_UNTIL_UNIXTIME) * TIMEUNITS_PER_SEC;
+  }
+  static uint64_t SERVideotimeToUnixNano(uint64_t video_t) {
+    return (video_t - uint64_t(SECS_UNTIL_UNIXTIME) * TIMEUNITS_PER_SEC) *
+           (NANOSEC_PER_SEC / TIMEUNITS_PER_SEC);
+  }
   uint64_t SERVideoTimeToUnixtime(uint64_t video_t) {
     double elapsed_sec = video_t / (double)TIMEUNITS_PER_SEC;
     return (uint64_t)elapsed_sec - SECS_UNTIL_UNIXTIME;
   }
-  bool SERIsBigEndian() { return header->uiLittleEndian == 1; }
+  // Byte order of the samples: uiLittleEndian == 1 means big endian, unless
+  // invert_endianness, in which case it means little endian as in the spec.
+  bool SERIsBigEndian() const {
+    return (header->uiLittleEndian == 1) != invert_endianness;
+  }
+  // True if 16-bit samples have to be swapped to get them in host order.
+  bool SERNeedsSwap() const {
+    return SERSampleBytes(*header) == 2 &&
+           SERIsBigEndian() != is_sysbig_endian;
+  }
   void print_header() {
     spdlog::info("{}: {} {}", __func__, "sFileID", header->sFileID);
     spdlog::info("{}: {} {}", __func__, "uiLuID", header->uiLuID);
@@ -249,9 +291,339 @@ class SERBase {
   }
 };  // namespace SER
 
+// Frame timing of a recording, from its trailer. Intervals are in seconds.
+struct SERTimingStats {
+  uint32_t frames = 0;
+  double duration = 0;  // first to last frame
+  double fps = 0;       // mean rate over the duration
+  double mean_interval = 0;
+  double median_interval = 0;
+  double jitter = 0;  // standard deviation of the intervals
+  double min_interval = 0;
+  double max_interval = 0;
+  uint32_t gaps = 0;      // intervals over 1.5x the median
+  uint64_t missing = 0;   // frames those gaps would have held
+  uint32_t backwards = 0; // timestamps earlier than the one before
+};
+
+// The trailer of a SER file as one contiguous array of SER ticks in host byte
+// order. Built once, then read-only: lookups are O(1) and time seeks are a
+// binary search.
+class SERTimestampIndex {
+ public:
+  // raw holds the trailer as stored; swap converts it to host byte order.
+  void load(std::vector<uint64_t> &&raw, bool swap) {
+    dates = std::move(raw);
+    if (swap) {
+      // A plain loop, so the compiler can turn it into vector shuffles.
+      uint64_t *p = dates.data();
+      const size_t n = dates.size();
+      for (size_t i = 0; i < n; i++) p[i] = __builtin_bswap64(p[i]);
+    }
+    compute_stats();
+  }
+  bool empty() const { return dates.empty(); }
+  size_t size() const { return dates.size(); }
+  uint64_t operator[](size_t idx) const { return dates[idx]; }
+  const uint64_t *data() const { return dates.data(); }
+  const SERTimingStats &stats() const { return st; }
+
+  // Frame closest to video_t (SER ticks), -1 if there are no timestamps.
+  int64_t find(uint64_t video_t) const {
+    if (dates.empty()) return -1;
+    size_t i;
+    if (st.backwards == 0) {
+      i = std::lower_bound(dates.begin(), dates.end(), video_t) -
+          dates.begin();
+      if (i == dates.size() ||
+          (i > 0 && video_t - dates[i - 1] < dates[i] - video_t))
+        i--;
+    } else {
+      // Out of order stamps: no binary search, take the nearest one.
+      i = 0;
+      for (size_t k = 1; k < dates.size(); k++)
+        if (distance(dates[k], video_t) < distance(dates[i], video_t)) i = k;
+    }
+    return int64_t(i);
+  }
+
+ private:
+  std::vector<uint64_t> dates;
+  SERTimingStats st;
+
+  static uint64_t distance(uint64_t a, uint64_t b) {
+    return a > b ? a - b : b - a;
+  }
+  void compute_stats() {
+    st = SERTimingStats();
+    st.frames = dates.size();
+    if (dates.size() < 2) return;
+    const double tick = 1.0 / TIMEUNITS_PER_SEC;
+    std::vector<double> iv;
+    iv.reserve(dates.size() - 1);
+    for (size_t i = 1; i < dates.size(); i++) {
+      if (dates[i] < dates[i - 1]) {
+        st.backwards++;
+        continue;
+      }
+      iv.push_back((dates[i] - dates[i - 1]) * tick);
+    }
+    if (dates.back() > dates.front())
+      st.duration = (dates.back() - dates.front()) * tick;
+    if (iv.empty()) return;
+    double sum = 0, sq = 0;
+    st.min_interval = st.max_interval = iv[0];
+    for (double d : iv) {
+      sum += d;
+      sq += d * d;
+      st.min_interval = std::min(st.min_interval, d);
+      st.max_interval = std::max(st.max_interval, d);
+    }
+    st.mean_interval = sum / iv.size();
+    st.jitter = std::sqrt(
+        std::max(0.0, sq / iv.size() - st.mean_interval * st.mean_interval));
+    if (st.duration > 0) st.fps = (dates.size() - 1) / st.duration;
+    const double median = st.median_interval = [&] {
+      std::vector<double> tmp(iv);
+      std::nth_element(tmp.begin(), tmp.begin() + tmp.size() / 2, tmp.end());
+      return tmp[tmp.size() / 2];
+    }();
+    if (median <= 0) return;
+    for (double d : iv)
+      if (d > 1.5 * median) {
+        st.gaps++;
+        st.missing += uint64_t(d / median + 0.5) - 1;
+      }
+  }
+};
+
+// Read-only view of one frame. data points into a mapping or a stream
+// buffer; how long it stays valid is up to the reader that filled it in.
+struct SERFrameView {
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  uint32_t index = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t pixelDepth = 0;
+  uint32_t colorID = 0;
+  bool bigEndian = false;  // byte order of 16-bit samples in data
+  uint64_t datetime = 0;   // SER ticks from the trailer, 0 if there is none
+  uint64_t utc_ns = 0;     // the same as ns since the Unix epoch
+};
+
+//-------------------------------------------------------------------
+// Front-to-back pass over the frames of a SER file.
+//
+// A read-ahead thread fills a fixed pool of chunk buffers with large preads
+// while the caller works on the frames of the chunk before, so decoding and
+// disk I/O overlap. The file is read with POSIX_FADV_SEQUENTIAL and every
+// chunk is dropped from the page cache once it is in our buffer, so a pass
+// over a 60 GB file does not push everything else out of memory.
+//
+//   auto s = reader.SERStream();
+//   SER::SERFrameView v;
+//   while (s->Next(v)) use(v);  // v is valid until the next Next()
+//
+// With to_host, 16-bit samples stored in the other byte order are swapped by
+// the read-ahead thread, so that too overlaps with the caller's work.
+//-------------------------------------------------------------------
+class SERFrameStream : public SERBase {
+ public:
+  // Frames [first, first + count) of fn, laid out as described by h, with
+  // timestamps from dates (may be empty). dates must outlive the stream.
+  // big_endian is the byte order of the samples in the file.
+  SERFrameStream(std::string _fn, const SERHeader &h,
+                 const SERTimestampIndex &_dates, uint32_t first,
+                 uint32_t count, size_t pool_mb, bool _big_endian,
+                 bool to_host)
+      : dates(_dates),
+        next_idx(first),
+        end_idx(first + count),
+        big_endian(_big_endian) {
+    fn = _fn;
+    *header = h;
+    frame_size = SERGetFrameSize();
+    swap = to_host && SERSampleBytes(*header) == 2 &&
+           big_endian != is_sysbig_endian;
+    fd = open(fn.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      spdlog::critical("{}: {} could not be opened: {}", __func__, fn,
+                       std::strerror(errno));
+      Fail();
+      return;
+    }
+    if (frame_size == 0) {
+      Fail();
+      return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    frames_per_chunk = std::max<size_t>(CHUNK_BYTES / frame_size, 1);
+    const size_t nbuf = std::max<size_t>(
+        pool_mb * 1024 * 1024 / (frames_per_chunk * frame_size), 2);
+    pool.resize(nbuf);
+    for (uint32_t i = 0; i < nbuf; i++) {
+      pool[i].data.resize(frames_per_chunk * frame_size);
+      free_list.push_back(i);
+    }
+    reader = std::thread(&SERFrameStream::ReadLoop, this);
+  }
+  ~SERFrameStream() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    cv.notify_all();
+    if (reader.joinable()) reader.join();
+    if (fd >= 0) ::close(fd);
+    spdlog::info("{}: {} MB in {:.2f} s, {:.0f} MB/s, waited {:.2f} s for "
+                 "the disk",
+                 fn, delivered / 1024 / 1024, Seconds(), MBps(), waited);
+  }
+  SERFrameStream(const SERFrameStream &) = delete;
+  SERFrameStream &operator=(const SERFrameStream &) = delete;
+
+  // Next frame in file order; false at the end or on a read error. Gives the
+  // previous frame's buffer back once it is used up.
+  bool Next(SERFrameView &v) {
+    if (cur < 0 || pos == pool[cur].frames) {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (cur >= 0) {
+        free_list.push_back(cur);
+        cur = -1;
+        cv.notify_all();
+      }
+      if (ready.empty() && !done) {
+        const auto t = std::chrono::steady_clock::now();
+        cv.wait(lock, [&] { return !ready.empty() || done; });
+        waited += std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - t)
+                      .count();
+      }
+      if (ready.empty()) return false;
+      cur = ready.front();
+      ready.pop_front();
+      pos = 0;
+    }
+    const Chunk &c = pool[cur];
+    const uint32_t idx = c.first + pos;
+    v.data = c.data.data() + pos * frame_size;
+    v.size = frame_size;
+    v.index = idx;
+    v.width = header->uiImageWidth;
+    v.height = header->uiImageHeight;
+    v.pixelDepth = header->uiPixelDepth;
+    v.colorID = header->uiColorID;
+    v.bigEndian = swap ? is_sysbig_endian : big_endian;
+    v.datetime = idx < dates.size() ? dates[idx] : 0;
+    v.utc_ns = v.datetime ? SERVideotimeToUnixNano(v.datetime) : 0;
+    pos++;
+    delivered += frame_size;
+    return true;
+  }
+  bool Failed() const { return failed; }
+  // Rate frames have been handed out at since the stream was opened.
+  double MBps() const {
+    const double s = Seconds();
+    return s > 0 ? delivered / 1024.0 / 1024.0 / s : 0;
+  }
+
+ private:
+  static constexpr size_t CHUNK_BYTES = 8 * 1024 * 1024;
+
+  struct Chunk {
+    std::vector<uint8_t> data;
+    uint32_t first = 0;   // index of its first frame
+    uint32_t frames = 0;  // frames in it
+  };
+
+  const SERTimestampIndex &dates;
+  int fd = -1;
+  size_t frame_size = 0;
+  size_t frames_per_chunk = 1;
+  uint32_t next_idx;  // next frame the read-ahead thread reads
+  const uint32_t end_idx;
+  const bool big_endian;
+  bool swap = false;  // samples to host order
+  std::vector<Chunk> pool;
+  int cur = -1;      // chunk the caller is in, -1 for none
+  uint32_t pos = 0;  // next frame in it
+  uint64_t delivered = 0;
+  double waited = 0;  // seconds Next() spent waiting for the disk
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  std::mutex mutex;  // guards the queues and flags below
+  std::condition_variable cv;
+  std::deque<uint32_t> free_list;
+  std::deque<uint32_t> ready;  // filled chunks, in file order
+  bool stop = false;
+  bool done = false;
+  std::atomic_bool failed = false;
+  std::thread reader;
+
+  // The stream could not start; there is no read-ahead thread to end it.
+  void Fail() {
+    std::lock_guard<std::mutex> lock(mutex);
+    failed = true;
+    done = true;
+  }
+  double Seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  }
+  void ReadLoop() {
+    while (next_idx < end_idx) {
+      uint32_t b;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return !free_list.empty() || stop; });
+        if (stop) break;
+        b = free_list.front();
+        free_list.pop_front();
+      }
+      Chunk &c = pool[b];
+      c.first = next_idx;
+      c.frames = std::min<size_t>(frames_per_chunk, end_idx - next_idx);
+      const off_t off = SERGetFrameOffset(c.first);
+      const size_t len = size_t(c.frames) * frame_size;
+      size_t got = 0;
+      while (got < len) {
+        ssize_t r = pread(fd, c.data.data() + got, len - got, off + got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += r;
+      }
+      if (got < len) {
+        spdlog::critical("{}: read of frames {}-{} failed: {}", fn, c.first,
+                         c.first + c.frames - 1,
+                         got ? "short read" : std::strerror(errno));
+        failed = true;
+        c.frames = got / frame_size;
+      }
+      // We have our own copy now.
+      posix_fadvise(fd, off, len, POSIX_FADV_DONTNEED);
+      if (swap)
+        ByteSwap::Swap16(c.data.data(), c.data.data(),
+                         size_t(c.frames) * frame_size);
+      next_idx += c.frames;
+      std::lock_guard<std::mutex> lock(mutex);
+      if (c.frames > 0) ready.push_back(b);
+      else free_list.push_back(b);
+      cv.notify_all();
+      if (failed) break;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+    cv.notify_all();
+  }
+};
+
 class SERReader : public SERBase {
  public:
-  SERReader(std::string _fn) {
+  // invert: files whose uiLittleEndian follows the spec, see SERHeader.
+  SERReader(std::string _fn, bool invert = false) : SERBase(invert) {
     std::ios_base::sync_with_stdio(false);
     cFrame = std::make_unique<SERFrame>();
     fn = _fn;
@@ -268,7 +640,7 @@ class SERReader : public SERBase {
   ~SERReader(){};
 
   bool SERHasTrailer() {
-    spdlog::info("{}: {}", __func__, filesize > (size_t)SERGetTrailerOffset());
+    spdlog::debug("{}: {}", __func__, filesize > (size_t)SERGetTrailerOffset());
     return filesize > (size_t)SERGetTrailerOffset();
   }
   bool GetFrame(uint32_t frame_idx) {
@@ -307,7 +679,9 @@ class SERReader : public SERBase {
     cFrame->buffer = std::unique_ptr<uint8_t[]>(new uint8_t[sz]);
     fd.seekg(offset_start, std::ios::beg);
     fd.read((char *)(cFrame->buffer.get()), sz);
-    spdlog::info("{}: reading frame @ {} len {}", __func__, offset_start, sz);
+    if (host_order && SERNeedsSwap())
+      ByteSwap::Swap16(cFrame->buffer.get(), cFrame->buffer.get(), sz);
+    spdlog::debug("{}: reading frame @ {} len {}", __func__, offset_start, sz);
     return true;
   }
 
@@ -337,6 +711,21 @@ class SERReader : public SERBase {
       spdlog::error("{}: incomplete tail info {}/{}", __func__,
                     filesize - trailer_offset, (frame_c * sizeof(uint64_t)));
       //      movie->warnings |= WARN_INCOMPLETE_TRAILER;
+    } else {
+      std::vector<uint64_t> raw(frame_c);
+      fd.seekg(trailer_offset, std::ios::beg);
+      read<uint64_t>(raw.data(), raw.size());
+      if (fd.gcount() != std::streamsize(raw.size() * sizeof(uint64_t)))
+        spdlog::error("{}: failed to read the trailer", __func__);
+      else
+        dates.load(std::move(raw), is_sysbig_endian);
+      fd.clear();
+      const auto &st = dates.stats();
+      spdlog::info(
+          "{}: {} timestamps, {:.3f} fps, interval {:.3f} ms +/- {:.3f} ms, "
+          "{} gaps ({} frames), {} out of order",
+          __func__, dates.size(), st.fps, st.mean_interval * 1e3,
+          st.jitter * 1e3, st.gaps, st.missing, st.backwards);
     }
     firstFrameDate = SERGetFirstFrameDate();
     lastFrameDate = SERGetLastFrameDate();
@@ -351,8 +740,48 @@ class SERReader : public SERBase {
     return true;
   }
 
+  // GetFrame() and SERStream() deliver 16-bit samples in host byte order,
+  // rather than as stored.
+  void SERSetHostOrder(bool on) { host_order = on; }
+
+  // Sequential pass over frames [first, first + count), clamped to the file,
+  // with a read-ahead pool of about pool_mb. Call after SEROpenMovie(); the
+  // reader must outlive the stream.
+  std::unique_ptr<SERFrameStream> SERStream(uint32_t first = 0,
+                                            uint32_t count = UINT32_MAX,
+                                            size_t pool_mb = 64) {
+    first = std::min(first, header->uiFrameCount);
+    count = std::min(count, header->uiFrameCount - first);
+    return std::make_unique<SERFrameStream>(fn, *header, dates, first, count,
+                                            pool_mb, SERIsBigEndian(),
+                                            host_order);
+  }
+
+  // Valid after SEROpenMovie().
+  const SERHeader &Header() const { return *header; }
+  // Valid after SEROpenMovie(); empty without a complete trailer.
+  const SERTimestampIndex &Timestamps() const { return dates; }
+  const SERTimingStats &TimingStats() const { return dates.stats(); }
+  // Frame closest to a time, -1 without timestamps. video_t is in SER ticks.
+  int64_t SERFindFrame(uint64_t video_t) const { return dates.find(video_t); }
+  int64_t SERFindFrameUnixNano(uint64_t unix_ns) {
+    return dates.find(SERUnixNanoToVideotime(unix_ns));
+  }
+  // Frame closest to a UTC time of day, e.g. 12:03:41.250 is
+  // (12 * 3600 + 3 * 60 + 41) * 1000 + 250, on the day of the first frame or,
+  // if that is before the recording started, on the day after.
+  int64_t SERFindFrameAtTimeOfDay(uint64_t ms_of_day) {
+    if (dates.empty()) return -1;
+    const uint64_t day = uint64_t(86400) * TIMEUNITS_PER_SEC;
+    uint64_t t = dates[0] / day * day + ms_of_day * (TIMEUNITS_PER_SEC / 1000);
+    if (t < dates[0]) t += day;
+    return dates.find(t);
+  }
+
  private:
   uint64_t firstFrameDate, lastFrameDate, duration;
+  bool host_order = false;
+  SERTimestampIndex dates;
   std::fstream fd;
   size_t filesize;
   std::unique_ptr<SERFrame> cFrame;
@@ -387,49 +816,75 @@ class SERReader : public SERBase {
   }
 
   uint64_t SERGetFrameDate(size_t idx) {
-    if (!SERHasTrailer()) {
-      spdlog::warn("{}: no tail found", __func__);
-      return 0;
-    }
-    uint64_t date = 0;
-    if (idx >= header->uiFrameCount) {
+    if (dates.empty()) return 0;
+    if (idx >= dates.size()) {
       spdlog::warn(
           "{}: index requested {} is greater than the total number of frames "
           "{}",
-          __func__, idx, header->uiFrameCount);
-      idx = header->uiFrameCount - 1;
+          __func__, idx, dates.size());
+      idx = dates.size() - 1;
     }
-    size_t offset = SERGetTrailerOffset();
-    offset += (idx * sizeof(uint64_t));
-    char *ptr = (char *)&date;
-    spdlog::info("{}: seeking to {} ", __func__, offset);
-    fd.seekg(offset, std::ios::beg);
-    fd.read(ptr, sizeof(uint64_t));
-
-    if (is_sysbig_endian && date > 0) swap_endian<uint64_t>(&date);
-    return date;
+    return dates[idx];
   }
 };
 
-class SERWriter : public SERBase {
- public:
-  SERWriter(std::string _fn) {
-    std::ios_base::sync_with_stdio(false);
-    fn = _fn;
-    fd = std::fstream(fn.c_str(), std::ios::out | std::ios::binary);
-    if (!fd.is_open()) {
-      spdlog::critical("failed to open file: {}", fn);
+// Writes all of iov[0, n) at off, picking up after short writes. iov is
+// used up in the process. False with errno set on failure.
+inline bool PwritevAll(int fd, iovec *v, int n, off_t off) {
+  while (n > 0) {
+    ssize_t w = pwritev(fd, v, std::min(n, IOV_MAX), off);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) {
+      if (w == 0) errno = EIO;
+      return false;
+    }
+    off += w;
+    while (n > 0 && size_t(w) >= v->iov_len) {
+      w -= v->iov_len;
+      v++;
+      n--;
+    }
+    if (n > 0) {
+      v->iov_base = static_cast<uint8_t *>(v->iov_base) + w;
+      v->iov_len -= w;
     }
-    is_prepared = false;
-  };
-  ~SERWriter() {
-    spdlog::info("closing writter for: {}", fn);
-    if (isOpen()) close();
-  };
-  bool isOpen()
-  {
-    return fd.is_open();
   }
+  return true;
+}
+
+// Which SERWriterBase implementation a recording uses.
+enum class WriterBackend { Stream, Direct, Compressed, Packed };
+// File name extension for a backend's files.
+inline const char *SERFileExtension(WriterBackend b) {
+  return b == WriterBackend::Compressed || b == WriterBackend::Packed ? ".serz"
+                                                                     : ".ser";
+}
+// How a recording spread over several directories picks one for each frame;
+// see SERStripedWriter.
+enum class StripeMode { RoundRobin, Weighted };
+
+// Header, frame accounting and trailer shared by the SER writer backends. A
+// backend only has to put bytes in the file: put_header() at offset 0 and
+// append() at the end, in order. Backends with a container of their own
+// override append_frames() and append_trailer() as well.
+//
+// Frames come in host byte order. If the file is to hold 16-bit samples in
+// the other order, append_frames() gets them through swapped_frames(), or
+// swaps them with copy_samples() on a copy it makes anyway.
+class SERWriterBase : public SERBase {
+ public:
+  virtual ~SERWriterBase() {}
+  virtual bool isOpen() = 0;
+  size_t FrameSize() const { return sz; }
+  uint32_t FrameCount() const { return header->uiFrameCount; }
+
+  // Byte order of the samples in the file; before prepare_header(). Unless
+  // set, prepare_header(h) keeps h's and takes the frames as they are.
+  virtual void set_byte_order(SERByteOrder o) { order = o; }
+  // Whether the frames have capture times, before the first frame. Without,
+  // a SER file gets no trailer and the header keeps its date.
+  void set_timestamped(bool t) { timestamped = t; }
+
   void prepare_header(std::array<size_t, 2> dim,
                       std::array<std::string, 3> str, uint8_t nbytes,
                       BAYER bay = COLOR_MONO) {
@@ -440,10 +895,9 @@ class SERWriter : public SERBase {
     std::memcpy(header->sFileID, "LUCAM-RECORDER", sizeof(header->sFileID));
     header->uiLuID = 0;
     header->uiColorID = bay;
-    header->uiLittleEndian = is_sysbig_endian ? 0 : 1;
     header->uiImageWidth = dim[1];
     header->uiImageHeight = dim[0];
-    header->uiPixelDepth = nbytes * SERGetNumberOfPlanes() * 8;
+    header->uiPixelDepth = nbytes * 8;  // of one plane
     header->uiFrameCount = 0;
     str[0].copy(&(header->sObserver[40]),
                 str[0].length() > 40 ? 40 : str[0].length());
@@ -452,61 +906,188 @@ class SERWriter : public SERBase {
     str[2].copy(&(header->sTelescope[40]),
                 str[2].length() > 40 ? 40 : str[2].length());
     auto const now = std::chrono::system_clock::now();
-    header->ulDateTime =
-        SERUnixTimeToVediotime(std::chrono::system_clock::to_time_t(now));
+    header->ulDateTime = SERUnixNanoToVideotime(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            now.time_since_epoch())
+            .count());
     header->ulDateTime_UTC = header->ulDateTime;
 
+    apply_byte_order(order.value_or(SERByteOrder::TrueLittleEndian));
+
     is_prepared = true;
     write_header();
     sz = SERGetFrameSize();
     spdlog::info("Created file: {}, each frame is {} bytes", fn, sz);
 
   }
-  void write_frame(uint8_t *data) {
+  // Same layout and labels as an existing file's header (host byte order),
+  // e.g. when frames are copied from one file to another.
+  void prepare_header(const SERHeader &h) {
     if (!isOpen()) {
       spdlog::critical("failed to open file: {}", fn);
       return;
     }
-    fd.seekg(0, std::ios::end);
-    header->uiFrameCount++;
-    write<uint8_t>(data, sz);
-    auto const now = std::chrono::system_clock::now();
-    timestamp.push_back(
-        SERUnixTimeToVediotime(std::chrono::system_clock::to_time_t(now)));
+    *header = h;
+    header->uiFrameCount = 0;
+    if (order) apply_byte_order(*order);
+    is_prepared = true;
+    write_header();
+    sz = SERGetFrameSize();
+  }
+  // utc_ns is the capture time of the frame (ns since the Unix epoch); 0
+  // stamps it with the time it is written instead.
+  void write_frame(uint8_t *data, uint64_t utc_ns = 0) {
+    const uint8_t *p = data;
+    write_frames(&p, &utc_ns, 1);
+  }
+  // n frames in one go, which the backends turn into one vectored write.
+  void write_frames(const uint8_t *const *data, const uint64_t *utc_ns,
+                    size_t n) {
+    if (!isOpen()) {
+      spdlog::critical("failed to open file: {}", fn);
+      return;
+    }
+    if (n == 0) return;
+    if (!is_prepared) spdlog::error("{}: header not initialized", __func__);
+    for (size_t i = 0; i < n; i++) {
+      header->uiFrameCount++;
+      if (!timestamped) {
+        timestamp.push_back(0);
+        continue;
+      }
+      uint64_t t = utc_ns[i];
+      if (t == 0)
+        t = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count();
+      timestamp.push_back(SERUnixNanoToVideotime(t));
+      // The recording starts with its first frame, which may predate the
+      // file (pre-trigger); the header is rewritten on close().
+      if (header->uiFrameCount == 1)
+        header->ulDateTime = header->ulDateTime_UTC = timestamp.back();
+    }
+    // the backend may want the new timestamps, the last n
+    append_frames(data, n);
   }
   void close() {
     if (header->uiFrameCount > 0) {
       print_header();
       write_header();
-      write_tail();
+      append_trailer();
     }
-    fd.flush();
-    fd.sync();
-    spdlog::info("Closing file: {}: {} bytes written", fn, fd.tellg());
-    fd.close();
+    finish();
   }
 
- private:
-  std::fstream fd;
-  bool is_prepared;
+ protected:
+  bool is_prepared = false;
+  bool timestamped = true;
   size_t sz = 0;
   std::vector<uint64_t> timestamp;
+  std::optional<SERByteOrder> order;
+  bool swap_samples = false;  // the file's samples are in the other order
+  std::vector<uint8_t> swapped;  // scratch for swapped_frames()
+  std::vector<const uint8_t *> swapped_ptrs;
 
-  template <typename T>
-  void write(T *data, std::size_t bytes) {
-    if (!is_prepared) spdlog::error("{}: header not initialized", __func__);
-    fd.write((char *)&data[0], bytes * sizeof(T));
+  virtual void put_header(const SERHeader &h) = 0;
+  virtual void append(const uint8_t *data, size_t bytes) = 0;
+  virtual void append_frames(const uint8_t *const *data, size_t n) {
+    data = swapped_frames(data, n);
+    for (size_t i = 0; i < n; i++) append(data[i], sz);
+  }
+  // data as it goes in the file: itself, or swapped copies in a scratch
+  // buffer that stays valid until the next call.
+  const uint8_t *const *swapped_frames(const uint8_t *const *data, size_t n) {
+    if (!swap_samples) return data;
+    if (swapped.size() < n * sz) swapped.resize(n * sz);
+    swapped_ptrs.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      ByteSwap::Swap16(swapped.data() + i * sz, data[i], sz);
+      swapped_ptrs[i] = swapped.data() + i * sz;
+    }
+    return swapped_ptrs.data();
+  }
+  // memcpy that puts the samples in the file's byte order; bytes is even.
+  void copy_samples(uint8_t *dst, const uint8_t *src, size_t bytes) const {
+    if (swap_samples)
+      ByteSwap::Swap16(dst, src, bytes);
+    else
+      std::memcpy(dst, src, bytes);
+  }
+  // After the last frame: the SER timestamp trailer, if there are times.
+  virtual void append_trailer() {
+    if (!timestamped) return;
+    append(reinterpret_cast<const uint8_t *>(timestamp.data()),
+           timestamp.size() * sizeof(uint64_t));
   }
+  // Flush everything and close the file.
+  virtual void finish() = 0;
+
   void write_header() {
     if (is_sysbig_endian) swapEndiannessHeader();
-    fd.seekg(0, std::ios::beg);
-    write<SERHeader>(header.get(), 1);
-    fd.seekg(0, std::ios::end);
+    put_header(*header);
     if (is_sysbig_endian) swapEndiannessHeader();
   }
-  void write_tail() {
-    fd.seekg(0, std::ios::end);
-    write<uint64_t>(timestamp.data(), timestamp.size());
+  void apply_byte_order(SERByteOrder o) {
+    header->uiLittleEndian = o == SERByteOrder::LegacyLittleEndian ? 0 : 1;
+    swap_samples = SERSampleBytes(*header) == 2 &&
+                   (o == SERByteOrder::LegacyBigEndian) != is_sysbig_endian;
+  }
+};
+
+// Buffered backend: positional writes through the page cache. A batch of
+// frames goes out as one pwritev().
+class SERWriter : public SERWriterBase {
+ public:
+  SERWriter(std::string _fn) {
+    fn = _fn;
+    fd = open(fn.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      spdlog::critical("failed to open file: {}: {}", fn,
+                       std::strerror(errno));
+    }
+  };
+  ~SERWriter() {
+    spdlog::info("closing writter for: {}", fn);
+    if (isOpen()) close();
+    if (fd >= 0) ::close(fd);
+  };
+  bool isOpen()
+  {
+    return fd >= 0 && !failed;
+  }
+
+ private:
+  int fd = -1;
+  bool failed = false;
+  off_t pos = 0;  // end of the file
+  std::vector<iovec> iov;
+
+  bool write_all(iovec *v, int n, off_t off) {
+    if (PwritevAll(fd, v, n, off)) return true;
+    spdlog::critical("Write to {} failed: {}", fn, std::strerror(errno));
+    failed = true;
+    return false;
+  }
+  void put_header(const SERHeader &h) {
+    iovec v{const_cast<SERHeader *>(&h), sizeof(h)};
+    write_all(&v, 1, 0);
+    pos = std::max<off_t>(pos, sizeof(h));
+  }
+  void append(const uint8_t *data, size_t bytes) {
+    iovec v{const_cast<uint8_t *>(data), bytes};
+    if (write_all(&v, 1, pos)) pos += bytes;
+  }
+  void append_frames(const uint8_t *const *data, size_t n) {
+    data = swapped_frames(data, n);
+    iov.resize(n);
+    for (size_t i = 0; i < n; i++)
+      iov[i] = {const_cast<uint8_t *>(data[i]), sz};
+    if (write_all(iov.data(), int(n), pos)) pos += n * sz;
+  }
+  void finish() {
+    spdlog::info("Closing file: {}: {} bytes written", fn, pos);
+    ::close(fd);
+    fd = -1;
   }
 };
 }  // namespace SER
@@ -0,0 +1,265 @@
+#ifndef __SER_STRIPED_WRITER__
+#define __SER_STRIPED_WRITER__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "SERDirectWriter.hpp"
+
+namespace SER {
+
+//-------------------------------------------------------------------
+// SER recording spread over several directories, typically on separate
+// disks, with optional size-based rotation.
+//
+// Frames go out in stripe units of about STRIPE_BYTES: a unit goes to one
+// directory, the next unit to the next one. RoundRobin takes the directories
+// in turn; Weighted gives each a share proportional to the rate it has been
+// absorbing frames at, so a slow disk gets fewer units. That rate is the
+// wall time of the writer's write_frames(): with the Buffered backend it is
+// how fast the page cache takes the frames, which only follows the disk once
+// dirty pages are being throttled; Direct measures the disk itself. Every file is a
+// complete SER of its own, and a file that would grow past rotate_mb is closed
+// and continued in the next part.
+//
+// Unless there is only one directory and no rotation, in which case this is
+// a plain <dir>/<name>.ser, the files are <dir>/<name>_s<stripe>_<part>.ser
+// (.serz for the Compressed and Packed backends, whose parts rotate early as
+// their size is estimated uncompressed) and <first dir>/<name>.manifest records which
+// file holds which frames:
+//   file <id> <path>
+//   run <id> <frames>       (repeated, in recording order)
+//   end <total frames>
+// tools/ser_merge turns it back into one SER in the original frame order.
+//-------------------------------------------------------------------
+class SERStripedWriter {
+ public:
+  static constexpr size_t STRIPE_BYTES = 8 * 1024 * 1024;
+
+  // name is the file name without extension; rotate_mb == 0 never rotates.
+  // adc_bits as for MakeSERWriter().
+  SERStripedWriter(const std::vector<std::string> &dirs, std::string _name,
+                   WriterBackend _backend, StripeMode _mode, size_t rotate_mb,
+                   int _adc_bits = 0)
+      : name(_name),
+        backend(_backend),
+        mode(_mode),
+        rotate_bytes(uint64_t(rotate_mb) * 1024 * 1024),
+        adc_bits(_adc_bits) {
+    for (const auto &d : dirs)
+      if (!d.empty()) stripes.emplace_back().dir = d;
+    if (stripes.empty()) stripes.emplace_back().dir = ".";
+    plain = stripes.size() == 1 && rotate_bytes == 0;
+    cur = stripes.size() - 1;  // so round robin starts at the first one
+  }
+  ~SERStripedWriter() { close(); }
+  SERStripedWriter(const SERStripedWriter &) = delete;
+  SERStripedWriter &operator=(const SERStripedWriter &) = delete;
+
+  // Byte order of the samples in every file; before prepare_header().
+  void set_byte_order(SERByteOrder o) { order = o; }
+  // Opens the first file in every directory.
+  void prepare_header(std::array<size_t, 2> _dim,
+                      std::array<std::string, 3> _str, uint8_t _nbytes,
+                      BAYER _bay = COLOR_MONO) {
+    dim = _dim;
+    str = _str;
+    nbytes = _nbytes;
+    bay = _bay;
+    if (!plain) {
+      const auto path = std::filesystem::path(stripes[0].dir) /
+                        (name + ".manifest");
+      manifest.open(path);
+      if (!manifest) {
+        spdlog::critical("Failed to create manifest {}", path.string());
+        failed = true;
+        return;
+      }
+      manifest << "# AstroCapture striped SER v1\n";
+    }
+    for (size_t i = 0; i < stripes.size() && !failed; i++) open_part(i);
+    if (!failed)
+      spdlog::info("Recording {} across {} director{}{}", name,
+                   stripes.size(), stripes.size() == 1 ? "y" : "ies",
+                   rotate_bytes ? fmt::format(", rotating at {} MB",
+                                              rotate_bytes / 1024 / 1024)
+                                : "");
+  }
+  // The first directory, which holds the manifest.
+  const std::string &directory() const { return stripes[0].dir; }
+  bool isOpen() {
+    if (failed) return false;
+    for (auto &s : stripes)
+      if (s.writer == nullptr || !s.writer->isOpen()) return false;
+    return true;
+  }
+  // utc_ns as for SERWriterBase::write_frames().
+  void write_frames(const uint8_t *const *data, const uint64_t *utc_ns,
+                    size_t n) {
+    size_t i = 0;
+    while (i < n && !failed) {
+      if (unit_left == 0) {
+        cur = pick();
+        unit_left = unit_frames;
+      }
+      Stripe &s = stripes[cur];
+      size_t k = std::min(n - i, unit_left);
+      if (rotate_bytes) {
+        // header + frames + their trailer entries must stay under the limit
+        const uint64_t per = sz + sizeof(uint64_t);
+        auto room = [&] {
+          return (rotate_bytes - std::min(rotate_bytes, s.bytes)) / per;
+        };
+        if (room() == 0 && s.writer->FrameCount() > 0) {
+          open_part(cur);
+          if (failed) return;
+        }
+        k = std::min<size_t>(k, std::max<uint64_t>(room(), 1));
+      }
+      const auto t = std::chrono::steady_clock::now();
+      s.writer->write_frames(data + i, utc_ns + i, k);
+      const double dt = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - t)
+                            .count();
+      // Rate over roughly the last ten writes to this stripe; a page cache
+      // rate for buffered writers, see above.
+      s.rate_bytes = 0.9 * s.rate_bytes + double(k) * sz;
+      s.rate_seconds = 0.9 * s.rate_seconds + dt;
+      s.bytes += k * (sz + sizeof(uint64_t));
+      s.frames += k;
+      add_run(s.file_id, k);
+      i += k;
+      unit_left -= k;
+    }
+  }
+  void close() {
+    if (closed) return;
+    closed = true;
+    for (auto &s : stripes) {
+      if (s.writer != nullptr)
+        spdlog::info("Stripe {}: {} frames, {:.0f} MB/s", s.dir, s.frames,
+                     s.rate_seconds > 0
+                         ? s.rate_bytes / s.rate_seconds / 1024 / 1024
+                         : 0.0);
+      s.writer.reset();
+    }
+    if (manifest.is_open()) {
+      flush_run();
+      manifest << "end " << total << "\n";
+      manifest.close();
+    }
+  }
+
+ private:
+  struct Stripe {
+    std::string dir;
+    std::unique_ptr<SERWriterBase> writer;
+    uint32_t part = 0;     // parts opened so far
+    uint32_t file_id = 0;  // of the current part in the manifest
+    uint64_t bytes = 0;    // the current part will have on close
+    uint64_t frames = 0;
+    double rate_bytes = 0;  // decayed sums for the Weighted rate
+    double rate_seconds = 0;
+    double credit = 0;  // smooth weighted round robin
+  };
+
+  const std::string name;
+  const WriterBackend backend;
+  const StripeMode mode;
+  const uint64_t rotate_bytes;
+  const int adc_bits;
+  bool plain = false;
+  bool failed = false;
+  bool closed = false;
+  std::vector<Stripe> stripes;
+  std::array<size_t, 2> dim{};
+  std::array<std::string, 3> str;
+  uint8_t nbytes = 1;
+  BAYER bay = COLOR_MONO;
+  std::optional<SERByteOrder> order;
+  size_t sz = 0;
+  size_t unit_frames = 1;  // frames per stripe unit
+  size_t unit_left = 0;    // frames left in the current unit
+  size_t cur = 0;          // stripe of the current unit
+  uint32_t files = 0;
+  uint64_t total = 0;
+  std::ofstream manifest;
+  uint32_t run_file = 0;  // pending manifest run
+  uint64_t run_frames = 0;
+
+  void open_part(size_t i) {
+    Stripe &s = stripes[i];
+    const std::string file =
+        plain ? name + SERFileExtension(backend)
+              : fmt::format("{}_s{}_{:03}{}", name, i, s.part,
+                            SERFileExtension(backend));
+    const std::string path = (std::filesystem::path(s.dir) / file).string();
+    s.writer.reset();  // closes the previous part
+    s.writer = MakeSERWriter(backend, path, adc_bits);
+    if (order) s.writer->set_byte_order(*order);
+    s.writer->prepare_header(dim, str, nbytes, bay);
+    if (!s.writer->isOpen()) {
+      spdlog::critical("Failed to open stripe file {}", path);
+      failed = true;
+      return;
+    }
+    sz = s.writer->FrameSize();
+    unit_frames = std::max<size_t>(STRIPE_BYTES / std::max<size_t>(sz, 1), 1);
+    s.part++;
+    s.bytes = sizeof(SERHeader);
+    s.file_id = files++;
+    if (manifest.is_open()) {
+      flush_run();
+      manifest << "file " << s.file_id << " " << path << "\n";
+      manifest.flush();
+    }
+  }
+  size_t pick() {
+    if (mode == StripeMode::RoundRobin) return (cur + 1) % stripes.size();
+    // Smooth weighted round robin on the measured rates. Until a stripe has
+    // been measured it gets the best rate seen, so each one gets tried.
+    double best = 0;
+    for (auto &s : stripes)
+      if (s.rate_seconds > 0)
+        best = std::max(best, s.rate_bytes / s.rate_seconds);
+    double sum = 0;
+    size_t next = 0;
+    for (size_t i = 0; i < stripes.size(); i++) {
+      Stripe &s = stripes[i];
+      const double w = s.rate_seconds > 0 ? s.rate_bytes / s.rate_seconds
+                                          : std::max(best, 1.0);
+      s.credit += w;
+      sum += w;
+      if (s.credit > stripes[next].credit) next = i;
+    }
+    stripes[next].credit -= sum;
+    return next;
+  }
+  void add_run(uint32_t file_id, uint64_t n) {
+    total += n;
+    if (!manifest.is_open()) return;
+    if (run_frames > 0 && run_file != file_id) flush_run();
+    run_file = file_id;
+    run_frames += n;
+  }
+  void flush_run() {
+    if (run_frames == 0) return;
+    manifest << "run " << run_file << " " << run_frames << "\n";
+    manifest.flush();
+    run_frames = 0;
+  }
+};
+
+}  // namespace SER
+
+#endif
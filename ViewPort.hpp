@@ -30,9 +30,15 @@ class ViewPort : public IVInspector, public AcqManager {
       Inspector_Show(true);
     } else {
       //UpdateView();
-      updatingFrame.lock();
+      Pipeline* p = Selected();
+      const uint64_t published = p != nullptr ? TakeImage(*p) : 0;
       Inspector_Show(true, &mImage);
-      updatingFrame.unlock();
+      if (published != 0) {
+        const uint64_t now = monotonic_ns();
+        p->camera->Stats()
+            .diag.at(LatencyStage::Displayed)
+            .record(now - std::min(now, published));
+      }
     }
     GuiSobelParams();
   }
@@ -132,6 +132,7 @@ class ASIBase : public CameraBase {
         mExposureCap->Description[14] = 'm';
         mExposureCap->current_value = mExposureCap->current_value / 1000.0;
       }
+      if (cap.ControlType == ASI_GAIN) mGainCap = rcap;
     }
 
     int width = 0, height = 0, bin = 1;
@@ -277,11 +278,13 @@ class ASIBase : public CameraBase {
     streamingFrames.buffer.reset();
     streamingFrames.buffer = std::make_shared<Circular_Buffer<uint8_t>>(
         max_buffer_size * 1024 * 1024 / nTotalBytes, nTotalBytes);
+    Stats().diag.start(*streamingFrames.buffer);
     streamingFrames.size = nTotalBytes;
     streamingFrames.ch = std::get<1>(imgFormat)[2];
     streamingFrames.byte_channel = std::get<2>(imgFormat);
     streamingFrames.format = SER::BAYER::COLOR_RGB;
     streamingFrames.currentFormat = mCurrentStillFormat;
+    streamingFrames.adc_bits = mCameraInfo.BitDepth;
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
     is_still = false;
     is_running = true;
@@ -307,12 +310,28 @@ class ASIBase : public CameraBase {
     streamingFrames.is_active = true;
     int droppedcount = 0;
     uint8_t *targetFrame = nullptr;
-    bool get_new_buffer = true;
+    // Frames that arrive while the ring is full are still pulled off the USB
+    // link (so the SDK does not stall), but into a scratch frame that is
+    // never published.
+    std::unique_ptr<uint8_t[]> discardFrame;
+    // RGB24 comes from the SDK interleaved. The conversion stage splits it
+    // into planes on its own thread; without one it comes into rgbFrame and
+    // is split into the slot here.
+    std::unique_ptr<FrameStage> stage =
+        MakeConvertStage(imgFormat, nTotalBytes);
+    std::unique_ptr<uint8_t[]> rgbFrame;
+    if (!stage && streamingFrames.currentFormat == ASI_IMG_RGB24)
+      rgbFrame = std::make_unique<uint8_t[]>(nTotalBytes);
+    // Exposure/gain stamped on each frame; refreshed with the fps counter so
+    // auto exposure/gain are tracked without a USB round trip per frame.
+    uint32_t expoUs = uint32_t(mExposureCap->current_value * 1000);
+    uint32_t gain = mGainCap != nullptr ? uint32_t(mGainCap->current_value) : 0;
 
     while (true) {
       if (do_abort) {
         spdlog::info("aborting .");
         StopVideoCapture();
+        stage.reset();  // publishes what it still holds
         is_running = false;
         do_abort = false;
         streamingFrames.do_record = false;
@@ -324,30 +343,41 @@ class ASIBase : public CameraBase {
       ASIGetDroppedFrames(mCameraID, &droppedcount);
       m_dropped_frames = droppedcount;
       if (timer.Finish() > 500) {
-        m_fps = float(count) * 500. / float(timer.Finish());
+        m_fps = float(count) * 1000. / float(timer.Finish());
         m_vc_escape = escaped.Finish();
         timer.Start();
         spdlog::debug("Capturing at {} fps. Dropped frame {}", m_fps,
                       m_dropped_frames);
-        processStat.fps.push(m_fps);
+        Stats().update(m_fps, *streamingFrames.buffer,
+                       streamingFrames.overflow_policy);
+        Stats().diag.sdk_dropped = m_dropped_frames;
         count = 0;
+        auto expo = GetControlValue(ASI_EXPOSURE);
+        if (std::get<0>(expo) == ASI_SUCCESS) expoUs = std::get<1>(expo);
+        auto g = GetControlValue(ASI_GAIN);
+        if (std::get<0>(g) == ASI_SUCCESS) gain = std::get<1>(g);
       }
 
-      if (get_new_buffer) 
-        targetFrame = streamingFrames.buffer->get_new_buffer();
-      else
-        get_new_buffer = true;
-      if (targetFrame == nullptr) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(waitMS));
-        continue;
+      targetFrame = stage ? stage->claim()
+                          : streamingFrames.buffer->claim(
+                                streamingFrames.overflow_policy,
+                                streamingFrames.block_timeout_ms);
+      bool is_discard = targetFrame == nullptr;
+      if (is_discard) {
+        if (!discardFrame) discardFrame = std::make_unique<uint8_t[]>(nTotalBytes);
+        targetFrame = discardFrame.get();
       }
 
-      ret = ASIGetVideoData(mCameraID, targetFrame, nTotalBytes, waitMS);
+      ret = ASIGetVideoData(mCameraID,
+                            rgbFrame && !is_discard ? rgbFrame.get()
+                                                    : targetFrame,
+                            nTotalBytes, waitMS);
       if (ret != ASI_SUCCESS) {
         if (ret != ASI_ERROR_TIMEOUT) {
           spdlog::critical("ASIGetVideoData status timed out ({})",
                            ASIHelpers::toString(ret));
           StopVideoCapture();
+          stage.reset();
           is_running = false;
           streamingFrames.do_record = false;
           streamingFrames.is_active = false;
@@ -355,12 +385,32 @@ class ASIBase : public CameraBase {
         }
         spdlog::critical("ASIGetVideoData status timed out ({})",
                          ASIHelpers::toString(ret));
-        get_new_buffer = false;
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
         continue;
       }
-      if (streamingFrames.currentFormat == ASI_IMG_RGB24)
-        sort_rgb24(targetFrame, imgFormat);
+      if (is_discard) {
+        streamingFrames.buffer->mark_dropped();
+        continue;
+      }
+      FrameMeta &meta = stage ? stage->claimed_meta()
+                              : streamingFrames.buffer->claimed_meta();
+      meta.capture_ns = monotonic_ns();
+      meta.utc_ns = realtime_ns();
+      meta.exposure_us = expoUs;
+      meta.gain = gain;
+      meta.sdk_dropped = droppedcount;
+      meta.ring_dropped =
+          streamingFrames.buffer->get_counters().dropped.load(
+              std::memory_order_relaxed);
+      if (stage) {
+        stage->commit();
+      } else {
+        if (rgbFrame)
+          RGB24::ToPlanar(targetFrame, rgbFrame.get(),
+                          std::get<1>(imgFormat)[1],
+                          std::get<1>(imgFormat)[0]);
+        streamingFrames.buffer->commit();
+      }
 
       count++;
       //std::this_thread::sleep_for(std::chrono::milliseconds(10));
@@ -370,6 +420,7 @@ class ASIBase : public CameraBase {
       //       std::swap(targetFrame[i], targetFrame[i + 2]);
     }
     spdlog::info("Capture completed .");
+    stage.reset();
     is_running = false;
     streamingFrames.do_record = false;
     while (streamingFrames.is_recording)
@@ -474,7 +525,13 @@ class ASIBase : public CameraBase {
     }
     spdlog::debug("Exposure successful .", mExposureRetry);
 
-    ret = ASIGetDataAfterExp(mCameraID, stillFrame.buffer.get(), nTotalBytes);
+    // RGB24 is split into planes on the way from a scratch frame.
+    std::unique_ptr<uint8_t[]> rgbFrame;
+    if (stillFrame.currentFormat == ASI_IMG_RGB24)
+      rgbFrame = std::make_unique<uint8_t[]>(nTotalBytes);
+    ret = ASIGetDataAfterExp(
+        mCameraID, rgbFrame ? rgbFrame.get() : stillFrame.buffer.get(),
+        nTotalBytes);
     if (ret != ASI_SUCCESS) {
       spdlog::critical(
           "Failed to get data after exposure ({}x{} #{} channels, {} bytes) "
@@ -484,8 +541,9 @@ class ASIBase : public CameraBase {
           ASIHelpers::toString(ret));
       return 0;
     }
-    if (stillFrame.currentFormat == ASI_IMG_RGB24)
-      sort_rgb24(stillFrame.buffer.get(), imgFormat);
+    if (rgbFrame)
+      RGB24::ToPlanar(stillFrame.buffer.get(), rgbFrame.get(),
+                      std::get<1>(imgFormat)[1], std::get<1>(imgFormat)[0]);
     spdlog::debug(
         "Downloaded exposure... ({}x{} #{} channels, {} bytes; total: {} {}) ",
         std::get<1>(imgFormat)[0], std::get<1>(imgFormat)[1],
@@ -519,50 +577,6 @@ class ASIBase : public CameraBase {
 
     return true;
   }
-  void sort_rgb24(
-      uint8_t *ptr,
-      std::tuple<ASIHelpers::PIXEL_FORMAT, std::array<uint16_t, 3>, size_t>
-          imgFormat) {
-    uint8_t *dstR = ptr;
-    uint8_t *dstG = ptr + std::get<1>(imgFormat)[0] * std::get<1>(imgFormat)[1];
-    uint8_t *dstB =
-        ptr + std::get<1>(imgFormat)[0] * std::get<1>(imgFormat)[1] * 2;
-
-    const uint8_t *src = ptr;
-    const uint8_t *end =
-        ptr + std::get<1>(imgFormat)[0] * std::get<1>(imgFormat)[1] * 3;
-
-    while (src != end) {
-      *dstB++ = *src++;
-      *dstG++ = *src++;
-      *dstR++ = *src++;
-    }
-  }
-  bool SetCCDBin(uint8_t bin) {
-    if (bin < 1) {
-      spdlog::critical("Invalid bin request : {}", bin);
-      return false;
-    }
-    for (size_t i = 0; i < 8; i++)
-      if (bin == mCameraInfo.SupportedBins[i]) {
-        m_frame[0].Bin = bin;
-        m_frame[1].Bin = bin;
-        m_frame[0].BinnedValue = m_frame[0].CurrentValue / bin;
-        m_frame[1].BinnedValue = m_frame[1].CurrentValue / bin;
-        m_frame[0].BinndedAxisOffset = m_frame[0].AxisOffset / bin;
-        m_frame[1].BinndedAxisOffset = m_frame[1].AxisOffset / bin;
-        spdlog::debug("Bin Set to: {}", bin);
-        spdlog::debug("Bined Resolution to: {} x {}", m_frame[0].BinnedValue,
-                      m_frame[1].BinnedValue);
-        spdlog::debug("Bined Resolution to: {} x {}",
-                      m_frame[0].BinndedAxisOffset,
-                      m_frame[1].BinndedAxisOffset);
-        return true;
-      }
-    spdlog::critical("Invalid bin request : {}", bin);
-
-    return false;
-  }
   bool SetCCDROI() {
     uint32_t binX = m_frame[1].Bin;
     uint32_t binY = m_frame[0].Bin;
@@ -612,25 +626,6 @@ class ASIBase : public CameraBase {
     return true;
   }
 
-  std::tuple<ASIHelpers::PIXEL_FORMAT, std::array<uint16_t, 3>, size_t>
-  getImageFormat(ASI_IMG_TYPE type) {
-    ASIHelpers::PIXEL_FORMAT pixel = ASIHelpers::pixelFormat(
-        type, mCameraInfo.BayerPattern, mCameraInfo.IsColorCam);
-    uint8_t dim = 3;
-    if (pixel == ASIHelpers::PIXEL_FORMAT::MONO8 ||
-        pixel == ASIHelpers::PIXEL_FORMAT::MONO16)
-      dim = 1;
-    size_t sz = 1;
-    if (type == ASI_IMG_RAW16) sz = 2;
-
-    return std::make_tuple(
-        pixel,
-        std::array<uint16_t, 3>{static_cast<uint16_t>(m_frame[0].BinnedValue),
-                                static_cast<uint16_t>(m_frame[1].BinnedValue),
-                                dim},
-        sz);
-  }
-
   bool StopExposure() {
     if (!is_running && !is_still) return true;
     ASI_ERROR_CODE ret = ASIStopExposure(mCameraInfo.CameraID);
@@ -695,11 +690,5 @@ class ASIBase : public CameraBase {
 
  public:
   uint32_t mCameraID;
-  ASI_CAMERA_INFO mCameraInfo;
   uint8_t mExposureRetry{0};
-  ASI_IMG_TYPE mCurrentStillFormat;
-
-  std::atomic_uint32_t m_expo_escape, m_vc_escape;
-
-
 };
@@ -26,6 +26,7 @@
 #include <spdlog/spdlog.h>
 #include <libasi/ASICamera2.h>
 #include "asi_base.hpp"
+#include "synthetic_camera.hpp"
 #include <thread>
 
 #include <map>
@@ -56,6 +57,7 @@ class ASICCD : public ASIBase
         static void SDoCapture(ASICCD* ccd)
         {
           spdlog::debug("SDoStatic started");
+          ThreadProfile::Apply(ThreadProfile::Role::Capture);
           ccd->DoCapture();
         }
         static void SDoVCapture(ASICCD* ccd)
@@ -63,13 +65,16 @@ class ASICCD : public ASIBase
           HelloImGui::Log(HelloImGui::LogLevel::Debug,
                           "DoVideoCapture command issued %d.", ccd->max_buffer_size);
           spdlog::debug("SDoVCapture started: %d", ccd->max_buffer_size);
+          ThreadProfile::Apply(ThreadProfile::Role::Capture);
           ccd->DoVideoCapture();
         }
 };
 static class Loader
 {
     public:
-        std::map<int, std::shared_ptr<ASICCD>> cameras;
+        // ZWO cameras by SDK id, and the synthetic camera after them.
+        std::map<int, std::shared_ptr<CameraBase>> cameras;
+        static constexpr int SYNTHETIC_CAMERA_ID = 0x10000;
         Loader()
         {
             spdlog::debug(__func__);
@@ -116,6 +121,14 @@ static class Loader
                 cameras[id] = std::shared_ptr<ASICCD>(asiCcd);
                 spdlog::info("Camera ID: {}; Name: {}", id, name);
             }
+
+            // Always there, for benchmarking without hardware.
+            if (usedCameras.find(SYNTHETIC_CAMERA_ID) != usedCameras.end())
+                std::swap(cameras[SYNTHETIC_CAMERA_ID],
+                          usedCameras[SYNTHETIC_CAMERA_ID]);
+            else
+                cameras[SYNTHETIC_CAMERA_ID] =
+                    std::make_shared<SyntheticCamera>("Synthetic camera");
         }
 
     public:
@@ -124,7 +137,7 @@ static class Loader
                 std::map<std::string, bool> used;
             public:
                 UniqueName() = default;
-                UniqueName(const std::map<int, std::shared_ptr<ASICCD>> &usedCameras)
+                UniqueName(const std::map<int, std::shared_ptr<CameraBase>> &usedCameras)
                 {
                     for (const auto &camera : usedCameras)
                         used[camera.second->getDevName()] = true;
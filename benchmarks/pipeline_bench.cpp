@@ -0,0 +1,364 @@
+// End-to-end benchmark of the streaming path, without a camera.
+//
+// A synthetic source publishes frames into the capture ring at a fixed rate
+// (0 = as fast as possible) while the recorder writes them out the way the
+// app does (spill tier pass-through, batched writes, SERStripedWriter) and a
+// preview thread converts the newest frame with the live view's conversion.
+// Per stage it reports the sustained rate, the latency from capture to the
+// end of that stage (p50/p99/max) and the frames lost there; the ring's
+// occupancy is sampled throughout. Afterwards the recording is read back and
+// compared with the frames the source committed. The result goes to stdout
+// as JSON, the log to stderr, so runs of two builds can be compared with jq
+// or diff.
+//
+// usage: pipeline_bench [dir] [width] [height] [raw8|raw16|rgb24] [fps]
+//                       [seconds] [stream|direct|compressed|packed]
+//                       [ring MB] [preview fps] [keep]
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SERCompressed.hpp"
+#include "SERMappedReader.hpp"
+#include "SERStripedWriter.hpp"
+#include "circular_buffer.hpp"
+#include "preview.hpp"
+#include "spill_tier.hpp"
+#include "synthetic_frames.hpp"
+#include "timer.hpp"
+
+// Latencies of one stage, in microseconds.
+struct Latency {
+  std::vector<uint32_t> us;
+
+  void add(uint64_t from_ns, uint64_t to_ns) {
+    us.push_back(uint32_t(std::min<uint64_t>(
+        to_ns > from_ns ? (to_ns - from_ns) / 1000 : 0, UINT32_MAX)));
+  }
+  std::string json() {
+    if (us.empty()) return R"({"p50": null, "p99": null, "max": null})";
+    std::sort(us.begin(), us.end());
+    auto pct = [&](double p) {
+      return us[std::min(us.size() - 1, size_t(p * us.size()))];
+    };
+    return fmt::format(R"({{"p50": {}, "p99": {}, "max": {}}})", pct(0.50),
+                       pct(0.99), us.back());
+  }
+};
+
+struct Stage {
+  uint64_t frames = 0;
+  uint64_t lost = 0;
+  double seconds = 0;
+  Latency latency;
+
+  std::string json(size_t frame_bytes, const std::string &extra = "") {
+    const double s = std::max(seconds, 1e-9);
+    return fmt::format(
+        R"({{"frames": {}, "lost": {}, "seconds": {:.3f}, "fps": {:.1f}, )"
+        R"("MBps": {:.1f}, "latency_us": {}{}}})",
+        frames, lost, seconds, frames / s,
+        frames * double(frame_bytes) / 1024 / 1024 / s, latency.json(),
+        extra);
+  }
+};
+
+static double process_cpu_seconds() {
+  rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+         (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+// Reads the recording back and checks it holds the scene frames committed,
+// in order, with the geometry they were recorded with.
+static bool Verify(const std::string &file, SER::WriterBackend backend,
+                   const Synthetic::Scene &scene,
+                   const std::vector<uint64_t> &committed) {
+  const auto &cfg = scene.Config();
+  auto check = [&](const SER::SERHeader &h, size_t frame_size,
+                   uint32_t frames) {
+    if (h.uiImageWidth != cfg.width || h.uiImageHeight != cfg.height ||
+        h.uiColorID != uint32_t(cfg.color) ||
+        h.uiPixelDepth != cfg.bytes * 8 || frame_size != scene.FrameBytes() ||
+        frames != committed.size()) {
+      spdlog::critical("{}: {} frames of {} bytes at {} bits, expected {} of "
+                       "{} at {}",
+                       file, frames, frame_size, h.uiPixelDepth,
+                       committed.size(), scene.FrameBytes(), cfg.bytes * 8);
+      return false;
+    }
+    return true;
+  };
+  std::vector<uint8_t> frame(scene.FrameBytes());
+  auto same = [&](uint32_t i) {
+    if (std::memcmp(frame.data(), scene.Frame(committed[i]), frame.size())) {
+      spdlog::critical("{}: frame {} differs from the one recorded", file, i);
+      return false;
+    }
+    return true;
+  };
+  if (backend == SER::WriterBackend::Compressed ||
+      backend == SER::WriterBackend::Packed) {
+    SER::SERCompressedReader in(file);
+    if (!in.isOpen() || !check(in.Header(), in.FrameSize(), in.FrameCount()))
+      return false;
+    uint8_t *out = frame.data();
+    uint64_t utc;
+    for (uint32_t i = 0; i < in.FrameCount(); i++)
+      if (!in.ReadFrames(i, 1, &out, &utc) || !same(i)) return false;
+    return true;
+  }
+  // Written with uiLittleEndian = 1 meaning little endian, as in the spec.
+  SER::SERMappedReader in(file, true);
+  if (!in.isOpen() || !check(in.Header(), in.FrameSize(), in.FrameCount()))
+    return false;
+  for (uint32_t i = 0; i < in.FrameCount(); i++)
+    if (!in.CopyFrame(i, frame.data()) || !same(i)) return false;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  spdlog::set_default_logger(spdlog::stderr_color_mt("pipeline_bench"));
+  const std::string dir = argc > 1 ? argv[1] : ".";
+  const uint32_t width = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1920;
+  const uint32_t height = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1080;
+  const std::string format = argc > 4 ? argv[4] : "raw16";
+  const double fps = argc > 5 ? std::strtod(argv[5], nullptr) : 100;
+  const double seconds = argc > 6 ? std::strtod(argv[6], nullptr) : 10;
+  const std::string backend_name = argc > 7 ? argv[7] : "stream";
+  const size_t ring_mb = argc > 8 ? std::strtoull(argv[8], nullptr, 10) : 512;
+  const double preview_fps = argc > 9 ? std::strtod(argv[9], nullptr) : 30;
+  const bool keep = argc > 10 && std::string(argv[10]) == "keep";
+
+  Synthetic::SceneConfig cfg;
+  cfg.width = width;
+  cfg.height = height;
+  if (format == "raw8") {
+    cfg.color = SER::COLOR_BAYER_RGGB;
+  } else if (format == "raw16") {
+    cfg.color = SER::COLOR_BAYER_RGGB;
+    cfg.bytes = 2;
+    cfg.adc_bits = 12;
+  } else if (format == "rgb24") {
+    cfg.color = SER::COLOR_RGB;
+  } else {
+    spdlog::critical("Unknown format {}", format);
+    return 1;
+  }
+  SER::WriterBackend backend;
+  if (backend_name == "stream")
+    backend = SER::WriterBackend::Stream;
+  else if (backend_name == "direct")
+    backend = SER::WriterBackend::Direct;
+  else if (backend_name == "compressed")
+    backend = SER::WriterBackend::Compressed;
+  else if (backend_name == "packed")
+    backend = SER::WriterBackend::Packed;
+  else {
+    spdlog::critical("Unknown backend {}", backend_name);
+    return 1;
+  }
+  if (width == 0 || height == 0) {
+    spdlog::critical("Empty frames");
+    return 1;
+  }
+
+  spdlog::info("Rendering {}x{} {} frames", width, height, format);
+  const Synthetic::Scene scene(cfg);
+  const size_t frame_bytes = scene.FrameBytes();
+  auto ring = std::make_shared<Circular_Buffer<uint8_t>>(
+      std::max<size_t>(ring_mb * 1024 * 1024 / frame_bytes, 2), frame_bytes);
+  // Both readers are there before the first frame, as the recorder's is
+  // when recording starts before the stream.
+  const int recordReader = ring->add_reader(ReaderPolicy::Lossless);
+  const int previewReader = ring->add_reader(ReaderPolicy::Latest);
+  spdlog::info("{} MB ring of {} frames, {} at {} fps into {} for {} s",
+               ring_mb, ring->capacity(), backend_name,
+               fps > 0 ? std::to_string(int(fps)) : "max", dir, seconds);
+
+  std::atomic_bool stop = false, sourceDone = false;
+  Stage source, recorder, preview;
+  // Scene frame of each frame committed, in order.
+  std::vector<uint64_t> committed;
+  const double cpu0 = process_cpu_seconds();
+  const uint64_t start = monotonic_ns();
+
+  // Source: the capture thread of a camera. Its latency is from the frame's
+  // slot in the schedule to its commit, so falling behind shows up there.
+  // Unthrottled, it waits for room in the ring instead of dropping, which
+  // makes the rate it reaches the sustained rate of the whole pipeline.
+  std::thread sourceThread([&] {
+    const uint64_t period = fps > 0 ? uint64_t(1e9 / fps) : 0;
+    const OverflowPolicy policy = period ? OverflowPolicy::DropNewest
+                                         : OverflowPolicy::BlockWithTimeout;
+    source.latency.us.reserve(size_t(std::max(fps, 1000.0) * seconds) + 1);
+    committed.reserve(source.latency.us.capacity());
+    for (uint64_t i = 0; !stop; i++) {
+      const uint64_t due = period ? start + i * period : monotonic_ns();
+      if (!sleep_until_ns(due, stop)) break;
+      uint8_t *slot = ring->claim(policy, 100);
+      if (slot == nullptr) {
+        ring->mark_dropped();
+        source.lost++;
+        continue;
+      }
+      std::memcpy(slot, scene.Frame(i), frame_bytes);
+      FrameMeta &meta = ring->claimed_meta();
+      meta.capture_ns = monotonic_ns();
+      meta.utc_ns = realtime_ns();
+      ring->commit();
+      committed.push_back(i);
+      source.latency.add(due, monotonic_ns());
+      source.frames++;
+    }
+    source.seconds = (monotonic_ns() - start) / 1e9;
+    sourceDone = true;
+  });
+
+  // Recorder: AcqManager::RecordStream without the GUI.
+  double closeSeconds = 0;
+  std::thread recordThread([&] {
+    SER::SERStripedWriter writer({dir}, "pipeline_bench", backend,
+                                 SER::StripeMode::RoundRobin, 0,
+                                 cfg.adc_bits);
+    writer.prepare_header({height, width}, {"bench", "bench", "bench"},
+                          uint8_t(cfg.bytes), cfg.color);
+    if (!writer.isOpen()) {
+      spdlog::critical("Failed to open the recording in {}", dir);
+      stop = true;
+      return;
+    }
+    SpillTier spill(ring, recordReader, dir, 0, 0.75);
+    const size_t limit = std::clamp<size_t>(
+        64 * 1024 * 1024 / frame_bytes, 1,
+        std::max<size_t>(ring->capacity() / 2, 1));
+    std::vector<SpillTier::Frame> batch;
+    std::vector<const uint8_t *> data;
+    std::vector<uint64_t> utc;
+    while (writer.isOpen()) {
+      const bool last = sourceDone;
+      spill.wait(100);
+      batch.clear();
+      SpillTier::Frame frame;
+      while (batch.size() < limit && spill.acquire(frame))
+        batch.push_back(frame);
+      if (batch.empty()) {
+        if (last) break;
+        continue;
+      }
+      data.clear();
+      utc.clear();
+      for (const auto &f : batch) {
+        data.push_back(f.data);
+        utc.push_back(f.meta.utc_ns);
+      }
+      writer.write_frames(data.data(), utc.data(), batch.size());
+      const uint64_t now = monotonic_ns();
+      for (const auto &f : batch) {
+        recorder.latency.add(f.meta.capture_ns, now);
+        if (spill.release())
+          recorder.frames++;
+        else
+          recorder.lost++;
+      }
+    }
+    const uint64_t t = monotonic_ns();
+    writer.close();
+    closeSeconds = (monotonic_ns() - t) / 1e9;
+    recorder.seconds = (monotonic_ns() - start) / 1e9;
+  });
+
+  // Preview: AcqManager::UpdateView's read and conversion of the newest
+  // frame. Frames it skips are by design, not lost.
+  std::thread previewThread([&] {
+    const uint64_t period = preview_fps > 0 ? uint64_t(1e9 / preview_fps) : 0;
+    const size_t samples = size_t(width) * height * scene.Channels();
+    std::unique_ptr<uint8_t[]> image(new uint8_t[samples]);
+    uint64_t due = start;
+    while (!sourceDone) {
+      due += period;
+      if (!sleep_until_ns(due, sourceDone)) break;
+      const uint8_t *buf = ring->acquire(previewReader);
+      if (buf == nullptr) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
+      }
+      const uint64_t captured = ring->meta(buf).capture_ns;
+      Preview::To8Bit(buf, samples, cfg.bytes, image.get());
+      preview.latency.add(captured, monotonic_ns());
+      ring->release(previewReader);
+      preview.frames++;
+    }
+    preview.seconds = (monotonic_ns() - start) / 1e9;
+  });
+
+  // Occupancy: frames committed but not yet released by the recorder.
+  double occSum = 0;
+  size_t occMax = 0, occSamples = 0;
+  while (!stop && monotonic_ns() - start < uint64_t(seconds * 1e9)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const size_t occ = ring->occupancy();
+    occSum += occ;
+    occMax = std::max(occMax, occ);
+    occSamples++;
+  }
+  stop = true;
+  sourceThread.join();
+  previewThread.join();
+  recordThread.join();
+  const double cpu = process_cpu_seconds() - cpu0;
+  const double wall = (monotonic_ns() - start) / 1e9;
+
+  const auto &counters = ring->get_counters();
+  recorder.lost += counters.overwritten.load();
+  const std::string file =
+      dir + "/pipeline_bench" + SER::SERFileExtension(backend);
+  std::error_code ec;
+  const auto fileBytes = std::filesystem::file_size(file, ec);
+  const bool verified = recorder.frames == source.frames &&
+                        Verify(file, backend, scene, committed);
+  fmt::print(
+      "{{\n"
+      R"(  "config": {{"width": {}, "height": {}, "format": "{}", )"
+      R"("frame_bytes": {}, "fps": {}, "seconds": {}, "backend": "{}", )"
+      R"("dir": "{}", "ring_frames": {}, "preview_fps": {}}},)"
+      "\n"
+      R"(  "source": {},)"
+      "\n"
+      R"(  "ring": {{"capacity": {}, "occupancy_mean": {:.1f}, )"
+      R"("occupancy_max": {}, "dropped": {}}},)"
+      "\n"
+      R"(  "recorder": {},)"
+      "\n"
+      R"(  "preview": {},)"
+      "\n"
+      R"(  "cpu_seconds": {:.2f}, "cpu_percent": {:.0f}, "verified": {})"
+      "\n}}\n",
+      width, height, format, frame_bytes, fps, seconds, backend_name, dir,
+      ring->capacity(), preview_fps, source.json(frame_bytes),
+      ring->capacity(), occSamples ? occSum / occSamples : 0.0, occMax,
+      counters.dropped.load(),
+      recorder.json(frame_bytes,
+                    fmt::format(R"(, "close_seconds": {:.3f}, )"
+                                R"("file_bytes": {})",
+                                closeSeconds, ec ? 0 : fileBytes)),
+      preview.json(frame_bytes,
+                   fmt::format(R"(, "skipped": {})",
+                               ring->skipped(previewReader))),
+      cpu, 100 * cpu / wall, verified);
+
+  if (!keep) std::filesystem::remove(file, ec);
+  return verified ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+// Microbenchmark of the RGB24 BGR-interleaved to planar RGB conversion.
+//
+// Times the byte loop the capture thread used to run in place, each kernel
+// of RGB24::detail the CPU can run, and the dispatched conversion with and
+// without the band-parallel pool, on one frame converted over and over. The
+// old loop overwrote input it had not read yet, so it is timed (with the
+// copy that restores its input, timed alone as memcpy) but not compared;
+// every other result is checked against the scalar loop.
+//
+// usage: rgb24_bench [width] [height] [iterations]
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "rgb24.hpp"
+
+// The capture path's sort_rgb24 as it was.
+static void OldLoop(uint8_t *ptr, size_t pixels) {
+  uint8_t *dstR = ptr;
+  uint8_t *dstG = ptr + pixels;
+  uint8_t *dstB = ptr + pixels * 2;
+  const uint8_t *src = ptr;
+  const uint8_t *end = ptr + pixels * 3;
+  while (src != end) {
+    *dstB++ = *src++;
+    *dstG++ = *src++;
+    *dstR++ = *src++;
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t width = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 3096;
+  const size_t height = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2080;
+  const int iterations = argc > 3 ? std::atoi(argv[3]) : 100;
+  const size_t pixels = width * height;
+  if (pixels == 0 || iterations <= 0) {
+    spdlog::critical("Nothing to convert");
+    return 1;
+  }
+
+  std::vector<uint8_t> src(pixels * 3), dst(pixels * 3), ref(pixels * 3);
+  uint32_t seed = 1;
+  for (auto &v : src) {
+    seed = seed * 1664525u + 1013904223u;
+    v = uint8_t(seed >> 24);
+  }
+  RGB24::detail::Scalar(ref.data(), ref.data() + pixels,
+                        ref.data() + 2 * pixels, src.data(), pixels);
+  spdlog::info("{}x{} RGB24 ({} MB), {} iterations, {} threads in the pool",
+               width, height, pixels * 3 / 1024 / 1024, iterations,
+               RGB24::Pool().size());
+
+  bool ok = true;
+  const auto run = [&](const std::string &name, bool check,
+                       const std::function<void()> &fn) {
+    fn();  // page in and warm up
+    const auto t = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) fn();
+    const double s = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - t)
+                         .count() /
+                     iterations;
+    const bool same = !check || dst == ref;
+    ok &= same;
+    spdlog::info("{:>16}: {:8.3f} ms/frame {:8.1f} MB/s {:7.0f} fps{}", name,
+                 s * 1e3, pixels * 3 / s / 1024 / 1024, 1 / s,
+                 same ? "" : "  WRONG");
+  };
+  const auto kernel = [&](void (*k)(uint8_t *, uint8_t *, uint8_t *,
+                                    const uint8_t *, size_t)) {
+    return [&, k] {
+      k(dst.data(), dst.data() + pixels, dst.data() + 2 * pixels, src.data(),
+        pixels);
+    };
+  };
+
+  run("old (in place)", false, [&] {
+    std::memcpy(dst.data(), src.data(), dst.size());
+    OldLoop(dst.data(), pixels);
+  });
+  run("memcpy", false,
+      [&] { std::memcpy(dst.data(), src.data(), dst.size()); });
+  run("scalar", true, kernel(RGB24::detail::Scalar));
+#ifdef CPU_X86
+  if (CpuFeatures::SSSE3()) run("ssse3", true, kernel(RGB24::detail::SSSE3));
+  if (CpuFeatures::AVX2()) run("avx2", true, kernel(RGB24::detail::AVX2));
+  if (CpuFeatures::AVX512BW())
+    run("avx512", true, kernel(RGB24::detail::AVX512));
+#endif
+#ifdef CPU_NEON
+  run("neon", true, kernel(RGB24::detail::NEON));
+#endif
+  WorkerPool single(0);
+  run("dispatched", true, [&] {
+    RGB24::ToPlanar(dst.data(), src.data(), width, height, single);
+  });
+  run("banded", true,
+      [&] { RGB24::ToPlanar(dst.data(), src.data(), width, height); });
+  return ok ? 0 : 1;
+}
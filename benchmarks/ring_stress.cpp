@@ -0,0 +1,142 @@
+// Stress benchmark for the streaming ring.
+//
+// The producer and a lossless consumer run on separate cores and hammer the
+// ring as fast as they can, while a "preview" thread reads the latest frame.
+// Every frame is stamped with its sequence number at both ends; the readers
+// check the stamps, so any torn or reordered frame is reported.
+//
+// usage: ring_stress [frame_bytes] [slots] [seconds] [drop|overwrite|block]
+#include <pthread.h>
+#include <sched.h>
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "circular_buffer.hpp"
+
+static void pin_to_cpu(unsigned cpu) {
+  unsigned n = std::thread::hardware_concurrency();
+  if (n == 0) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu % n, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    spdlog::warn("Could not pin thread to cpu {}", cpu % n);
+}
+
+int main(int argc, char **argv) {
+  const size_t frame_bytes = argc > 1 ? std::strtoull(argv[1], nullptr, 10)
+                                      : 320 * 240 * 2;
+  const size_t slots = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 256;
+  const double seconds = argc > 3 ? std::strtod(argv[3], nullptr) : 5.0;
+  const std::string mode = argc > 4 ? argv[4] : "drop";
+  OverflowPolicy policy = OverflowPolicy::DropNewest;
+  if (mode == "overwrite") policy = OverflowPolicy::OverwriteOldest;
+  if (mode == "block") policy = OverflowPolicy::BlockWithTimeout;
+  if (frame_bytes < 2 * sizeof(uint64_t) || slots == 0) {
+    spdlog::critical("frame_bytes must be >= 16 and slots > 0");
+    return 1;
+  }
+
+  Circular_Buffer<uint8_t> ring(slots, frame_bytes);
+  std::atomic_bool stop = false;
+  std::atomic_bool producer_done = false;
+  uint64_t produced = 0, full_stalls = 0;
+  uint64_t consumed = 0, torn = 0, out_of_order = 0, gaps = 0;
+  uint64_t previewed = 0, preview_torn = 0;
+  const int lossless = ring.add_reader(ReaderPolicy::Lossless);
+  const int latest = ring.add_reader(ReaderPolicy::Latest);
+
+  std::thread producer([&] {
+    pin_to_cpu(0);
+    uint64_t seq = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+      uint8_t *slot = ring.claim(policy, 10);
+      // A failed claim is retried with the same frame: a stall, not a drop.
+      if (slot == nullptr) {
+        full_stalls++;
+        continue;
+      }
+      std::memcpy(slot, &seq, sizeof(seq));
+      std::memcpy(slot + frame_bytes - sizeof(seq), &seq, sizeof(seq));
+      ring.commit();
+      seq++;
+    }
+    produced = seq;
+    producer_done = true;
+  });
+
+  std::thread consumer([&] {
+    pin_to_cpu(1);
+    uint64_t expected = 0;
+    while (true) {
+      uint8_t *slot = ring.acquire(lossless);
+      if (slot == nullptr) {
+        if (producer_done.load(std::memory_order_acquire) &&
+            ring.acquire(lossless) == nullptr)
+          break;
+        continue;
+      }
+      uint64_t first, last;
+      std::memcpy(&first, slot, sizeof(first));
+      std::memcpy(&last, slot + frame_bytes - sizeof(last), sizeof(last));
+      if (first != last) torn++;
+      if (first < expected) out_of_order++;
+      if (first > expected) gaps += first - expected;
+      expected = first + 1;
+      ring.release(lossless);
+      consumed++;
+    }
+  });
+
+  std::thread preview([&] {
+    pin_to_cpu(2);
+    while (!stop.load(std::memory_order_relaxed)) {
+      uint8_t *slot = ring.acquire(latest);
+      if (slot == nullptr) continue;
+      uint64_t first, last;
+      std::memcpy(&first, slot, sizeof(first));
+      std::memcpy(&last, slot + frame_bytes - sizeof(last), sizeof(last));
+      if (first != last) preview_torn++;
+      ring.release(latest);
+      previewed++;
+    }
+  });
+
+  // The ring warns every time it runs full, which is the normal state here.
+  spdlog::set_level(spdlog::level::err);
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  producer.join();
+  consumer.join();
+  preview.join();
+  spdlog::set_level(spdlog::level::info);
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  spdlog::info("frame {} bytes, {} slots, {:.2f} s", frame_bytes, slots,
+               elapsed);
+  spdlog::info("produced {} consumed {} full stalls {}", produced, consumed,
+               full_stalls);
+  spdlog::info("throughput {:.0f} fps, {:.1f} MB/s", consumed / elapsed,
+               consumed * frame_bytes / elapsed / 1024 / 1024);
+  const RingCounters &c = ring.get_counters();
+  spdlog::info("policy {}: dropped {} overwritten {} blocked {} ({} timed out)",
+               mode, c.dropped.load(), c.overwritten.load(), c.blocked.load(),
+               c.block_timeouts.load());
+  spdlog::info("torn frames {} out of order {} gaps {}", torn, out_of_order,
+               gaps);
+  spdlog::info("preview saw {} frames, skipped {}, torn {}", previewed,
+               ring.skipped(latest), preview_torn);
+  return (torn == 0 && out_of_order == 0 && preview_torn == 0 &&
+          gaps == c.overwritten.load() && produced == consumed + gaps)
+             ? 0
+             : 1;
+}
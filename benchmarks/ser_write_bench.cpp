@@ -0,0 +1,140 @@
+// Throughput benchmark for the SER writer backends.
+//
+// Feeds a synthetic camera stream at a fixed data rate (0 = as fast as
+// possible) into each backend in turn and reports the rate it sustained, how
+// far it fell behind the stream, and the CPU time of the writing thread. Both
+// backends get the same frames and timestamps, and the resulting files are
+// compared byte for byte.
+//
+// usage: ser_write_bench [dir] [frame_bytes] [MB/s] [seconds] [keep]
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SERDirectWriter.hpp"
+#include "frame_slab.hpp"
+
+struct Result {
+  double seconds = 0;  // until close() returned
+  double fsync_seconds = 0;
+  double cpu_seconds = 0;
+  double max_behind_ms = 0;
+  uint64_t frames = 0;
+};
+
+static double thread_cpu_seconds() {
+  rusage ru;
+  getrusage(RUSAGE_THREAD, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+         (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static Result run(SER::WriterBackend backend, const std::string &fn,
+                  FrameSlab &frames, size_t width, size_t height,
+                  double rate, uint64_t nframes) {
+  using clock = std::chrono::steady_clock;
+  Result r;
+  const size_t frame_bytes = width * height * 2;
+  const double period = rate > 0 ? frame_bytes / rate : 0;
+  const double cpu0 = thread_cpu_seconds();
+  const auto start = clock::now();
+  {
+    auto writer = SER::MakeSERWriter(backend, fn);
+    writer->prepare_header({height, width}, {"bench", "bench", "bench"}, 2);
+    for (uint64_t i = 0; i < nframes && writer->isOpen(); i++) {
+      const auto due = start + std::chrono::duration_cast<clock::duration>(
+                                   std::chrono::duration<double>(i * period));
+      auto now = clock::now();
+      if (now < due)
+        std::this_thread::sleep_until(due);
+      else
+        r.max_behind_ms = std::max(
+            r.max_behind_ms,
+            std::chrono::duration<double, std::milli>(now - due).count());
+      // Fixed timestamps so both files come out identical.
+      writer->write_frame(frames.slot(i % 16),
+                          1700000000000000000ull + i * 1000000ull);
+      r.frames++;
+    }
+  }
+  r.seconds = std::chrono::duration<double>(clock::now() - start).count();
+  r.cpu_seconds = thread_cpu_seconds() - cpu0;
+  int fd = open(fn.c_str(), O_RDONLY);
+  auto s = clock::now();
+  fsync(fd);
+  close(fd);
+  r.fsync_seconds = std::chrono::duration<double>(clock::now() - s).count();
+  return r;
+}
+
+static bool identical(const std::string &a, const std::string &b) {
+  std::ifstream fa(a, std::ios::binary), fb(b, std::ios::binary);
+  std::vector<char> ba(1 << 20), bb(1 << 20);
+  while (fa && fb) {
+    fa.read(ba.data(), ba.size());
+    fb.read(bb.data(), bb.size());
+    if (fa.gcount() != fb.gcount() ||
+        std::memcmp(ba.data(), bb.data(), fa.gcount()) != 0)
+      return false;
+  }
+  return fa.eof() && fb.eof();
+}
+
+int main(int argc, char **argv) {
+  const std::string dir = argc > 1 ? argv[1] : ".";
+  const size_t frame_bytes = argc > 2 ? std::strtoull(argv[2], nullptr, 10)
+                                      : 2048 * 1024 * 2;
+  const double mbps = argc > 3 ? std::strtod(argv[3], nullptr) : 1024;
+  const double seconds = argc > 4 ? std::strtod(argv[4], nullptr) : 5;
+  const bool keep = argc > 5 && std::string(argv[5]) == "keep";
+
+  // 16-bit mono, 2048 pixels wide where the size allows it.
+  const size_t width = frame_bytes % 4096 == 0 ? 2048 : frame_bytes / 2;
+  const size_t height = frame_bytes / 2 / width;
+  if (width * height * 2 != frame_bytes || frame_bytes == 0) {
+    spdlog::critical("frame_bytes must be a positive multiple of 2");
+    return 1;
+  }
+  const double rate = mbps * 1024 * 1024;
+  const uint64_t nframes =
+      rate > 0 ? uint64_t(seconds * rate / frame_bytes) : 1000;
+
+  FrameSlab frames(16, frame_bytes);
+  for (size_t i = 0; i < 16; i++) {
+    uint8_t *p = frames.slot(i);
+    for (size_t b = 0; b < frame_bytes; b++) p[b] = uint8_t(b * 31 + i * 7);
+  }
+
+  spdlog::info("{} frames of {} bytes ({}x{} 16-bit) at {} MB/s into {}",
+               nframes, frame_bytes, width, height,
+               rate > 0 ? std::to_string(int(mbps)) : "max", dir);
+  const std::string names[] = {"stream", "direct"};
+  const std::string files[] = {dir + "/ser_bench_stream.ser",
+                               dir + "/ser_bench_direct.ser"};
+  const SER::WriterBackend backends[] = {SER::WriterBackend::Stream,
+                                         SER::WriterBackend::Direct};
+  for (int b = 0; b < 2; b++) {
+    Result r = run(backends[b], files[b], frames, width, height, rate,
+                   nframes);
+    const double mb = double(r.frames) * frame_bytes / 1024 / 1024;
+    spdlog::info(
+        "{:>6}: {:.0f} MB/s ({:.0f} MB/s incl. fsync), writer CPU {:.2f} s "
+        "({:.0f}%), fell behind by up to {:.1f} ms",
+        names[b], mb / r.seconds, mb / (r.seconds + r.fsync_seconds),
+        r.cpu_seconds, 100 * r.cpu_seconds / r.seconds, r.max_behind_ms);
+  }
+  const bool same = identical(files[0], files[1]);
+  spdlog::info("files are {}", same ? "byte-identical" : "DIFFERENT");
+  if (!keep)
+    for (auto &f : files) unlink(f.c_str());
+  return same ? 0 : 1;
+}
@@ -0,0 +1,254 @@
+#ifndef __BITPACK__
+#define __BITPACK__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "cpu_features.hpp"
+#ifdef CPU_X86
+#include <immintrin.h>
+#elif defined(CPU_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace SER {
+
+//-------------------------------------------------------------------
+// Bit packing of 16-bit samples that use fewer bits, e.g. a 12-bit ADC whose
+// data the camera puts in the top of a 16-bit word (shift 4).
+//
+// Each sample is stored as (v >> shift) in bits bits, LSB first: sample 0
+// takes bits 0..bits-1 of the stream, sample 1 the next bits, and so on.
+// Even widths from 8 to 14 bits, 10 and 12 in particular, run eight samples
+// at a time with SSSE3 (picked at run time) or NEON; anything else and the
+// tail of a buffer go through the scalar loop.
+//-------------------------------------------------------------------
+namespace BitPack {
+
+inline size_t PackedBytes(size_t samples, int bits) {
+  return (samples * bits + 7) / 8;
+}
+// Narrowest (shift, bits) that holds every sample whose bits are in or_all.
+inline void DepthOf(uint16_t or_all, int &shift, int &bits) {
+  if (or_all == 0) {
+    shift = 0;
+    bits = 1;
+    return;
+  }
+  shift = __builtin_ctz(or_all);
+  bits = 32 - __builtin_clz(or_all) - shift;
+}
+// True if every sample whose bits are in or_all survives (shift, bits).
+inline bool Fits(uint16_t or_all, int shift, int bits) {
+  const uint32_t keep = ((1u << bits) - 1) << shift;
+  return (or_all & ~keep) == 0;
+}
+// Bitwise OR of n samples, for DepthOf().
+inline uint16_t OrAll(const uint16_t *in, size_t n) {
+  uint16_t acc = 0;
+  for (size_t i = 0; i < n; i++) acc |= in[i];
+  return acc;
+}
+
+namespace detail {
+
+inline uint16_t PackScalar(const uint16_t *in, size_t n, int shift, int bits,
+                           uint8_t *out) {
+  const uint32_t mask = (1u << bits) - 1;
+  uint16_t acc_or = 0;
+  uint64_t acc = 0;
+  int nbits = 0;
+  for (size_t i = 0; i < n; i++) {
+    acc_or |= in[i];
+    acc |= uint64_t((in[i] >> shift) & mask) << nbits;
+    nbits += bits;
+    while (nbits >= 8) {
+      *out++ = uint8_t(acc);
+      acc >>= 8;
+      nbits -= 8;
+    }
+  }
+  if (nbits > 0) *out = uint8_t(acc);
+  return acc_or;
+}
+inline void UnpackScalar(const uint8_t *in, size_t n, int shift, int bits,
+                         uint16_t *out) {
+  const uint32_t mask = (1u << bits) - 1;
+  uint64_t acc = 0;
+  int nbits = 0;
+  for (size_t i = 0; i < n; i++) {
+    while (nbits < bits) {
+      acc |= uint64_t(*in++) << nbits;
+      nbits += 8;
+    }
+    out[i] = uint16_t((acc & mask) << shift);
+    acc >>= bits;
+    nbits -= bits;
+  }
+}
+inline bool Vectorised(int bits) {
+  return bits >= 8 && bits <= 14 && bits % 2 == 0;
+}
+// Samples the vector loop can do without touching bytes past the packed end:
+// it moves 16 bytes per 8 samples.
+inline size_t VectorSamples(size_t n, int bits) {
+  const size_t bytes = n * bits / 8;
+  if (bytes < 16) return 0;
+  return ((bytes - 16) / bits + 1) * 8;  // groups of 8 samples = bits bytes
+}
+
+// Eight samples, in two 64-bit lanes of four: first pairs in each 32-bit
+// lane become one 2*bits value, then pairs of those one 4*bits value, which
+// is bits/2 whole bytes; a byte shuffle then closes the gap between lanes.
+#ifdef CPU_X86
+__attribute__((target("ssse3"))) inline uint16_t PackSSSE3(
+    const uint16_t *in, size_t n, int shift, int bits, uint8_t *out) {
+  const __m128i s = _mm_cvtsi32_si128(shift);
+  const __m128i s1 = _mm_cvtsi32_si128(16 - bits);
+  const __m128i s2 = _mm_cvtsi32_si128(32 - 2 * bits);
+  const __m128i m1 = _mm_set1_epi32((1 << bits) - 1);
+  const __m128i m2 = _mm_set1_epi64x((1ll << (2 * bits)) - 1);
+  alignas(16) uint8_t pick[16];
+  for (int i = 0, h = bits / 2; i < 16; i++)
+    pick[i] = uint8_t(i < h ? i : i < 2 * h ? 8 + i - h : 0x80);
+  const __m128i shuf = _mm_load_si128(reinterpret_cast<const __m128i *>(pick));
+  __m128i acc_or = _mm_setzero_si128();
+  const size_t v = VectorSamples(n, bits);
+  for (size_t i = 0; i < v; i += 8) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    acc_or = _mm_or_si128(acc_or, x);
+    x = _mm_srl_epi16(x, s);
+    x = _mm_or_si128(_mm_and_si128(x, m1),
+                     _mm_andnot_si128(m1, _mm_srl_epi32(x, s1)));
+    x = _mm_or_si128(_mm_and_si128(x, m2),
+                     _mm_andnot_si128(m2, _mm_srl_epi64(x, s2)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i / 8 * bits),
+                     _mm_shuffle_epi8(x, shuf));
+  }
+  acc_or = _mm_or_si128(acc_or, _mm_srli_si128(acc_or, 8));
+  acc_or = _mm_or_si128(acc_or, _mm_srli_si128(acc_or, 4));
+  acc_or = _mm_or_si128(acc_or, _mm_srli_si128(acc_or, 2));
+  return uint16_t(_mm_cvtsi128_si32(acc_or)) |
+         PackScalar(in + v, n - v, shift, bits, out + v / 8 * bits);
+}
+__attribute__((target("ssse3"))) inline void UnpackSSSE3(
+    const uint8_t *in, size_t n, int shift, int bits, uint16_t *out) {
+  const __m128i s = _mm_cvtsi32_si128(shift);
+  const __m128i s1 = _mm_cvtsi32_si128(16 - bits);
+  const __m128i s2 = _mm_cvtsi32_si128(32 - 2 * bits);
+  const __m128i m1 = _mm_set1_epi32((1 << bits) - 1);
+  const __m128i m2 = _mm_set1_epi64x((1ll << (2 * bits)) - 1);
+  alignas(16) uint8_t spread[16];
+  for (int i = 0, h = bits / 2; i < 16; i++)
+    spread[i] = uint8_t(i % 8 < h ? i / 8 * h + i % 8 : 0x80);
+  const __m128i shuf =
+      _mm_load_si128(reinterpret_cast<const __m128i *>(spread));
+  const size_t v = VectorSamples(n, bits);
+  for (size_t i = 0; i < v; i += 8) {
+    __m128i x = _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i / 8 * bits)),
+        shuf);
+    x = _mm_or_si128(_mm_and_si128(x, m2), _mm_and_si128(_mm_slli_epi64(m2, 32),
+                                                         _mm_sll_epi64(x, s2)));
+    x = _mm_or_si128(_mm_and_si128(x, m1), _mm_and_si128(_mm_slli_epi32(m1, 16),
+                                                         _mm_sll_epi32(x, s1)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_sll_epi16(x, s));
+  }
+  UnpackScalar(in + v / 8 * bits, n - v, shift, bits, out + v);
+}
+#endif
+
+#ifdef CPU_NEON
+inline uint16_t PackNEON(const uint16_t *in, size_t n, int shift, int bits,
+                         uint8_t *out) {
+  const int16x8_t s = vdupq_n_s16(int16_t(-shift));
+  const int32x4_t s1 = vdupq_n_s32(-(16 - bits));
+  const int64x2_t s2 = vdupq_n_s64(-(32 - 2 * bits));
+  const uint32x4_t m1 = vdupq_n_u32((1u << bits) - 1);
+  const uint64x2_t m2 = vdupq_n_u64((1ull << (2 * bits)) - 1);
+  uint8_t pick[16];
+  for (int i = 0, h = bits / 2; i < 16; i++)
+    pick[i] = uint8_t(i < h ? i : i < 2 * h ? 8 + i - h : 0xff);
+  const uint8x16_t shuf = vld1q_u8(pick);
+  uint16x8_t acc_or = vdupq_n_u16(0);
+  const size_t v = VectorSamples(n, bits);
+  for (size_t i = 0; i < v; i += 8) {
+    uint16x8_t x = vld1q_u16(in + i);
+    acc_or = vorrq_u16(acc_or, x);
+    uint32x4_t y = vreinterpretq_u32_u16(vshlq_u16(x, s));
+    y = vorrq_u32(vandq_u32(y, m1), vbicq_u32(vshlq_u32(y, s1), m1));
+    uint64x2_t z = vreinterpretq_u64_u32(y);
+    z = vorrq_u64(vandq_u64(z, m2), vbicq_u64(vshlq_u64(z, s2), m2));
+    vst1q_u8(out + i / 8 * bits, vqtbl1q_u8(vreinterpretq_u8_u64(z), shuf));
+  }
+  uint16_t lanes[8], o = 0;
+  vst1q_u16(lanes, acc_or);
+  for (uint16_t l : lanes) o |= l;
+  return o | PackScalar(in + v, n - v, shift, bits, out + v / 8 * bits);
+}
+inline void UnpackNEON(const uint8_t *in, size_t n, int shift, int bits,
+                       uint16_t *out) {
+  const int16x8_t s = vdupq_n_s16(int16_t(shift));
+  const int32x4_t s1 = vdupq_n_s32(16 - bits);
+  const int64x2_t s2 = vdupq_n_s64(32 - 2 * bits);
+  const uint32x4_t m1 = vdupq_n_u32((1u << bits) - 1);
+  const uint64x2_t m2 = vdupq_n_u64((1ull << (2 * bits)) - 1);
+  uint8_t spread[16];
+  for (int i = 0, h = bits / 2; i < 16; i++)
+    spread[i] = uint8_t(i % 8 < h ? i / 8 * h + i % 8 : 0xff);
+  const uint8x16_t shuf = vld1q_u8(spread);
+  const size_t v = VectorSamples(n, bits);
+  for (size_t i = 0; i < v; i += 8) {
+    uint64x2_t z = vreinterpretq_u64_u8(
+        vqtbl1q_u8(vld1q_u8(in + i / 8 * bits), shuf));
+    z = vorrq_u64(vandq_u64(z, m2),
+                  vandq_u64(vshlq_n_u64(m2, 32), vshlq_u64(z, s2)));
+    uint32x4_t y = vreinterpretq_u32_u64(z);
+    y = vorrq_u32(vandq_u32(y, m1),
+                  vandq_u32(vshlq_n_u32(m1, 16), vshlq_u32(y, s1)));
+    vst1q_u16(out + i, vshlq_u16(vreinterpretq_u16_u32(y), s));
+  }
+  UnpackScalar(in + v / 8 * bits, n - v, shift, bits, out + v);
+}
+#endif
+
+}  // namespace detail
+
+// Packs n samples into PackedBytes(n, bits) bytes at out. Returns the OR of
+// all samples: if !Fits(result, shift, bits), bits were lost and the caller
+// has to pack again with a wider (shift, bits).
+inline uint16_t Pack(const uint16_t *in, size_t n, int shift, int bits,
+                     uint8_t *out) {
+  if (detail::Vectorised(bits)) {
+#ifdef CPU_X86
+    if (CpuFeatures::SSSE3())
+      return detail::PackSSSE3(in, n, shift, bits, out);
+#endif
+#ifdef CPU_NEON
+    return detail::PackNEON(in, n, shift, bits, out);
+#endif
+  }
+  return detail::PackScalar(in, n, shift, bits, out);
+}
+// Reverse of Pack(): n samples from PackedBytes(n, bits) bytes at in.
+inline void Unpack(const uint8_t *in, size_t n, int shift, int bits,
+                   uint16_t *out) {
+  if (detail::Vectorised(bits)) {
+#ifdef CPU_X86
+    if (CpuFeatures::SSSE3())
+      return detail::UnpackSSSE3(in, n, shift, bits, out);
+#endif
+#ifdef CPU_NEON
+    return detail::UnpackNEON(in, n, shift, bits, out);
+#endif
+  }
+  detail::UnpackScalar(in, n, shift, bits, out);
+}
+
+}  // namespace BitPack
+}  // namespace SER
+
+#endif
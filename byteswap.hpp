@@ -0,0 +1,107 @@
+#ifndef __BYTESWAP__
+#define __BYTESWAP__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <cstddef>
+#include <cstdint>
+
+#include "cpu_features.hpp"
+#ifdef CPU_X86
+#include <immintrin.h>
+#elif defined(CPU_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace SER {
+
+//-------------------------------------------------------------------
+// Byte order reversal of 16-bit samples, for SER files whose samples are
+// not in host order. AVX2 or SSSE3 (picked at run time) or NEON do 32 or 16
+// bytes per step with a byte shuffle; the tail and other machines take the
+// scalar loop. dst may be src, to swap in place.
+//-------------------------------------------------------------------
+namespace ByteSwap {
+
+namespace detail {
+
+inline void Scalar(uint16_t *dst, const uint16_t *src, size_t n) {
+  for (size_t i = 0; i < n; i++) dst[i] = __builtin_bswap16(src[i]);
+}
+
+#ifdef CPU_X86
+__attribute__((target("avx2"))) inline void AVX2(uint16_t *dst,
+                                                 const uint16_t *src,
+                                                 size_t n) {
+  const __m256i shuf =
+      _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                       1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i a =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    const __m256i b =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 16));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                        _mm256_shuffle_epi8(a, shuf));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 16),
+                        _mm256_shuffle_epi8(b, shuf));
+  }
+  for (; i + 16 <= n; i += 16)
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(dst + i),
+        _mm256_shuffle_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)),
+            shuf));
+  Scalar(dst + i, src + i, n - i);
+}
+__attribute__((target("ssse3"))) inline void SSSE3(uint16_t *dst,
+                                                   const uint16_t *src,
+                                                   size_t n) {
+  const __m128i shuf =
+      _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(dst + i),
+        _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)),
+            shuf));
+  Scalar(dst + i, src + i, n - i);
+}
+#endif
+
+#ifdef CPU_NEON
+inline void NEON(uint16_t *dst, const uint16_t *src, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    vst1q_u16(dst + i, vreinterpretq_u16_u8(vrev16q_u8(
+                           vreinterpretq_u8_u16(vld1q_u16(src + i)))));
+  Scalar(dst + i, src + i, n - i);
+}
+#endif
+
+}  // namespace detail
+
+// dst[i] = bswap(src[i]) for n samples; dst == src is fine, other overlap
+// is not.
+inline void Swap16(uint16_t *dst, const uint16_t *src, size_t n) {
+#ifdef CPU_X86
+  if (CpuFeatures::AVX2()) return detail::AVX2(dst, src, n);
+  if (CpuFeatures::SSSE3()) return detail::SSSE3(dst, src, n);
+#endif
+#ifdef CPU_NEON
+  return detail::NEON(dst, src, n);
+#endif
+  detail::Scalar(dst, src, n);
+}
+// The same on bytes bytes (even) of raw frame data.
+inline void Swap16(uint8_t *dst, const uint8_t *src, size_t bytes) {
+  Swap16(reinterpret_cast<uint16_t *>(dst),
+         reinterpret_cast<const uint16_t *>(src), bytes / 2);
+}
+
+}  // namespace ByteSwap
+}  // namespace SER
+
+#endif
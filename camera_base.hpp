@@ -41,7 +41,10 @@
 #include "SERProcessor.hpp"
 #include "asi_helpers.hpp"
 #include "circular_buffer.hpp"
+#include "frame_stage.hpp"
 #include "hello_imgui/hello_imgui.h"
+#include "rgb24.hpp"
+#include "thread_profile.hpp"
 #include "timer.hpp"
 #include "Plots.hpp"
 #include "SERProcessor.hpp"
@@ -96,8 +99,57 @@ typedef struct _STILL_STREAMING_STRUCT {
   size_t byte_channel = 1;
   SER::BAYER format;
   std::array<size_t, 3> dim;
+  // Bits the ADC delivers, at the top of 16-bit samples; 0 if unknown.
+  int adc_bits = 0;
 
-  bool do_record = false;
+  // What the capture thread does when the recorder falls a full ring behind.
+  std::atomic<OverflowPolicy> overflow_policy = OverflowPolicy::DropNewest;
+  std::atomic_uint32_t block_timeout_ms = 100;
+  // Frames RGB24 conversion may fall behind the camera by, on a thread of
+  // its own (FrameStage); 0 converts on the capture thread.
+  size_t convert_slots = 8;
+
+  // How the recorder writes SER files; Direct bypasses the page cache,
+  // Compressed and Packed write the smaller .serz (tools/serz_to_ser).
+  std::atomic<SER::WriterBackend> writer_backend = SER::WriterBackend::Stream;
+  // Byte order of 16-bit samples in the SER files written.
+  std::atomic<SER::SERByteOrder> byte_order =
+      SER::SERByteOrder::TrueLittleEndian;
+  // Most the recorder hands the writer in one batch; at least one frame.
+  std::atomic<size_t> max_batch_bytes = 64 * 1024 * 1024;
+
+  // Further directories, after selectedFilename, a recording is striped
+  // across, and how; each SER file is continued in a new one at rotate_mb
+  // (0 = never). The GUI edits the list while a recorder may be starting,
+  // so it is only read and written through Stripes() and SetStripes().
+  std::vector<std::string> stripeDirectories;
+  std::atomic<SER::StripeMode> stripe_mode = SER::StripeMode::RoundRobin;
+  size_t rotate_mb = 0;
+
+  // Disk-backed overflow tier used by the recorder; 0 MB disables it. The
+  // ring fraction above which frames start to spill is spill_high_water.
+  // Like the stripes, the directory is only reached through SpillDirectory()
+  // and SetSpillDirectory().
+  std::string spillDirectory = "/var/tmp";
+  size_t spill_mb = 0;
+  float spill_high_water = 0.75;
+
+  // Retroactive recording: a new recording first writes the frames captured
+  // in the last pretrigger_s seconds, or the last pretrigger_frames frames if
+  // that is set, as far as the ring still holds them. 0 disables it.
+  std::atomic<float> pretrigger_s = 0;
+  std::atomic_uint32_t pretrigger_frames = 0;
+  // Automatic trigger: start recording when the mean brightness of the
+  // preview jumps by trigger_jump percent, and stop trigger_hold_s after the
+  // last jump.
+  std::atomic_bool auto_trigger = false;
+  std::atomic<float> trigger_jump = 20;
+  std::atomic<float> trigger_hold_s = 5;
+  std::atomic<uint64_t> trigger_until_ns = 0;
+
+  // Set by the GUI and the automatic trigger, cleared by the capture and
+  // recorder threads.
+  std::atomic_bool do_record = false;
   std::atomic_bool is_recording = false;
   std::atomic_bool is_active = false;
   std::string selectedFilename =
@@ -105,6 +157,24 @@ typedef struct _STILL_STREAMING_STRUCT {
   std::atomic_uint32_t nCaptured;
   size_t fSpace = 0;
   size_t aSpace = 0;
+
+  std::mutex dirMutex;
+  std::vector<std::string> Stripes() {
+    std::lock_guard<std::mutex> lock(dirMutex);
+    return stripeDirectories;
+  }
+  void SetStripes(std::vector<std::string> dirs) {
+    std::lock_guard<std::mutex> lock(dirMutex);
+    stripeDirectories = std::move(dirs);
+  }
+  std::string SpillDirectory() {
+    std::lock_guard<std::mutex> lock(dirMutex);
+    return spillDirectory;
+  }
+  void SetSpillDirectory(std::string dir) {
+    std::lock_guard<std::mutex> lock(dirMutex);
+    spillDirectory = std::move(dir);
+  }
 } STILL_STREAMING_STRUCT;
 
 typedef struct _ASI_CONTROL_CAPS_CAST {
@@ -133,18 +203,101 @@ class CameraBase {
     mVendorName = _vendor;
   }
 
-  ~CameraBase() {  }
+  virtual ~CameraBase() {  }
 
  public:
   std::string getVendorName() { return mVendorName; };
   std::string getDefaultName() { return mCameraName; };
   std::string getDevName() { return mCameraName; }
 
+  // What the GUI and the acquisition threads drive a camera with, so a
+  // source that is not a ZWO camera (e.g. SER playback) can stand in for
+  // one. Captures run on their own thread and fill stillFrame or the
+  // streamingFrames ring.
+  virtual bool Connect() = 0;
+  virtual bool Disconnect() = 0;
+  virtual bool CreateControls() = 0;
+  virtual bool RetrieveControls(bool is_create = false) = 0;
+  virtual bool UpdateControls() = 0;
+  virtual void AbortExposure() = 0;
+  virtual void DoCaptureHelper() = 0;
+  virtual void DoVCaptureHelper(size_t _size = 1 * 1024) = 0;
+
+  // Frame geometry in ZWO terms, from mCameraInfo and m_frame; a source
+  // that fills those in gets them for free.
+  virtual bool SetCCDBin(uint8_t bin) {
+    if (bin < 1) {
+      spdlog::critical("Invalid bin request : {}", bin);
+      return false;
+    }
+    for (size_t i = 0; i < 8; i++)
+      if (bin == mCameraInfo.SupportedBins[i]) {
+        m_frame[0].Bin = bin;
+        m_frame[1].Bin = bin;
+        m_frame[0].BinnedValue = m_frame[0].CurrentValue / bin;
+        m_frame[1].BinnedValue = m_frame[1].CurrentValue / bin;
+        m_frame[0].BinndedAxisOffset = m_frame[0].AxisOffset / bin;
+        m_frame[1].BinndedAxisOffset = m_frame[1].AxisOffset / bin;
+        spdlog::debug("Bin Set to: {}", bin);
+        spdlog::debug("Bined Resolution to: {} x {}", m_frame[0].BinnedValue,
+                      m_frame[1].BinnedValue);
+        spdlog::debug("Bined Resolution to: {} x {}",
+                      m_frame[0].BinndedAxisOffset,
+                      m_frame[1].BinndedAxisOffset);
+        return true;
+      }
+    spdlog::critical("Invalid bin request : {}", bin);
 
+    return false;
+  }
+  std::tuple<ASIHelpers::PIXEL_FORMAT, std::array<uint16_t, 3>, size_t>
+  getImageFormat(ASI_IMG_TYPE type) {
+    ASIHelpers::PIXEL_FORMAT pixel = ASIHelpers::pixelFormat(
+        type, mCameraInfo.BayerPattern, mCameraInfo.IsColorCam);
+    uint8_t dim = 3;
+    if (pixel == ASIHelpers::PIXEL_FORMAT::MONO8 ||
+        pixel == ASIHelpers::PIXEL_FORMAT::MONO16)
+      dim = 1;
+    size_t sz = 1;
+    if (type == ASI_IMG_RAW16) sz = 2;
+
+    return std::make_tuple(
+        pixel,
+        std::array<uint16_t, 3>{static_cast<uint16_t>(m_frame[0].BinnedValue),
+                                static_cast<uint16_t>(m_frame[1].BinnedValue),
+                                dim},
+        sz);
+  }
+  // The stage that converts RGB24 video for the consumers, if the format
+  // is RGB24 and streamingFrames asks for one; otherwise the capture thread
+  // converts.
+  std::unique_ptr<FrameStage> MakeConvertStage(
+      std::tuple<ASIHelpers::PIXEL_FORMAT, std::array<uint16_t, 3>, size_t>
+          imgFormat,
+      size_t nTotalBytes) {
+    if (streamingFrames.currentFormat != ASI_IMG_RGB24 ||
+        streamingFrames.convert_slots == 0)
+      return nullptr;
+    const size_t w = std::get<1>(imgFormat)[1], h = std::get<1>(imgFormat)[0];
+    return std::make_unique<FrameStage>(
+        streamingFrames.buffer, nTotalBytes, streamingFrames.convert_slots,
+        [w, h](uint8_t *dst, const uint8_t *src) {
+          RGB24::ToPlanar(dst, src, w, h);
+        },
+        streamingFrames.overflow_policy, streamingFrames.block_timeout_ms);
+  }
 
   STILL_IMAGE_STRUCT stillFrame;
   STILL_STREAMING_STRUCT streamingFrames;
 
+  // This camera's slot in processStat, taken the first time it is asked
+  // for; the name is unique and set by then.
+  cameraStat_t &Stats() {
+    cameraStat_t *s = m_stats;
+    if (s == nullptr) m_stats = s = &processStat.camera(mCameraName);
+    return *s;
+  }
+
   STILL_IMAGE_STRUCT *getImageFramePtr() { return &stillFrame; };
   STILL_STREAMING_STRUCT *getStreamingFramePtr() { return &streamingFrames; };
   std::string mVendorName;
@@ -158,6 +311,7 @@ class CameraBase {
   std::atomic_bool do_abort;
   std::atomic_uint32_t m_dropped_frames;
   std::atomic<float> m_fps;
+  std::atomic<cameraStat_t *> m_stats = nullptr;
 
   std::array<RESOLUTION_STRUCT, 2> m_frame;
   std::vector<std::string> m_supportedFormat_str;
@@ -167,5 +321,9 @@ class CameraBase {
 
   std::vector<CONTROL_CAPS_CAST> mControlCaps;
   CONTROL_CAPS_CAST *mExposureCap;
+  CONTROL_CAPS_CAST *mGainCap = nullptr;
+
+  ASI_CAMERA_INFO mCameraInfo;
+  std::atomic_uint32_t m_expo_escape, m_vc_escape;
 
 };
@@ -4,67 +4,202 @@
 //-------------------------------------------------------------------
 // Includes
 //-------------------------------------------------------------------
+#include <linux/futex.h>
 #include <spdlog/spdlog.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <ctime>
 #include <array>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
-// Array-based push-only circular buffer.
+#include "frame_slab.hpp"
+#include "latency.hpp"
+#include "timer.hpp"
 
-// Sample usage:
+//-------------------------------------------------------------------
+// Single-producer, multi-consumer broadcast frame ring.
 //
-// CircularBuffer<int, 3> buff;
-// buff.push( 1 ); // 1
-// buff.push( 2 ); // 1 2
-// buff.push( 3 ); // 1 2 3
-// buff.push( 4 ); // 2 3 4
-// buff.push( 5 ); // 3 4 5
-
-// for( int i : buff )
-//   std::cout << i << std::endl;
-
-template <class T, std::size_t SIZE>
-class CircularBuffer {
- public:
-  static_assert(SIZE > 0);
-
-  CircularBuffer() { mBuffer.resize(SIZE); }
-  void push(const T& value) {
-    mBuffer.erase(mBuffer.begin());
-    mBuffer.push_back(value);
-  }
-
-  T* get_buffer() { return mBuffer.data(); }
+// The capture thread is the only producer. Consumers (recorder, preview,
+// analysis...) register a reader and get their own cursor, so adding a stage
+// never touches the others. Sequence numbers are monotonic
+// (slot = seq % max_size), so full and empty are unambiguous and every slot is
+// usable. A slot becomes visible to readers once the producer commits it
+// (release store on tail).
+//
+// Reader policies:
+//  - Lossless: sees every frame in order. The producer only reuses a slot once
+//    every lossless reader has released it, so a slow lossless reader makes
+//    the ring fill up (claim() returns nullptr).
+//  - Latest: only ever sees the newest committed frame and may skip frames.
+//    While it holds a frame the slot is pinned and the producer will not
+//    overwrite it; pinning never holds back any other slot.
+//
+// What happens when a lossless reader falls a full ring behind is set per
+// claim() by OverflowPolicy:
+//  - DropNewest: claim() fails and the incoming frame is dropped, so what the
+//    lossless readers see stays contiguous.
+//  - OverwriteOldest: the producer reuses the oldest slot anyway; a lapped
+//    lossless reader jumps forward to the oldest frame still in the ring.
+//    Only the slot a reader is holding right now is never overwritten.
+//  - BlockWithTimeout: claim() waits for a lossless reader to release a slot,
+//    up to a timeout, then drops.
+// Every outcome is counted in RingCounters, and commit() can feed the time
+// from capture to publication into a LatencyHistogram.
+//
+// Producer:                          Consumer:
+//   T* slot = ring.claim();            int id = ring.add_reader(policy);
+//   if (slot) { fill(slot);            T* slot = ring.acquire(id);
+//               ring.commit(); }       if (slot) { use(slot);
+//                                                  ring.release(id); }
+//                                      ring.remove_reader(id);
+//
+// claim() calls without an intervening commit() hand back the same slot, so a
+// failed fill can simply be retried. Frames are used in place, never copied.
+//
+// A lossless reader that needs several frames at once (e.g. a spill stage
+// working ahead of a writer) can peek() at any committed frame from its cursor
+// on and later hand them all back with advance(). Under OverwriteOldest a
+// peek()ed frame is only protected by the cursor, so check intact() again
+// once done with it.
+#ifndef CACHELINE_SIZE
+#define CACHELINE_SIZE 64
+#endif
+enum class ReaderPolicy { Lossless, Latest };
+enum class OverflowPolicy { DropNewest, OverwriteOldest, BlockWithTimeout };
 
-  void reset() {
-    mBuffer.resize(0);
-    mBuffer.resize(SIZE);
-  }
+struct RingCounters {
+  std::atomic<uint64_t> dropped{0};      // incoming frames dropped at the ring
+  std::atomic<uint64_t> overwritten{0};  // frames lossless readers never saw
+  std::atomic<uint64_t> blocked{0};      // claims that had to wait
+  std::atomic<uint64_t> block_timeouts{0};
+  std::atomic<uint64_t> blocked_us{0};   // total time spent waiting
+};
 
- private:
-  enum { mCapacity = SIZE };
-  std::vector<T> mBuffer;
+// Fixed-size header kept alongside every ring slot. The producer fills it
+// before commit(); readers get it with meta(slot) and can measure their own
+// lag (monotonic_ns() - capture_ns) and gaps (seq) without locks.
+struct alignas(CACHELINE_SIZE) FrameMeta {
+  uint64_t seq = 0;         // ring sequence number, set by commit()
+  uint64_t capture_ns = 0;  // CLOCK_MONOTONIC when the frame arrived
+  uint64_t utc_ns = 0;      // CLOCK_REALTIME at the same instant
+  uint64_t publish_ns = 0;  // CLOCK_MONOTONIC at commit()
+  uint32_t exposure_us = 0;
+  uint32_t gain = 0;
+  uint32_t sdk_dropped = 0;   // cumulative drops reported by the camera
+  uint32_t ring_dropped = 0;  // cumulative drops because the ring was full
 };
-//-------------------------------------------------------------------
+
 template <class T>
 class Circular_Buffer {
+ public:
+  static constexpr size_t MAX_READERS = 8;
+
  private:
+  static constexpr uint64_t NO_SEQ = UINT64_MAX;
+
+  struct alignas(CACHELINE_SIZE) Reader {
+    std::atomic_bool active{false};
+    // Set by add_reader() before active, read by the producer after it.
+    std::atomic<ReaderPolicy> policy{ReaderPolicy::Lossless};
+    // Lossless: next sequence number to read. Written by the reader only.
+    std::atomic<uint64_t> cursor{0};
+    // Sequence number currently held, NO_SEQ if none.
+    std::atomic<uint64_t> pinned{NO_SEQ};
+    // Frames handed out and frames a Latest reader never got to see.
+    std::atomic<uint64_t> delivered{0};
+    std::atomic<uint64_t> skipped{0};
+    // Reader-local state.
+    uint64_t tail_cache = 0;
+    uint64_t last_seen = NO_SEQ;
+  };
+
   //---------------------------------------------------------------
   // Circular_Buffer - Private Member Variables
   //---------------------------------------------------------------
 
-  std::unique_ptr<T[]> buffer;  // using a smart pointer is safer (and we don't
-                                // have to implement a destructor)
-  std::atomic<std::size_t> head = 0;  // size_t is an unsigned long
-  std::atomic<std::size_t> tail = 0;
-  std::atomic<std::size_t> m_ltail = 0;
   const size_t max_size;
   const size_t n_bytes;
-  bool is_done = true;
-  T* empty_item;  // we will use this to clear data
+  FrameSlab slab;  // one pinned, 4 KiB-aligned slot per frame
+  std::unique_ptr<FrameMeta[]> metas;  // one header per slot
+
+  // Producer-owned: sequence number of the next slot to be committed.
+  alignas(CACHELINE_SIZE) std::atomic<uint64_t> tail{0};
+  // Producer-owned: sequence number of the slot being filled. Paired with
+  // Reader::pinned so that a reader and the producer never both win
+  // the same slot.
+  alignas(CACHELINE_SIZE) std::atomic<uint64_t> claiming{0};
+  // Set by add_reader() when a reader starts behind the producer's min_cache.
+  std::atomic_bool rescan{false};
+
+  // Readers blocked in wait_committed() sleep on the futex word `wake`, which
+  // commit() bumps only while `waiters` says someone is there.
+  alignas(CACHELINE_SIZE) std::atomic<uint32_t> wake{0};
+  std::atomic<uint32_t> waiters{0};
+
+  // Producer-local state; never touched by the readers.
+  alignas(CACHELINE_SIZE) uint64_t min_cache = 0;
   bool logged = false;
+  LatencyHistogram* publish_latency = nullptr;
+
+  RingCounters counters;
+
+  std::array<Reader, MAX_READERS> readers;
+  std::mutex readers_mutex;  // serialises add_reader/remove_reader only
+
+  T* full() {
+    if (!logged) {
+      spdlog::warn("Streaming buffer is full, dropping frames");
+      logged = true;
+    }
+    return nullptr;
+  }
+  // Wait until the slowest lossless reader frees the slot for seq t.
+  bool wait_for_space(uint64_t t, uint32_t timeout_ms) {
+    counters.blocked.fetch_add(1, std::memory_order_relaxed);
+    const auto start = std::chrono::steady_clock::now();
+    const auto deadline = start + std::chrono::milliseconds(timeout_ms);
+    bool ok = false;
+    while (std::chrono::steady_clock::now() < deadline) {
+      min_cache = min_cursor(t);
+      if (t - min_cache < max_size) {
+        ok = true;
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    counters.blocked_us.fetch_add(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count(),
+        std::memory_order_relaxed);
+    if (!ok) counters.block_timeouts.fetch_add(1, std::memory_order_relaxed);
+    return ok;
+  }
+
+  T* slot(uint64_t seq) {
+    return reinterpret_cast<T*>(slab.slot(seq % max_size));
+  }
+
+  // Oldest sequence number still needed by a lossless reader.
+  uint64_t min_cursor(uint64_t t) {
+    uint64_t m = t;
+    for (auto& r : readers)
+      if (r.active.load(std::memory_order_acquire) &&
+          r.policy.load(std::memory_order_relaxed) == ReaderPolicy::Lossless)
+        m = std::min(m, r.cursor.load(std::memory_order_acquire));
+    return m;
+  }
+
  public:
   //---------------------------------------------------------------
   // Circular_Buffer - Public Methods
@@ -72,94 +207,289 @@ class Circular_Buffer {
 
   // Create a new Circular_Buffer.
   Circular_Buffer<T>(size_t _nsamples, size_t _nbytes)
-      : buffer(std::unique_ptr<T[]>(new T[_nsamples * _nbytes])),
-        max_size(_nsamples),
-        n_bytes(_nbytes) {
-    empty_item = new T[_nsamples * _nbytes];
+      : max_size(std::max<size_t>(_nsamples, 2)),
+        n_bytes(_nbytes),
+        slab(max_size, _nbytes * sizeof(T)),
+        metas(new FrameMeta[max_size]) {
     spdlog::info(
         "Streaming buffer created of size {} bytes * {} samples = {} MB",
-        _nbytes, _nsamples, _nsamples * _nbytes / 1024 / 1024);
+        _nbytes, max_size, slab.bytes() / 1024 / 1024);
   };
 
   ~Circular_Buffer<T>() { spdlog::info("Streaming buffer released"); }
-  T get_empty() { return *empty_item; }
-
-  // Add an item to this circular buffer.
-  T* get_new_buffer() {
-    // if buffer is full, throw an error
-    if (is_full()) {
-      if (!logged) {
-        spdlog::warn("Streaming buffer is full, overwriting last buffer");
-        logged = true;
+
+  // Register a new reader; it starts at the next frame to be committed.
+  // A lossless reader can instead start up to `history` frames back, so a
+  // recording can begin with frames captured before it was started; the
+  // producer stops reusing those slots as soon as the reader is registered.
+  // Returns -1 if all MAX_READERS are taken.
+  int add_reader(ReaderPolicy policy, size_t history = 0) {
+    std::lock_guard<std::mutex> lock(readers_mutex);
+    for (size_t i = 0; i < MAX_READERS; i++) {
+      Reader& r = readers[i];
+      if (r.active.load(std::memory_order_relaxed)) continue;
+      r.policy.store(policy, std::memory_order_relaxed);
+      r.pinned.store(NO_SEQ, std::memory_order_relaxed);
+      r.delivered.store(0, std::memory_order_relaxed);
+      r.skipped.store(0, std::memory_order_relaxed);
+      r.tail_cache = tail.load(std::memory_order_acquire);
+      uint64_t start = r.tail_cache;
+      if (policy == ReaderPolicy::Lossless)
+        start -= std::min<uint64_t>({history, max_size - 1, r.tail_cache});
+      r.cursor.store(start, std::memory_order_relaxed);
+      r.last_seen = r.tail_cache - 1;
+      r.active.store(true, std::memory_order_seq_cst);
+      if (start < r.tail_cache) {
+        // The producer's min_cache may be newer than start; make it look
+        // again, and skip whatever it was already refilling.
+        rescan.store(true, std::memory_order_seq_cst);
+        r.cursor.store(std::max(start, oldest()), std::memory_order_release);
       }
-      return last();
+      spdlog::debug("Streaming buffer reader {} added ({}, {} frames back)", i,
+                    policy == ReaderPolicy::Lossless ? "lossless" : "latest",
+                    r.tail_cache - r.cursor.load(std::memory_order_relaxed));
+      return int(i);
     }
-    logged = false;
-
-    // insert item at back of buffer
-    T* item = &buffer[tail * n_bytes];
-    size_t tt = tail;
-    m_ltail = tt;
-
-    // increment tail
-    tail = (tail + 1) % max_size;
-    return item;
+    spdlog::error("Streaming buffer has no free reader slots");
+    return -1;
+  }
+  void remove_reader(int id) {
+    if (id < 0 || size_t(id) >= MAX_READERS) return;
+    std::lock_guard<std::mutex> lock(readers_mutex);
+    readers[id].pinned.store(NO_SEQ, std::memory_order_release);
+    readers[id].active.store(false, std::memory_order_release);
+    spdlog::debug("Streaming buffer reader {} removed", id);
   }
 
-  // Remove an item from this circular buffer and return it.
-  T* dequeue(bool is_vPort = false) {
-    // if buffer is empty, throw an error
-    if (is_empty()) {
-      if (!logged) {
-        spdlog::debug("buffer is empty");
-        logged = true;
-      }
-      return nullptr;
+  // Producer: return the slot for the next frame, or nullptr if there is no
+  // room for it under the given policy (see OverflowPolicy). A failed claim
+  // does not count as a drop by itself; call mark_dropped() once the frame is
+  // actually discarded.
+  T* claim(OverflowPolicy policy = OverflowPolicy::DropNewest,
+           uint32_t timeout_ms = 0) {
+    const uint64_t t = tail.load(std::memory_order_relaxed);
+    if (rescan.load(std::memory_order_relaxed) &&
+        rescan.exchange(false, std::memory_order_seq_cst))
+      min_cache = min_cursor(t);
+    if (policy != OverflowPolicy::OverwriteOldest &&
+        t - min_cache >= max_size) {
+      min_cache = min_cursor(t);
+      if (t - min_cache >= max_size &&
+          (policy != OverflowPolicy::BlockWithTimeout ||
+           !wait_for_space(t, timeout_ms)))
+        return full();
+    }
+    claiming.store(t, std::memory_order_seq_cst);
+    for (auto& r : readers) {
+      if (!r.active.load(std::memory_order_acquire)) continue;
+      const uint64_t p = r.pinned.load(std::memory_order_seq_cst);
+      if (p != NO_SEQ && p % max_size == t % max_size) return full();
     }
     logged = false;
-    // get item at head
-    T* item = &buffer[head * n_bytes];
+    return slot(t);
+  }
+  // Producer: a frame was discarded because claim() failed.
+  void mark_dropped() {
+    counters.dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+  // A lossless reader found frames that OverwriteOldest had already reclaimed.
+  void mark_overwritten(uint64_t n) {
+    counters.overwritten.fetch_add(n, std::memory_order_relaxed);
+  }
+  // Records capture_ns to publication of every frame in h from now on;
+  // before the producer starts.
+  void set_publish_latency(LatencyHistogram* h) { publish_latency = h; }
+  // Producer: header of the slot returned by the last claim().
+  FrameMeta& claimed_meta() {
+    return metas[tail.load(std::memory_order_relaxed) % max_size];
+  }
+  // Producer: publish the slot returned by the last claim().
+  void commit() {
+    const uint64_t t = tail.load(std::memory_order_relaxed);
+    FrameMeta& m = metas[t % max_size];
+    m.seq = t;
+    m.publish_ns = monotonic_ns();
+    if (publish_latency != nullptr && m.capture_ns != 0 &&
+        m.capture_ns <= m.publish_ns)
+      publish_latency->record(m.publish_ns - m.capture_ns);
+    tail.store(t + 1, std::memory_order_release);
+    // Pairs with the fence in wait_committed(): either the waiter sees the
+    // new tail or we see the waiter.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed) != 0) {
+      wake.fetch_add(1, std::memory_order_release);
+      syscall(SYS_futex, &wake, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr,
+              nullptr, 0);
+    }
+  }
 
-    // set item at head to be empty
-    // T empty;
-    // buffer[head] = empty_item;
+  // Reader: Lossless readers get the oldest frame they have not released yet,
+  // Latest readers get the newest committed frame if they have not seen it.
+  // Returns nullptr if there is nothing new.
+  T* acquire(int id) {
+    Reader& r = readers[id];
+    if (r.policy.load(std::memory_order_relaxed) == ReaderPolicy::Lossless) {
+      while (true) {
+        const uint64_t c = r.cursor.load(std::memory_order_relaxed);
+        if (c == r.tail_cache) {
+          r.tail_cache = tail.load(std::memory_order_acquire);
+          if (c == r.tail_cache) return nullptr;
+        }
+        r.pinned.store(c, std::memory_order_seq_cst);
+        const uint64_t w = claiming.load(std::memory_order_seq_cst);
+        if (w < c + max_size) return slot(c);
+        // OverwriteOldest lapped us: skip to the oldest frame that is not
+        // being refilled.
+        r.pinned.store(NO_SEQ, std::memory_order_release);
+        const uint64_t oldest = w - max_size + 1;
+        counters.overwritten.fetch_add(oldest - c, std::memory_order_relaxed);
+        r.cursor.store(oldest, std::memory_order_release);
+      }
+    }
+    while (true) {
+      const uint64_t t = tail.load(std::memory_order_acquire);
+      if (t == 0 || t - 1 == r.last_seen) return nullptr;
+      const uint64_t c = t - 1;
+      r.pinned.store(c, std::memory_order_seq_cst);
+      if (claiming.load(std::memory_order_seq_cst) < c + max_size) {
+        r.skipped.fetch_add(c - r.last_seen - 1, std::memory_order_relaxed);
+        r.last_seen = c;
+        return slot(c);
+      }
+      // The producer lapped us while we were pinning; try the newer frame.
+      r.pinned.store(NO_SEQ, std::memory_order_release);
+    }
+  }
+  // Reader: hand the slot returned by the last acquire() back to the
+  // producer.
+  void release(int id) {
+    Reader& r = readers[id];
+    r.delivered.fetch_add(1, std::memory_order_relaxed);
+    r.pinned.store(NO_SEQ, std::memory_order_release);
+    if (r.policy.load(std::memory_order_relaxed) == ReaderPolicy::Lossless)
+      r.cursor.store(r.cursor.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+  }
 
-    // move head foward
-    is_done = is_vPort;
-    // head = (head + 1) % max_size;
+  // Reader: sleep until frame seq has been committed, at most timeout_ms.
+  // Returns false on timeout. Costs the producer nothing while nobody waits.
+  bool wait_committed(uint64_t seq, uint32_t timeout_ms) {
+    if (tail.load(std::memory_order_acquire) > seq) return true;
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(timeout_ms);
+    waiters.fetch_add(1, std::memory_order_relaxed);
+    bool ok = false;
+    while (true) {
+      const uint32_t w = wake.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (tail.load(std::memory_order_acquire) > seq) {
+        ok = true;
+        break;
+      }
+      const auto left = deadline - std::chrono::steady_clock::now();
+      if (left <= std::chrono::steady_clock::duration::zero()) break;
+      const auto ns =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+      timespec ts{time_t(ns / 1000000000), long(ns % 1000000000)};
+      syscall(SYS_futex, &wake, FUTEX_WAIT_PRIVATE, w, &ts, nullptr, 0);
+    }
+    waiters.fetch_sub(1, std::memory_order_relaxed);
+    return ok;
+  }
 
-    // return item
-    return item;
+  // Lossless reader: frame seq (seq >= cursor) if it has been committed and
+  // not reclaimed, without moving the cursor. nullptr if not committed yet or
+  // already lapped; tell the two apart with intact().
+  T* peek(int id, uint64_t seq) {
+    Reader& r = readers[id];
+    if (seq >= r.tail_cache) {
+      r.tail_cache = tail.load(std::memory_order_acquire);
+      if (seq >= r.tail_cache) return nullptr;
+    }
+    return intact(seq) ? slot(seq) : nullptr;
   }
-  void move_tail() {
-    if (!is_done) {
-      is_done = true;
-      head = (head + 1) % max_size;
+  // Lossless reader: hand back every frame before seq at once.
+  void advance(int id, uint64_t seq) {
+    Reader& r = readers[id];
+    const uint64_t c = r.cursor.load(std::memory_order_relaxed);
+    if (seq <= c) return;
+    r.delivered.fetch_add(seq - c, std::memory_order_relaxed);
+    r.pinned.store(NO_SEQ, std::memory_order_release);
+    r.cursor.store(seq, std::memory_order_release);
+  }
+  // Lossless reader: skip the frames captured before capture_ns
+  // (CLOCK_MONOTONIC). Frames from the cursor on are held for this reader, so
+  // their headers are stable.
+  void skip_before(int id, uint64_t capture_ns) {
+    Reader& r = readers[id];
+    uint64_t lo = std::max(r.cursor.load(std::memory_order_relaxed), oldest());
+    uint64_t hi = r.tail_cache = tail.load(std::memory_order_acquire);
+    while (lo < hi) {
+      const uint64_t mid = lo + (hi - lo) / 2;
+      if (metas[mid % max_size].capture_ns < capture_ns)
+        lo = mid + 1;
+      else
+        hi = mid;
     }
+    if (lo > r.cursor.load(std::memory_order_relaxed))
+      r.cursor.store(lo, std::memory_order_release);
+  }
+  uint64_t cursor(int id) {
+    return readers[id].cursor.load(std::memory_order_acquire);
+  }
+  // False once the producer has started to refill the slot of frame seq.
+  // Only OverwriteOldest reclaims frames a lossless reader still needs.
+  bool intact(uint64_t seq) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return claiming.load(std::memory_order_seq_cst) < seq + max_size;
+  }
+  // Oldest frame that is still intact.
+  uint64_t oldest() {
+    const uint64_t w = claiming.load(std::memory_order_seq_cst);
+    return w >= max_size ? w - max_size + 1 : 0;
   }
 
-  // Return the item at the front/end of this circular buffer.
-  T* peek() { return &buffer[head * n_bytes]; }
-  T* last() {
-    return &buffer[m_ltail == 0 ? 0 : (m_ltail * n_bytes) - n_bytes];
+  // Reader: header of a slot returned by acquire(). Valid until release().
+  const FrameMeta& meta(const T* slot_ptr) {
+    const size_t idx = (reinterpret_cast<const uint8_t*>(slot_ptr) -
+                        slab.data()) /
+                       slab.slot_stride();
+    return metas[idx];
   }
 
+  size_t capacity() const { return max_size; }
+  size_t frame_size() const { return n_bytes; }
+  // Distance in bytes between consecutive slots; always a multiple of
+  // FrameSlab::SLOT_ALIGN.
+  size_t slot_stride() const { return slab.slot_stride(); }
+  uint64_t committed() { return tail.load(std::memory_order_acquire); }
+
+  // Number of committed frames a Lossless reader has not consumed yet; 0 for
+  // a Latest reader, which never falls behind (see skipped()).
+  size_t lag(int id) {
+    const Reader& r = readers[id];
+    const uint64_t t = tail.load(std::memory_order_acquire);
+    const uint64_t c = r.cursor.load(std::memory_order_acquire);
+    if (r.policy.load(std::memory_order_relaxed) != ReaderPolicy::Lossless)
+      return 0;
+    return t > c ? t - c : 0;
+  }
+  uint64_t delivered(int id) { return readers[id].delivered.load(); }
+  uint64_t skipped(int id) { return readers[id].skipped.load(); }
+  const RingCounters& get_counters() const { return counters; }
+
   // Return true if this circular buffer is empty, and false otherwise.
-  bool is_empty() { return occupancy() == 1; }
+  bool is_empty() { return occupancy() == 0; }
 
   // Return true if this circular buffer is full, and false otherwise.
-  bool is_full() { return occupancy() == max_size - 1; }
+  bool is_full() { return occupancy() >= max_size; }
 
-  // Return the size of this circular buffer.
-  std::array<size_t, 2> get_head_tail() {
-    return std::array<size_t, 2>{head, tail};
-  }
   // Return the number of empty slots on the buffer.
   size_t vacancy() { return max_size - occupancy(); }
-  // Return the number of populated slots on the buffer.
+  // Return the number of slots still held for the slowest lossless reader.
   size_t occupancy() {
-    if (tail >= head) return tail - head;
-    return max_size - head + tail;
+    const uint64_t t = tail.load(std::memory_order_acquire);
+    return std::min<uint64_t>(t - min_cursor(t), max_size);
   }
   float update_fullness() { return float(occupancy()) / float(max_size); }
 };
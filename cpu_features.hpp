@@ -0,0 +1,40 @@
+#ifndef __CPU_FEATURES__
+#define __CPU_FEATURES__
+
+//-------------------------------------------------------------------
+// Instruction set extensions of the machine we run on, for kernels that
+// are compiled for several and pick one at run time. The build itself only
+// assumes the baseline of the target (SSE2 on x86-64, NEON on aarch64).
+//-------------------------------------------------------------------
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#elif defined(__aarch64__)
+#define CPU_NEON 1
+#endif
+
+namespace CpuFeatures {
+
+#ifdef CPU_X86
+inline bool SSSE3() {
+  static const bool have = __builtin_cpu_supports("ssse3");
+  return have;
+}
+inline bool AVX2() {
+  static const bool have = __builtin_cpu_supports("avx2");
+  return have;
+}
+// Byte and word operations on 512-bit vectors (AVX-512 F and BW).
+inline bool AVX512BW() {
+  static const bool have = __builtin_cpu_supports("avx512f") &&
+                           __builtin_cpu_supports("avx512bw");
+  return have;
+}
+#else
+inline bool SSSE3() { return false; }
+inline bool AVX2() { return false; }
+inline bool AVX512BW() { return false; }
+#endif
+
+}  // namespace CpuFeatures
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef __FRAME_SLAB__
+#define __FRAME_SLAB__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+// One contiguous, pinned allocation backing every slot of the streaming ring.
+//
+// Each slot starts on a SLOT_ALIGN boundary so it can be handed to O_DIRECT
+// writes and aligned SIMD loads as-is. The slab is backed by explicit huge
+// pages (MAP_HUGETLB) when the system has a pool reserved, otherwise by
+// transparent huge pages (MADV_HUGEPAGE); either way every page is faulted in
+// and mlock'd here, up front, so the capture thread never takes a page fault
+// mid-session.
+class FrameSlab {
+ public:
+  static constexpr size_t SLOT_ALIGN = 4096;
+  static constexpr size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+  FrameSlab(size_t _nslots, size_t _slot_bytes)
+      : nslots(_nslots),
+        slot_bytes(_slot_bytes),
+        stride(round_up(_slot_bytes, SLOT_ALIGN)) {
+    const size_t wanted = stride * nslots;
+    auto start = std::chrono::steady_clock::now();
+
+#ifdef MAP_HUGETLB
+    map_size = round_up(wanted, HUGE_PAGE);
+    void *p = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                   -1, 0);
+    if (p != MAP_FAILED) {
+      base = static_cast<uint8_t *>(p);
+      map_base = base;
+      is_hugetlb = true;
+    }
+#endif
+    if (base == nullptr) {
+      // Over-allocate by one huge page so the slab can start on a huge page
+      // boundary, which THP needs to back it with 2 MiB pages.
+      map_size = round_up(wanted, HUGE_PAGE) + HUGE_PAGE;
+      void *p = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED) {
+        spdlog::critical("Failed to map {} MB for the streaming buffer: {}",
+                         map_size / 1024 / 1024, std::strerror(errno));
+        throw std::bad_alloc();
+      }
+      map_base = static_cast<uint8_t *>(p);
+      base = reinterpret_cast<uint8_t *>(
+          round_up(reinterpret_cast<uintptr_t>(map_base), HUGE_PAGE));
+#ifdef MADV_HUGEPAGE
+      madvise(base, round_up(wanted, HUGE_PAGE), MADV_HUGEPAGE);
+#endif
+      // Touch every page so the kernel backs the whole slab now rather than
+      // on the capture thread.
+      const size_t page = size_t(sysconf(_SC_PAGESIZE));
+      for (size_t off = 0; off < wanted; off += page) base[off] = 0;
+    }
+    size = round_up(wanted, HUGE_PAGE);
+
+    is_locked = mlock(base, size) == 0;
+    if (!is_locked)
+      spdlog::warn(
+          "Could not mlock the streaming buffer ({}); it may be swapped out. "
+          "Raise RLIMIT_MEMLOCK (ulimit -l) to pin it.",
+          std::strerror(errno));
+
+    prefault_ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    spdlog::info(
+        "Streaming slab: {} slots x {} bytes ({} MB), {} huge pages, {:.0f}% "
+        "huge-page coverage, {}, pre-faulted in {:.1f} ms",
+        nslots, stride, size / 1024 / 1024,
+        is_hugetlb ? "explicit" : "transparent", huge_page_coverage() * 100,
+        is_locked ? "locked" : "not locked", prefault_ms);
+  }
+  ~FrameSlab() {
+    if (is_locked) munlock(base, size);
+    if (map_base != nullptr) munmap(map_base, map_size);
+  }
+  FrameSlab(const FrameSlab &) = delete;
+  FrameSlab &operator=(const FrameSlab &) = delete;
+
+  uint8_t *data() { return base; }
+  uint8_t *slot(size_t idx) { return base + idx * stride; }
+  size_t slot_stride() const { return stride; }
+  size_t bytes() const { return size; }
+
+  // Fraction of the slab backed by huge pages.
+  double huge_page_coverage() {
+    if (is_hugetlb) return 1.0;
+    // THP: sum AnonHugePages over the mappings the slab spans in smaps.
+    // madvise and mlock split the slab from the unaligned head of the
+    // mmap, so that can be a mapping of its own, and is not counted.
+    FILE *file = fopen("/proc/self/smaps", "r");
+    if (file == nullptr) return 0.0;
+    char line[256];
+    bool in_range = false;
+    size_t huge_kb = 0;
+    const uintptr_t lo = reinterpret_cast<uintptr_t>(base);
+    const uintptr_t hi = lo + size;
+    while (fgets(line, sizeof(line), file) != NULL) {
+      unsigned long start, end;
+      if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+        in_range = start < hi && lo < end;
+        continue;
+      }
+      size_t kb;
+      if (in_range && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1)
+        huge_kb += kb;
+    }
+    fclose(file);
+    return size ? std::min(1.0, double(huge_kb) * 1024 / double(size)) : 0.0;
+  }
+
+ private:
+  static size_t round_up(size_t v, size_t a) { return (v + a - 1) / a * a; }
+
+  const size_t nslots;
+  const size_t slot_bytes;
+  const size_t stride;
+  uint8_t *base = nullptr;
+  uint8_t *map_base = nullptr;
+  size_t map_size = 0;
+  size_t size = 0;
+  bool is_hugetlb = false;
+  bool is_locked = false;
+  double prefault_ms = 0;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef __FRAME_STAGE__
+#define __FRAME_STAGE__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "circular_buffer.hpp"
+#include "thread_profile.hpp"
+
+//-------------------------------------------------------------------
+// Worker stage between a camera's capture thread and the streaming ring,
+// for frames that need converting before anyone may see them.
+//
+// The capture thread claims a slot of the stage's own small ring, has the
+// SDK fill it, commits it and goes straight back to the SDK for the next
+// frame. The stage thread takes the frames in order, converts each into a
+// slot of the streaming ring, copies its header across and publishes it
+// there, under the streaming ring's overflow policy; a blocking policy
+// blocks the stage, not the USB link.
+//
+// When the stage is a whole ring behind, claim() fails and the capture
+// thread discards the frame as it does when the streaming ring is full;
+// frames the streaming ring has no room for are dropped by the stage. Both
+// are counted as dropped on the streaming ring.
+//
+//   FrameStage stage(ring, bytes, 8, convert, policy, timeout);
+//   uint8_t *slot = stage.claim();   // nullptr: discard, mark_dropped()
+//   ... fill slot, stage.claimed_meta() ...
+//   stage.commit();
+//-------------------------------------------------------------------
+class FrameStage {
+ public:
+  using Ring = Circular_Buffer<uint8_t>;
+  // Converts one frame from the stage's slot into the streaming ring's.
+  using Convert = std::function<void(uint8_t *dst, const uint8_t *src)>;
+
+  FrameStage(std::shared_ptr<Ring> _out, size_t frame_bytes, size_t slots,
+             Convert _convert, const std::atomic<OverflowPolicy> &_policy,
+             const std::atomic_uint32_t &_timeout_ms)
+      : out(_out),
+        in(slots, frame_bytes),
+        convert(std::move(_convert)),
+        policy(_policy),
+        timeout_ms(_timeout_ms) {
+    reader = in.add_reader(ReaderPolicy::Lossless);
+    worker = std::thread(&FrameStage::Loop, this);
+  }
+  // Converts what is still queued, then stops the worker.
+  ~FrameStage() {
+    stop = true;
+    worker.join();
+    spdlog::info("Conversion stage: {} frames converted, {} not taken by "
+                 "the streaming buffer",
+                 converted.load(), refused.load());
+  }
+  FrameStage(const FrameStage &) = delete;
+  FrameStage &operator=(const FrameStage &) = delete;
+
+  // Capture thread: as Circular_Buffer's producer side; a failed claim is
+  // counted with mark_dropped() on the streaming ring.
+  uint8_t *claim() { return in.claim(OverflowPolicy::DropNewest); }
+  FrameMeta &claimed_meta() { return in.claimed_meta(); }
+  void commit() { in.commit(); }
+
+  // Frames queued and not converted yet.
+  size_t depth() { return in.occupancy(); }
+
+ private:
+  std::shared_ptr<Ring> out;
+  Ring in;
+  int reader = -1;
+  Convert convert;
+  const std::atomic<OverflowPolicy> &policy;
+  const std::atomic_uint32_t &timeout_ms;
+  std::thread worker;
+  std::atomic_bool stop = false;
+  std::atomic<uint64_t> converted = 0;
+  std::atomic<uint64_t> refused = 0;
+
+  void Loop() {
+    ThreadProfile::Apply(ThreadProfile::Role::Convert);
+    while (true) {
+      // Read before looking for frames, so the last ones are not missed.
+      const bool last = stop;
+      const uint8_t *src = in.acquire(reader);
+      if (src == nullptr) {
+        if (last) return;
+        in.wait_committed(in.cursor(reader), 50);
+        continue;
+      }
+      uint8_t *dst = out->claim(policy, timeout_ms);
+      if (dst == nullptr) {
+        out->mark_dropped();
+        refused++;
+      } else {
+        convert(dst, src);
+        FrameMeta &meta = out->claimed_meta();
+        meta = in.meta(src);
+        meta.ring_dropped =
+            out->get_counters().dropped.load(std::memory_order_relaxed);
+        out->commit();
+        converted++;
+      }
+      in.release(reader);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef __LATENCY__
+#define __LATENCY__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <spdlog/fmt/fmt.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+//-------------------------------------------------------------------
+// Latency histogram in the manner of HdrHistogram: every power of two is
+// split into SUB linear buckets, so a value is known to within 1/SUB (3 %)
+// from a nanosecond up to 2^MAX_BITS ns (about 18 minutes); anything longer
+// counts as that.
+//
+// One thread records, any thread reads. record() is a few relaxed loads
+// and stores, no locked instruction and no allocation, so it may sit on the
+// capture path. Readers take a Snapshot, which can be a sample or two
+// behind the writer. A histogram is never reset: a window (one recording,
+// since a button was pressed) is the difference of two snapshots.
+//
+//   LatencyHistogram h;                  h.record(monotonic_ns() - t0);
+//   auto s = h.snapshot().since(start);  s.percentile(0.99);
+//-------------------------------------------------------------------
+class LatencyHistogram {
+ public:
+  static constexpr int SUB_BITS = 5;
+  static constexpr uint64_t SUB = uint64_t(1) << SUB_BITS;
+  static constexpr int MAX_BITS = 40;
+  static constexpr size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB;
+
+  struct Snapshot {
+    std::array<uint64_t, BUCKETS> counts{};
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+    uint64_t max_ns = 0;
+
+    // Smallest value at or below which a fraction p of the samples are, to
+    // within a bucket; 0 if there are none.
+    uint64_t percentile(double p) const {
+      if (count == 0) return 0;
+      const uint64_t rank =
+          std::max<uint64_t>(uint64_t(p * double(count) + 0.5), 1);
+      uint64_t seen = 0;
+      for (size_t i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) return std::min(Highest(i), max_ns);
+      }
+      return max_ns;
+    }
+    double mean_ns() const { return count ? double(sum_ns) / count : 0.; }
+    // The samples recorded after `earlier` was taken. Their max is only
+    // known to within a bucket, unless it is the histogram's own.
+    Snapshot since(const Snapshot &earlier) const {
+      Snapshot s = *this;
+      s.count = 0;
+      uint64_t top = 0;
+      for (size_t i = 0; i < BUCKETS; i++) {
+        s.counts[i] -= std::min(s.counts[i], earlier.counts[i]);
+        s.count += s.counts[i];
+        if (s.counts[i]) top = Highest(i);
+      }
+      s.sum_ns -= std::min(s.sum_ns, earlier.sum_ns);
+      s.max_ns = std::min(s.max_ns, top);
+      return s;
+    }
+    // {"count": .., "mean_us": .., "p50_us": .., ..., "max_us": ..}
+    std::string json() const {
+      const auto us = [](double ns) { return ns / 1000.; };
+      return fmt::format(
+          R"({{"count": {}, "mean_us": {:.1f}, "p50_us": {:.1f}, )"
+          R"("p90_us": {:.1f}, "p99_us": {:.1f}, "p999_us": {:.1f}, )"
+          R"("max_us": {:.1f}}})",
+          count, us(mean_ns()), us(percentile(0.5)), us(percentile(0.9)),
+          us(percentile(0.99)), us(percentile(0.999)), us(max_ns));
+    }
+  };
+
+  LatencyHistogram() = default;
+  LatencyHistogram(const LatencyHistogram &) = delete;
+  LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+  // Writer only.
+  void record(uint64_t ns) {
+    auto &c = counts[Bucket(ns)];
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum.store(sum.load(std::memory_order_relaxed) + ns,
+              std::memory_order_relaxed);
+    if (ns > max.load(std::memory_order_relaxed))
+      max.store(ns, std::memory_order_relaxed);
+  }
+
+  Snapshot snapshot() const {
+    Snapshot s;
+    for (size_t i = 0; i < BUCKETS; i++) {
+      s.counts[i] = counts[i].load(std::memory_order_relaxed);
+      s.count += s.counts[i];
+    }
+    s.sum_ns = sum.load(std::memory_order_relaxed);
+    s.max_ns = max.load(std::memory_order_relaxed);
+    return s;
+  }
+
+  static size_t Bucket(uint64_t ns) {
+    ns = std::min(ns, (uint64_t(1) << MAX_BITS) - 1);
+    if (ns < SUB) return size_t(ns);
+    const int shift = 63 - __builtin_clzll(ns) - SUB_BITS;
+    return size_t(shift + 1) * SUB + size_t((ns >> shift) - SUB);
+  }
+  // Largest value that falls in bucket i.
+  static uint64_t Highest(size_t i) {
+    const size_t group = i / SUB;
+    if (group == 0) return i;
+    const int shift = int(group) - 1;
+    return ((SUB + i % SUB + 1) << shift) - 1;
+  }
+
+ private:
+  std::array<std::atomic<uint64_t>, BUCKETS> counts{};
+  std::atomic<uint64_t> sum{0};
+  std::atomic<uint64_t> max{0};
+};
+
+#endif
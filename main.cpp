@@ -13,8 +13,10 @@
 
 #include "CameraWindow.hpp"
 #include "HyperlinkHelper.hpp"
+#include "Diagnostics.hpp"
 #include "Plots.hpp"
 #include "ViewPort.hpp"
+#include "thread_profile.hpp"
 // MyLoadFonts: demonstrate
 // * how to load additional fonts
 // * how to use assets from the local assets/ folder
@@ -73,12 +75,28 @@ void StatusBarGui() {
             &(CameraWindow::pCamera->getStreamingFramePtr()->aSpace);
         size_t *fSpace =
             &(CameraWindow::pCamera->getStreamingFramePtr()->fSpace);
+        // A striped recording can use the free space of every stripe.
         *fSpace =
             std::filesystem::space(
                 CameraWindow::pCamera->getStreamingFramePtr()->selectedFilename,
                 ec)
                 .available /
             1024 / 1024;
+        const auto stripes =
+            CameraWindow::pCamera->getStreamingFramePtr()->Stripes();
+        if (!stripes.empty()) {
+          *aSpace = std::filesystem::space(CameraWindow::pCamera
+                                               ->getStreamingFramePtr()
+                                               ->selectedFilename,
+                                           ec)
+                        .capacity /
+                    1024 / 1024;
+          for (const auto &dir : stripes) {
+            const auto sp = std::filesystem::space(dir, ec);
+            *fSpace += sp.available / 1024 / 1024;
+            *aSpace += sp.capacity / 1024 / 1024;
+          }
+        }
         ImGui::Text("Diskspace: %ld/%ld MB ", *aSpace, *fSpace);
         ImGui::SameLine();
         ImGui::ProgressBar((float)(*fSpace) / (float)(*aSpace),
@@ -133,9 +151,7 @@ static void segfault_sigaction(int signal, siginfo_t *si, void *arg) {
       "be safe, signal- {}",
       __func__, si->si_addr, signal);
   if (vp != nullptr) vp->close_threads();
-  if (CameraWindow::pCamera != nullptr)
-    if ((CameraWindow::pCamera->is_connected))
-      CameraWindow::pCamera->Disconnect();
+  CameraWindow::DisconnectAll();
   exit(-1);
 }
 
@@ -146,9 +162,7 @@ static void captured_ctrl_c(int signum) {
   else
     spdlog::critical("{} {}: making sure camera is closed", __func__, signum);
   if (vp != nullptr) vp->close_threads();
-  if (CameraWindow::pCamera != nullptr)
-    if ((CameraWindow::pCamera->is_connected))
-      CameraWindow::pCamera->Disconnect();
+  CameraWindow::DisconnectAll();
   exit(signum);
 }
 int main(int, char **) {
@@ -157,7 +171,10 @@ int main(int, char **) {
   // load additional font
   ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
   try {
+    // Before the other threads start, so they begin where the GUI may run.
+    ThreadProfile::Apply(ThreadProfile::Role::Gui);
     PlotWidget plotWidget;
+    DiagnosticsWidget diagnosticsWidget;
     ViewPort viewPort;
     CameraWindow cameraWindow;
     AboutWindow aboutWindow;
@@ -188,6 +205,10 @@ int main(int, char **) {
     // uncomment next line in order to hide the FPS in the status bar
     // runnerParams.imGuiWindowParams.showStatus_Fps = false;
     runnerParams.callbacks.ShowStatus = [] { StatusBarGui(); };
+    runnerParams.callbacks.PreNewFrame = [] {
+      static uint32_t profile = ThreadProfile::Generation();
+      ThreadProfile::Refresh(ThreadProfile::Role::Gui, profile);
+    };
 
     MenuBar(runnerParams);
 
@@ -278,6 +299,14 @@ int main(int, char **) {
       plotWindow.dockSpaceName = "BottomSpace";
       plotWindow.GuiFunction = [&plotWidget] { plotWidget.gui(); };
     }
+    HelloImGui::DockableWindow diagnosticsWindow;
+    {
+      diagnosticsWindow.label = "Diagnostics";
+      diagnosticsWindow.dockSpaceName = "BottomSpace";
+      diagnosticsWindow.GuiFunction = [&diagnosticsWidget] {
+        diagnosticsWidget.gui();
+      };
+    }
     HelloImGui::DockableWindow logsWindow;
     {
       logsWindow.label = "Logs";
@@ -312,7 +341,8 @@ int main(int, char **) {
     // Finally, transmit these windows to HelloImGui
     runnerParams.dockingParams.dockableWindows = {
         dock_about, commandsWindow,       logsWindow,
-        plotWindow, dock_acknowledgments, captureWindow};
+        plotWindow, diagnosticsWindow,    dock_acknowledgments,
+        captureWindow};
     aboutWindow.isVisible =
         &(runnerParams.dockingParams.dockableWindowOfName("About")->isVisible);
     acknowledgments.isVisible =
@@ -345,27 +375,21 @@ int main(int, char **) {
     spdlog::critical(
         "captured runtime exception: {}; executing graceful exit just to be safe ", ex.what());
     if (vp != nullptr) vp->close_threads();
-    if (CameraWindow::pCamera != nullptr)
-      if ((CameraWindow::pCamera->is_connected))
-        CameraWindow::pCamera->Disconnect();
+    CameraWindow::DisconnectAll();
     exit(-1);
   }
   catch (const std::exception &ex) {
     spdlog::critical(
         "captured exception: {}; executing graceful exit just to be safe ", ex.what());
     if (vp != nullptr) vp->close_threads();
-    if (CameraWindow::pCamera != nullptr)
-      if ((CameraWindow::pCamera->is_connected))
-        CameraWindow::pCamera->Disconnect();
+    CameraWindow::DisconnectAll();
     exit(-1);
   }
   catch (...) {
     spdlog::critical(
         "captured undefined exception; executing graceful exit just to be safe ");
     if (vp != nullptr) vp->close_threads();
-    if (CameraWindow::pCamera != nullptr)
-      if ((CameraWindow::pCamera->is_connected))
-        CameraWindow::pCamera->Disconnect();
+    CameraWindow::DisconnectAll();
     exit(-1);
   }
 
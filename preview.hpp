@@ -0,0 +1,34 @@
+#ifndef __PREVIEW__
+#define __PREVIEW__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//-------------------------------------------------------------------
+// The 8-bit image the live view shows for a frame. Kept free of GUI and
+// OpenCV so the pipeline benchmark runs the very same conversion.
+//-------------------------------------------------------------------
+namespace Preview {
+
+// samples samples of bytes (1 or 2) each from src into 8 bits at dst.
+// 16-bit samples (host order) become v / 255, rounded and saturated, as
+// cv::Mat's division and conversion did before.
+inline void To8Bit(const uint8_t *src, size_t samples, size_t bytes,
+                   uint8_t *dst) {
+  if (bytes != 2) {
+    std::memcpy(dst, src, samples);
+    return;
+  }
+  const uint16_t *s = reinterpret_cast<const uint16_t *>(src);
+  // A plain loop; the compiler vectorises the division by a constant.
+  for (size_t i = 0; i < samples; i++)
+    dst[i] = uint8_t(std::min<uint32_t>((uint32_t(s[i]) + 127) / 255, 255));
+}
+
+}  // namespace Preview
+
+#endif
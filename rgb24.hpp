@@ -0,0 +1,213 @@
+#ifndef __RGB24__
+#define __RGB24__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "cpu_features.hpp"
+#include "thread_profile.hpp"
+#include "worker_pool.hpp"
+#ifdef CPU_X86
+#include <immintrin.h>
+#elif defined(CPU_NEON)
+#include <arm_neon.h>
+#endif
+
+//-------------------------------------------------------------------
+// RGB24 frames come from the SDK interleaved B, G, R; the capture path
+// keeps them as three planes, R, G then B. Each plane gets every third
+// byte, which the x86 kernels gather with byte shuffles: three 16-byte
+// vectors of input hold 16 pixels, and one shuffle of each, OR-ed,
+// gives a plane's 16 bytes. AVX2 and AVX-512 do the same on two and four
+// such groups at once (shuffles stay within 128-bit lanes, so each lane
+// is loaded with its own group). NEON has a de-interleaving load. The
+// widest one the CPU has is picked at run time; the tail and other
+// machines take the scalar loop.
+//
+// Big frames are cut into bands of rows that the RGB24 pool converts in
+// parallel with the calling thread.
+//-------------------------------------------------------------------
+namespace RGB24 {
+
+namespace detail {
+
+inline void Scalar(uint8_t *r, uint8_t *g, uint8_t *b, const uint8_t *src,
+                   size_t n) {
+  for (size_t i = 0; i < n; i++, src += 3) {
+    b[i] = src[0];
+    g[i] = src[1];
+    r[i] = src[2];
+  }
+}
+
+#ifdef CPU_X86
+// Shuffle masks: mask[c][v] moves the bytes of channel c (0 B, 1 G, 2 R)
+// that are in input vector v to their place in the plane's vector, and
+// zeroes the rest. Repeated for each 128-bit lane of the widest vector.
+struct Masks {
+  int8_t mask[3][3][64];
+};
+constexpr Masks MakeMasks() {
+  Masks t{};
+  for (int c = 0; c < 3; c++)
+    for (int v = 0; v < 3; v++)
+      for (int p = 0; p < 64; p++) {
+        const int idx = 3 * (p % 16) + c;
+        t.mask[c][v][p] = idx / 16 == v ? int8_t(idx % 16) : int8_t(-128);
+      }
+  return t;
+}
+inline constexpr Masks masks = MakeMasks();
+
+__attribute__((target("avx512f,avx512bw"))) inline void AVX512(
+    uint8_t *r, uint8_t *g, uint8_t *b, const uint8_t *src, size_t n) {
+  __m512i m[3][3];
+  for (int c = 0; c < 3; c++)
+    for (int v = 0; v < 3; v++) m[c][v] = _mm512_loadu_si512(masks.mask[c][v]);
+  uint8_t *planes[3] = {b, g, r};
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64, src += 192) {
+    __m512i in[3];
+    for (int v = 0; v < 3; v++) {
+      const auto lane = [&](int k) {
+        return _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(src + 48 * k + 16 * v));
+      };
+      in[v] = _mm512_inserti32x4(
+          _mm512_inserti32x4(
+              _mm512_inserti32x4(_mm512_zextsi128_si512(lane(0)), lane(1), 1),
+              lane(2), 2),
+          lane(3), 3);
+    }
+    for (int c = 0; c < 3; c++)
+      _mm512_storeu_si512(
+          planes[c] + i,
+          _mm512_or_si512(_mm512_or_si512(_mm512_shuffle_epi8(in[0], m[c][0]),
+                                          _mm512_shuffle_epi8(in[1], m[c][1])),
+                          _mm512_shuffle_epi8(in[2], m[c][2])));
+  }
+  Scalar(r + i, g + i, b + i, src, n - i);
+}
+
+__attribute__((target("avx2"))) inline void AVX2(uint8_t *r, uint8_t *g,
+                                                 uint8_t *b,
+                                                 const uint8_t *src,
+                                                 size_t n) {
+  __m256i m[3][3];
+  for (int c = 0; c < 3; c++)
+    for (int v = 0; v < 3; v++)
+      m[c][v] = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(masks.mask[c][v]));
+  uint8_t *planes[3] = {b, g, r};
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32, src += 96) {
+    __m256i in[3];
+    for (int v = 0; v < 3; v++)
+      in[v] = _mm256_inserti128_si256(
+          _mm256_castsi128_si256(_mm_loadu_si128(
+              reinterpret_cast<const __m128i *>(src + 16 * v))),
+          _mm_loadu_si128(
+              reinterpret_cast<const __m128i *>(src + 48 + 16 * v)),
+          1);
+    for (int c = 0; c < 3; c++)
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i *>(planes[c] + i),
+          _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(in[0], m[c][0]),
+                                          _mm256_shuffle_epi8(in[1], m[c][1])),
+                          _mm256_shuffle_epi8(in[2], m[c][2])));
+  }
+  Scalar(r + i, g + i, b + i, src, n - i);
+}
+
+__attribute__((target("ssse3"))) inline void SSSE3(uint8_t *r, uint8_t *g,
+                                                   uint8_t *b,
+                                                   const uint8_t *src,
+                                                   size_t n) {
+  __m128i m[3][3];
+  for (int c = 0; c < 3; c++)
+    for (int v = 0; v < 3; v++)
+      m[c][v] = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(masks.mask[c][v]));
+  uint8_t *planes[3] = {b, g, r};
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16, src += 48) {
+    __m128i in[3];
+    for (int v = 0; v < 3; v++)
+      in[v] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16 * v));
+    for (int c = 0; c < 3; c++)
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i *>(planes[c] + i),
+          _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in[0], m[c][0]),
+                                    _mm_shuffle_epi8(in[1], m[c][1])),
+                       _mm_shuffle_epi8(in[2], m[c][2])));
+  }
+  Scalar(r + i, g + i, b + i, src, n - i);
+}
+#endif
+
+#ifdef CPU_NEON
+inline void NEON(uint8_t *r, uint8_t *g, uint8_t *b, const uint8_t *src,
+                 size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16, src += 48) {
+    const uint8x16x3_t bgr = vld3q_u8(src);
+    vst1q_u8(b + i, bgr.val[0]);
+    vst1q_u8(g + i, bgr.val[1]);
+    vst1q_u8(r + i, bgr.val[2]);
+  }
+  Scalar(r + i, g + i, b + i, src, n - i);
+}
+#endif
+
+inline void Kernel(uint8_t *r, uint8_t *g, uint8_t *b, const uint8_t *src,
+                   size_t n) {
+#ifdef CPU_X86
+  if (CpuFeatures::AVX512BW()) return AVX512(r, g, b, src, n);
+  if (CpuFeatures::AVX2()) return AVX2(r, g, b, src, n);
+  if (CpuFeatures::SSSE3()) return SSSE3(r, g, b, src, n);
+#endif
+#ifdef CPU_NEON
+  return NEON(r, g, b, src, n);
+#endif
+  Scalar(r, g, b, src, n);
+}
+
+}  // namespace detail
+
+// Helpers of the capture thread for big frames; a quarter of the cores, up
+// to three, as the recorder and the compression pool need the rest.
+inline WorkerPool &Pool() {
+  static WorkerPool pool(
+      std::min(std::max(std::thread::hardware_concurrency() / 4, 1u), 4u) -
+          1,
+      [] { ThreadProfile::RefreshThread(ThreadProfile::Role::Worker); });
+  return pool;
+}
+
+// Bands smaller than this are not worth handing to another thread.
+constexpr size_t BAND_PIXELS = 256 * 1024;
+
+// Interleaved BGR src of width x height pixels into planar R, G, B at dst.
+// dst and src must not overlap.
+inline void ToPlanar(uint8_t *dst, const uint8_t *src, size_t width,
+                     size_t height, WorkerPool &pool = Pool()) {
+  const size_t pixels = width * height;
+  uint8_t *r = dst, *g = dst + pixels, *b = dst + 2 * pixels;
+  const size_t bands = std::clamp<size_t>(
+      pixels / BAND_PIXELS, 1, std::min<size_t>(pool.size(), height));
+  if (bands == 1) return detail::Kernel(r, g, b, src, pixels);
+  const size_t rows = (height + bands - 1) / bands;
+  pool.run(bands, [&](size_t i) {
+    const size_t first = i * rows * width;
+    const size_t n = std::min(rows * width, pixels - std::min(first, pixels));
+    detail::Kernel(r + first, g + first, b + first, src + 3 * first, n);
+  });
+}
+
+}  // namespace RGB24
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef __SER_CODEC__
+#define __SER_CODEC__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace SER {
+
+//-------------------------------------------------------------------
+// Lossless predictive coder for 8/16-bit mono, Bayer and RGB frames.
+//
+// A frame is cut into horizontal slices that are coded independently, so
+// several threads can work on one frame. Each sample is predicted from its
+// same-colour neighbours (LOCO-I's median edge detector: left, up, up-left;
+// two pixels/rows apart on a Bayer mosaic), and the residual is Rice coded
+// with a parameter picked per block of 32 samples. Trailing zero bits common
+// to the whole slice, such as those of a 12-bit ADC in a 16-bit container,
+// are shifted out first. Dark, noisy sky costs a few bits per sample instead
+// of 16.
+//
+// Slice: u8 shift, 3 reserved, then the bit stream (MSB first): per block
+// 5 bits of k, then per sample q ones, a zero and k low bits, where q is
+// residual >> k; q >= ESCAPE is sent as ESCAPE ones and the raw residual.
+//-------------------------------------------------------------------
+struct CodecLayout {
+  uint32_t width = 0;   // pixels
+  uint32_t height = 0;  // rows
+  uint32_t planes = 1;  // interleaved samples per pixel (3 for RGB)
+  uint32_t bytes = 1;   // per sample, 1 or 2
+  bool bayer = false;   // colour mosaic: same colour is 2 pixels/rows away
+
+  size_t row_samples() const { return size_t(width) * planes; }
+  size_t frame_bytes() const { return row_samples() * height * bytes; }
+  // Rows [first, first + count) of slice s out of n.
+  void slice_rows(uint32_t s, uint32_t n, uint32_t &first,
+                  uint32_t &count) const {
+    const uint32_t per = (height + n - 1) / n;
+    first = std::min(height, s * per);
+    count = std::min(height - first, per);
+  }
+};
+
+class SliceCodec {
+ public:
+  static constexpr uint32_t BLOCK = 32;
+  static constexpr uint32_t ESCAPE = 20;
+  static constexpr size_t HEADER = 4;
+
+  // Most bytes Encode() can produce for that many rows.
+  static size_t MaxEncoded(const CodecLayout &l, uint32_t rows) {
+    const size_t n = size_t(rows) * l.row_samples();
+    return HEADER + (n * (ESCAPE + 8 * l.bytes) + (n / BLOCK + 1) * 5) / 8 + 8;
+  }
+  // Codes rows [row0, row0 + rows) of frame into out, which must hold
+  // MaxEncoded(l, rows) bytes; returns the number of bytes used.
+  static size_t Encode(const CodecLayout &l, const uint8_t *frame,
+                       uint32_t row0, uint32_t rows, uint8_t *out) {
+    if (l.bytes == 2)
+      return EncodeT<uint16_t>(l, reinterpret_cast<const uint16_t *>(frame),
+                               row0, rows, out);
+    return EncodeT<uint8_t>(l, frame, row0, rows, out);
+  }
+  // Decodes a slice made by Encode() back into frame; false if it is damaged.
+  static bool Decode(const CodecLayout &l, const uint8_t *in, size_t len,
+                     uint8_t *frame, uint32_t row0, uint32_t rows) {
+    if (l.bytes == 2)
+      return DecodeT<uint16_t>(l, in, len,
+                               reinterpret_cast<uint16_t *>(frame), row0,
+                               rows);
+    return DecodeT<uint8_t>(l, in, len, frame, row0, rows);
+  }
+
+ private:
+  // Bit writer into a buffer sized for the worst case up front.
+  struct BitWriter {
+    uint8_t *p;
+    uint64_t acc = 0;
+    int n = 0;  // bits in acc
+    explicit BitWriter(uint8_t *_p) : p(_p) {}
+    void put(uint32_t v, int bits) {  // bits <= 32
+      acc = (acc << bits) | v;
+      n += bits;
+      if (n >= 32) {
+        n -= 32;
+        const uint32_t w = uint32_t(acc >> n);
+        p[0] = w >> 24;
+        p[1] = w >> 16;
+        p[2] = w >> 8;
+        p[3] = w;
+        p += 4;
+      }
+    }
+    uint8_t *flush() {
+      while (n > 0) {
+        const int s = std::max(n - 8, 0);
+        *p++ = uint8_t(acc >> s << (8 - (n - s)));
+        n = s;
+      }
+      return p;
+    }
+  };
+  // Bit reader. Past the end it reads zeros and counts them in pad.
+  struct BitReader {
+    const uint8_t *p, *end;
+    uint64_t buf = 0;  // left aligned
+    int avail = 0;
+    uint64_t pad = 0;
+    BitReader(const uint8_t *_p, const uint8_t *_end) : p(_p), end(_end) {}
+    void refill() {  // to at least 57 bits
+      if (avail > 56) return;
+      if (end - p >= 8) {
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        buf |= __builtin_bswap64(w) >> avail;
+        const int bytes = (63 - avail) >> 3;
+        p += bytes;
+        avail += bytes * 8;
+        return;
+      }
+      while (avail <= 56) {
+        if (p < end)
+          buf |= uint64_t(*p++) << (56 - avail);
+        else
+          pad += 8;
+        avail += 8;
+      }
+    }
+    uint32_t ones() const {
+      const uint64_t inv = ~buf;
+      return inv ? __builtin_clzll(inv) : 64;
+    }
+    void skip(int bits) {
+      buf = bits < 64 ? buf << bits : 0;
+      avail -= bits;
+    }
+    uint32_t get(int bits) {
+      if (bits == 0) return 0;
+      const uint32_t v = uint32_t(buf >> (64 - bits));
+      skip(bits);
+      return v;
+    }
+    // True if more was read than the stream holds.
+    bool overrun() const { return pad > uint64_t(avail); }
+  };
+
+  // Residuals of one row, zigzagged so small |e| is small. The prediction is
+  // LOCO-I's median edge detector on the same-colour neighbours a (left),
+  // b (up) and c (up-left), i.e. the median of a, b and a + b - c; the first
+  // row(s) of a slice use the left neighbour only, the first column(s) the
+  // one above. Samples are shifted right by shift first.
+  template <typename T>
+  static void Residuals(const T *row, const T *up, size_t rs, size_t hstep,
+                        int shift, uint32_t *res) {
+    constexpr int BITS = sizeof(T) * 8;
+    constexpr uint32_t MASK = (1u << BITS) - 1;
+    auto zigzag = [](int v, int p) {
+      // sign-extend the BITS-bit difference, then zigzag it
+      const int e = int(uint32_t(v - p) << (32 - BITS)) >> (32 - BITS);
+      return ((uint32_t(e) << 1) ^ uint32_t(e >> 31)) & MASK;
+    };
+    const size_t h = std::min(hstep, rs);
+    for (size_t x = 0; x < h; x++)
+      res[x] = zigzag(row[x] >> shift, up ? up[x] >> shift : 0);
+    if (up == nullptr) {
+      for (size_t x = h; x < rs; x++)
+        res[x] = zigzag(row[x] >> shift, row[x - hstep] >> shift);
+      return;
+    }
+    // The hot loop; plain enough for the compiler to vectorise.
+    for (size_t x = h; x < rs; x++) {
+      const int a = row[x - hstep] >> shift, b = up[x] >> shift,
+                c = up[x - hstep] >> shift;
+      const int lo = std::min(a, b), hi = std::max(a, b);
+      res[x] = zigzag(row[x] >> shift, std::min(std::max(a + b - c, lo), hi));
+    }
+  }
+
+  template <typename T>
+  static size_t EncodeT(const CodecLayout &l, const T *frame, uint32_t row0,
+                        uint32_t rows, uint8_t *out) {
+    constexpr int BITS = sizeof(T) * 8;
+    const size_t rs = l.row_samples();
+    const size_t hstep = l.bayer ? 2 : l.planes;
+    const uint32_t vstep = l.bayer ? 2 : 1;
+    const T *px = frame + size_t(row0) * rs;
+    const size_t n = size_t(rows) * rs;
+
+    T bits = 0;
+    for (size_t i = 0; i < n; i++) bits |= px[i];
+    const int shift = bits ? std::min(__builtin_ctz(bits), BITS - 1) : 0;
+
+    out[0] = uint8_t(shift);
+    out[1] = out[2] = out[3] = 0;
+    BitWriter bw(out + HEADER);
+
+    // Residuals of the current row plus what is left of the last block.
+    std::vector<uint32_t> res(rs + BLOCK);
+    size_t carry = 0;
+    auto code_block = [&](const uint32_t *r, uint32_t count) {
+      uint32_t sum = 0;
+      for (uint32_t i = 0; i < count; i++) sum += r[i];
+      const uint32_t mean = sum / count;
+      const int k = mean > 1 ? std::min(31 - __builtin_clz(mean), BITS) : 0;
+      bw.put(k, 5);
+      for (uint32_t i = 0; i < count; i++) {
+        const uint32_t q = r[i] >> k;
+        if (q < ESCAPE) {
+          const uint32_t unary = ((1u << q) - 1) << 1;
+          if (q + 1 + k <= 32)
+            bw.put((unary << k) | (r[i] & ((1u << k) - 1)), q + 1 + k);
+          else {
+            bw.put(unary, q + 1);
+            bw.put(r[i] & ((1u << k) - 1), k);
+          }
+        } else {
+          bw.put((1u << ESCAPE) - 1, ESCAPE);
+          bw.put(r[i], BITS);
+        }
+      }
+    };
+    for (uint32_t y = 0; y < rows; y++) {
+      const T *row = px + size_t(y) * rs;
+      Residuals(row, y >= vstep ? row - rs * vstep : nullptr, rs, hstep,
+                shift, res.data() + carry);
+      const size_t avail = carry + rs;
+      size_t i = 0;
+      for (; i + BLOCK <= avail; i += BLOCK) code_block(res.data() + i, BLOCK);
+      carry = avail - i;
+      std::memmove(res.data(), res.data() + i, carry * sizeof(uint32_t));
+    }
+    if (carry) code_block(res.data(), carry);
+    return bw.flush() - out;
+  }
+
+  template <typename T>
+  static bool DecodeT(const CodecLayout &l, const uint8_t *in, size_t len,
+                      T *frame, uint32_t row0, uint32_t rows) {
+    constexpr int BITS = sizeof(T) * 8;
+    if (len < HEADER || in[0] >= BITS) return false;
+    const int shift = in[0];
+    const size_t rs = l.row_samples();
+    const size_t hstep = l.bayer ? 2 : l.planes;
+    const uint32_t vstep = l.bayer ? 2 : 1;
+    T *px = frame + size_t(row0) * rs;
+    BitReader br(in + HEADER, in + len);
+    std::vector<uint32_t> res(rs);
+
+    uint32_t left_in_block = 0;
+    int k = 0;
+    for (uint32_t y = 0; y < rows; y++) {
+      for (size_t x = 0; x < rs; x++) {
+        br.refill();
+        if (left_in_block == 0) {
+          k = int(br.get(5));
+          if (k > BITS) return false;
+          left_in_block = BLOCK;
+        }
+        left_in_block--;
+        const uint32_t q = br.ones();
+        if (q < ESCAPE) {
+          br.skip(q + 1);
+          res[x] = (q << k) | br.get(k);
+        } else {
+          br.skip(ESCAPE);
+          res[x] = br.get(BITS);
+        }
+      }
+      // Undo the prediction; the slice holds shifted samples until the end.
+      T *row = px + size_t(y) * rs;
+      const T *up = y >= vstep ? row - rs * vstep : nullptr;
+      auto unzigzag = [](uint32_t r) { return T((r >> 1) ^ (0u - (r & 1))); };
+      const size_t h = std::min(hstep, rs);
+      for (size_t x = 0; x < h; x++)
+        row[x] = T((up ? up[x] : 0) + unzigzag(res[x]));
+      if (up == nullptr) {
+        for (size_t x = h; x < rs; x++)
+          row[x] = T(row[x - hstep] + unzigzag(res[x]));
+        continue;
+      }
+      for (size_t x = h; x < rs; x++) {
+        const int a = row[x - hstep], b = up[x], c = up[x - hstep];
+        const int lo = std::min(a, b), hi = std::max(a, b);
+        row[x] = T(std::min(std::max(a + b - c, lo), hi) + unzigzag(res[x]));
+      }
+    }
+    if (shift) {
+      const size_t n = size_t(rows) * rs;
+      for (size_t i = 0; i < n; i++) px[i] = T(px[i] << shift);
+    }
+    return !br.overrun();
+  }
+};
+
+}  // namespace SER
+
+#endif
@@ -0,0 +1,377 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "SERProcessor.hpp"
+#include "camera_base.hpp"
+#include "hello_imgui/hello_imgui.h"
+#include "timer.hpp"
+
+// How a recording is paced when it is played back.
+enum class PlaybackTiming {
+  Original,          // the intervals in the SER trailer
+  FixedFps,          // PlaybackCamera::fps frames a second
+  AsFastAsPossible,  // as fast as the disk and the ring take them
+};
+
+//-------------------------------------------------------------------
+// A recorded SER file played back as a camera. Frames go into the
+// streamingFrames ring the way a live capture puts them there, so preview,
+// trigger and recorder run on real data on a machine with no camera
+// attached, at the original pace or faster.
+//
+// The ring holds what was recorded, byte for byte: 16-bit samples are
+// brought to host order, nothing else is converted. Frames are stamped
+// with the time they are published, as a live camera would stamp them.
+//-------------------------------------------------------------------
+class SERPlaybackCamera : public CameraBase {
+ public:
+  SERPlaybackCamera() : CameraBase("SER") {
+    mCameraName = "SER playback";
+    mCameraInfo = ASI_CAMERA_INFO();
+  }
+  ~SERPlaybackCamera() { Disconnect(); }
+
+  // These may be changed while playing; the next frame picks them up.
+  std::atomic<PlaybackTiming> timing = PlaybackTiming::Original;
+  std::atomic<float> fps = 30;  // FixedFps, and Original without a trailer
+  std::atomic_bool loop = true;
+
+  // Takes effect on the next Connect().
+  bool SetFile(const std::string &fn) {
+    if (is_connected) {
+      spdlog::error("Disconnect before choosing another recording");
+      return false;
+    }
+    mFilename = fn;
+    return true;
+  }
+  const std::string &getFile() const { return mFilename; }
+  // Whether uiLittleEndian in the file follows the spec, as SER files we
+  // write do by default; see SERHeader. Takes effect on the next Connect().
+  bool spec_byte_order = true;
+
+  bool Connect() {
+    if (mFilename.empty()) {
+      spdlog::critical("No recording selected for playback");
+      return false;
+    }
+    spdlog::info("Attempting to open {}...", mFilename);
+    reader = std::make_unique<SER::SERReader>(mFilename, spec_byte_order);
+    if (!reader->SEROpenMovie() || reader->Header().uiFrameCount == 0) {
+      spdlog::critical("Failed to open {} for playback", mFilename);
+      reader.reset();
+      return false;
+    }
+    reader->SERSetHostOrder(true);
+    if (!DescribeRecording()) {
+      reader.reset();
+      return false;
+    }
+    stillFrame.buffer = std::make_unique<uint8_t[]>(nFrameBytes);
+    mStillIndex = 0;
+    is_connected = true;
+    spdlog::info("Playing back {} frames of {}", reader->Header().uiFrameCount,
+                 mFilename);
+    return true;
+  }
+  bool Disconnect() {
+    if (!is_connected) return true;
+    if (is_running) {
+      AbortExposure();
+      for (int i = 0; i < 100 && is_running; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (is_running) {
+      spdlog::critical("Playback of {} did not stop", mFilename);
+      return false;
+    }
+    reader.reset();
+    is_connected = false;
+    spdlog::info("Playback closed.");
+    return true;
+  }
+  // A recording has no controls; its frame interval shows up as a read-only
+  // exposure, which is also what the still progress bar reads.
+  bool CreateControls() {
+    mControlCaps.assign(1, CONTROL_CAPS_CAST());
+    CONTROL_CAPS_CAST &expo = mControlCaps[0];
+    snprintf(expo.Name, sizeof(expo.Name), "Exposure");
+    snprintf(expo.Description, sizeof(expo.Description),
+             "Frame interval of the recording (ms)");
+    const double median = reader->TimingStats().median_interval;
+    expo.current_value =
+        std::max<long>(median > 0 ? long(median * 1000 + 0.5) : 0, 1);
+    expo.MinValue = expo.MaxValue = expo.DefaultValue = expo.current_value;
+    expo.IsAutoSupported = ASI_FALSE;
+    expo.IsWritable = ASI_FALSE;
+    expo.ControlType = ASI_EXPOSURE;
+    mExposureCap = &expo;
+    mGainCap = nullptr;
+    return true;
+  }
+  bool RetrieveControls(bool is_create = false) {
+    (void)is_create;
+    return true;
+  }
+  bool UpdateControls() { return true; }
+  bool SetCCDBin(uint8_t bin) {
+    if (bin == 1) return true;
+    spdlog::critical("Invalid bin request : {}", bin);
+    return false;
+  }
+  void AbortExposure() {
+    if (!is_running) {
+      spdlog::warn("Camera not runing...");
+    }
+    do_abort = true;
+    spdlog::debug("Aaborted signal submitted...");
+  }
+
+  void DoVCaptureHelper(size_t _size = 1 * 1024) {
+    max_buffer_size = _size;
+    std::thread([this] {
+      ThreadProfile::Apply(ThreadProfile::Role::Capture);
+      DoVideoCapture();
+    }).detach();
+    HelloImGui::Log(HelloImGui::LogLevel::Debug,
+                    "DoVideoCapture command issued %d.", max_buffer_size);
+  }
+  void DoCaptureHelper() {
+    std::thread([this] {
+      ThreadProfile::Apply(ThreadProfile::Role::Capture);
+      DoCapture();
+    }).detach();
+    HelloImGui::Log(HelloImGui::LogLevel::Debug, "DoCapture command issued.");
+  }
+
+  bool DoVideoCapture() {
+    if (is_running || !is_connected) {
+      spdlog::debug("camera is busy IsRunning: {} IsConnected: {}",
+                    is_running, is_connected);
+      HelloImGui::Log(HelloImGui::LogLevel::Error, "camera is busy");
+      return false;
+    }
+    streamingFrames.buffer.reset();
+    streamingFrames.buffer = std::make_shared<Circular_Buffer<uint8_t>>(
+        std::max<size_t>(max_buffer_size * 1024 * 1024 / nFrameBytes, 2),
+        nFrameBytes);
+    Stats().diag.start(*streamingFrames.buffer);
+    streamingFrames.size = nFrameBytes;
+    streamingFrames.ch = stillFrame.ch;
+    streamingFrames.byte_channel = stillFrame.byte_channel;
+    streamingFrames.format = stillFrame.format;
+    streamingFrames.currentFormat = mCurrentStillFormat;
+    streamingFrames.adc_bits = mCameraInfo.BitDepth;
+    streamingFrames.dim = stillFrame.dim;
+    spdlog::info("Started playback {} MB", max_buffer_size);
+    HelloImGui::Log(HelloImGui::LogLevel::Debug, "Started playback");
+    is_still = false;
+    is_running = true;
+    m_dropped_frames = 0;
+    streamingFrames.is_active = true;
+
+    Timer escaped;
+    Timer timer;
+    escaped.Start();
+    timer.Start();
+    size_t count = 0;
+    const uint32_t expoUs = uint32_t(mExposureCap->current_value * 1000);
+    // Publication deadline of the next frame, CLOCK_MONOTONIC.
+    uint64_t due = monotonic_ns();
+    bool ok = true;
+    while (ok) {
+      auto stream = reader->SERStream();
+      if (stream->Failed()) {
+        spdlog::critical("Playback of {} failed", mFilename);
+        ok = false;
+        break;
+      }
+      SER::SERFrameView v;
+      uint64_t prev_utc = 0;
+      while (stream->Next(v)) {
+        due += Interval(v.utc_ns, prev_utc);
+        prev_utc = v.utc_ns;
+        // Running late, e.g. the ring blocked: carry on from now rather
+        // than catching up in a burst.
+        const uint64_t now = monotonic_ns();
+        if (now > due + 1000000000ull) due = now;
+        if (!sleep_until_ns(due, do_abort)) break;
+
+        if (timer.Finish() > 500) {
+          m_fps = float(count) * 1000. / float(timer.Finish());
+          m_vc_escape = escaped.Finish();
+          timer.Start();
+          spdlog::debug("Playing at {} fps", m_fps);
+          Stats().update(m_fps, *streamingFrames.buffer,
+                         streamingFrames.overflow_policy);
+          count = 0;
+        }
+        uint8_t *targetFrame = streamingFrames.buffer->claim(
+            streamingFrames.overflow_policy, streamingFrames.block_timeout_ms);
+        if (targetFrame == nullptr) {
+          streamingFrames.buffer->mark_dropped();
+          continue;
+        }
+        std::memcpy(targetFrame, v.data, nFrameBytes);
+        FrameMeta &meta = streamingFrames.buffer->claimed_meta();
+        meta.capture_ns = monotonic_ns();
+        meta.utc_ns = realtime_ns();
+        meta.exposure_us = expoUs;
+        meta.ring_dropped =
+            streamingFrames.buffer->get_counters().dropped.load(
+                std::memory_order_relaxed);
+        streamingFrames.buffer->commit();
+        count++;
+      }
+      if (stream->Failed()) {
+        spdlog::critical("Playback of {} failed", mFilename);
+        ok = false;
+      }
+      if (do_abort || !loop) break;
+    }
+    if (do_abort) {
+      spdlog::info("aborting .");
+      is_running = false;
+      do_abort = false;
+      streamingFrames.do_record = false;
+      streamingFrames.is_active = false;
+      spdlog::info("Exiting {}.", __func__);
+      return ok;
+    }
+    spdlog::info("Playback completed .");
+    is_running = false;
+    streamingFrames.do_record = false;
+    while (streamingFrames.is_recording)
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    streamingFrames.is_active = false;
+    return ok;
+  }
+
+  // A still is the next frame of the recording, in turn.
+  bool DoCapture() {
+    if (is_running || !is_connected) {
+      spdlog::debug("camera is busy IsRunning: {} IsConnected: {}",
+                    is_running, is_connected);
+      HelloImGui::Log(HelloImGui::LogLevel::Error, "camera is busy");
+      return false;
+    }
+    is_running = true;
+    is_still = true;
+    m_expo_escape = 0;
+    auto stream = reader->SERStream(mStillIndex, 1, 1);
+    SER::SERFrameView v;
+    std::lock_guard<std::mutex> lock(stillFrame.mutex);
+    if (!stream->Next(v)) {
+      spdlog::critical("Failed to read frame {} of {}", mStillIndex,
+                       mFilename);
+      is_running = false;
+      return false;
+    }
+    std::memcpy(stillFrame.buffer.get(), v.data, nFrameBytes);
+    stillFrame.currentFormat = mCurrentStillFormat;
+    mStillIndex = (mStillIndex + 1) % reader->Header().uiFrameCount;
+    stillFrame.is_new = true;
+    is_running = false;
+    return true;
+  }
+
+ private:
+  std::string mFilename;
+  std::unique_ptr<SER::SERReader> reader;
+  size_t nFrameBytes = 0;
+  uint32_t mStillIndex = 0;
+
+  // Camera info, frame geometry and layout of the recording, as a ZWO
+  // camera with that sensor would report them.
+  bool DescribeRecording() {
+    const SER::SERHeader &h = reader->Header();
+    const size_t ch = h.uiColorID >= SER::COLOR_RGB ? 3 : 1;
+    const size_t bc = SER::SERSampleBytes(h);
+    nFrameBytes = size_t(h.uiImageWidth) * h.uiImageHeight * ch * bc;
+    if (nFrameBytes == 0) {
+      spdlog::critical("{} has empty frames", mFilename);
+      return false;
+    }
+    ASI_IMG_TYPE fmt = bc == 2 ? ASI_IMG_RAW16 : ASI_IMG_RAW8;
+    if (ch == 3) fmt = ASI_IMG_RGB24;
+    mCameraInfo = ASI_CAMERA_INFO();
+    snprintf(mCameraInfo.Name, sizeof(mCameraInfo.Name), "SER playback");
+    mCameraInfo.CameraID = -1;
+    mCameraInfo.MaxHeight = h.uiImageHeight;
+    mCameraInfo.MaxWidth = h.uiImageWidth;
+    mCameraInfo.IsColorCam = h.uiColorID == SER::COLOR_MONO ? ASI_FALSE
+                                                            : ASI_TRUE;
+    switch (h.uiColorID) {
+      case SER::COLOR_BAYER_BGGR:
+        mCameraInfo.BayerPattern = ASI_BAYER_BG;
+        break;
+      case SER::COLOR_BAYER_GRBG:
+        mCameraInfo.BayerPattern = ASI_BAYER_GR;
+        break;
+      case SER::COLOR_BAYER_GBRG:
+        mCameraInfo.BayerPattern = ASI_BAYER_GB;
+        break;
+      default:
+        mCameraInfo.BayerPattern = ASI_BAYER_RG;
+    }
+    mCameraInfo.SupportedBins[0] = 1;
+    mCameraInfo.SupportedVideoFormat[0] = fmt;
+    mCameraInfo.SupportedVideoFormat[1] = ASI_IMG_END;
+    // Older recordings of this app have the depth summed over the planes.
+    const int depth =
+        int(h.uiPixelDepth > 16 ? h.uiPixelDepth / ch : h.uiPixelDepth);
+    mCameraInfo.BitDepth = bc == 2 ? std::min(depth, 16) : 8;
+
+    const long dims[2] = {long(h.uiImageHeight), long(h.uiImageWidth)};
+    for (size_t i = 0; i < 2; i++) {
+      m_frame[i].MaxValue = m_frame[i].MinValue = dims[i];
+      m_frame[i].DefaultValue = m_frame[i].CurrentValue = dims[i];
+      m_frame[i].BinnedValue = dims[i];
+      m_frame[i].AxisOffset = m_frame[i].BinndedAxisOffset = 0;
+      m_frame[i].Bin = 1;
+    }
+    m_supportedFormat = {fmt};
+    m_supportedFormat_str = {ASIHelpers::toPrettyString(fmt)};
+    m_supportedBin = {"1"};
+    BinNumber = 1;
+    mCurrentStillFormat = fmt;
+
+    stillFrame.size = nFrameBytes;
+    stillFrame.ch = ch;
+    stillFrame.byte_channel = bc;
+    stillFrame.format = SER::BAYER(h.uiColorID);
+    stillFrame.dim = {h.uiImageHeight, h.uiImageWidth, ch};
+    return true;
+  }
+
+  // Time from the previous frame to one stamped utc_ns (0 if it has no
+  // stamp; prev_utc is 0 for the first frame of a pass), in ns.
+  uint64_t Interval(uint64_t utc_ns, uint64_t prev_utc) const {
+    switch (timing.load()) {
+      case PlaybackTiming::AsFastAsPossible:
+        return 0;
+      case PlaybackTiming::Original:
+        // Without a trailer this falls back to fps.
+        if (utc_ns == 0) break;
+        // First frame of a pass: the usual interval of the recording.
+        if (prev_utc == 0)
+          return uint64_t(mExposureCap->current_value) * 1000000;
+        // Out of order stamps play back to back; a long pause in the
+        // recording is cut to 10 s.
+        if (utc_ns <= prev_utc) return 0;
+        return std::min<uint64_t>(utc_ns - prev_utc, 10000000000ull);
+      case PlaybackTiming::FixedFps:
+        break;
+    }
+    return uint64_t(1e9 / std::max(fps.load(), 0.01f));
+  }
+};
@@ -0,0 +1,348 @@
+#ifndef __SPILL_TIER__
+#define __SPILL_TIER__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "circular_buffer.hpp"
+
+struct SpillStats {
+  size_t depth = 0;     // frames waiting in the scratch file
+  size_t capacity = 0;  // frames the scratch file can hold
+  uint64_t spilled = 0;
+  uint64_t drained = 0;
+  uint64_t lost = 0;  // frames reclaimed by OverwriteOldest before we got them
+  bool spilling = false;
+};
+
+//-------------------------------------------------------------------
+// Disk-backed second tier behind the streaming ring.
+//
+// Owns one lossless reader on the ring and hands its frames to the recorder
+// in order. While the frames held for that reader stay below the high-water
+// mark the recorder gets them in place, as before. Once they cross it, a
+// spill thread copies the oldest frames nobody holds yet into a preallocated,
+// memory-mapped scratch file and gives their slots back to the capture
+// thread, until occupancy is down to half the high-water mark. The recorder
+// always drains the scratch file before it takes ring frames again, so the
+// output stays in sequence order.
+//
+// Slow writes are absorbed up to the scratch file's size. A single write that
+// stalls keeps its own frame pinned in the ring, so one stall is still bounded
+// by the ring size; frames are never copied when the recorder keeps up.
+//
+// The scratch file is unlinked as soon as it is mapped, so nothing is left
+// behind if the process dies. max_mb == 0 gives a plain pass-through.
+//
+// Recorder:
+//   SpillTier::Frame f;
+//   tier.wait(100);
+//   if (tier.acquire(f)) { write(f.data, f.meta); tier.release(); }
+//-------------------------------------------------------------------
+class SpillTier {
+ public:
+  using Ring = Circular_Buffer<uint8_t>;
+
+  // A frame handed to the recorder. data points into the ring or into the
+  // scratch file and stays valid until the matching release().
+  struct Frame {
+    const uint8_t* data = nullptr;
+    FrameMeta meta;
+    bool spilled = false;
+  };
+
+  SpillTier(std::shared_ptr<Ring> _ring, int _reader,
+            const std::string& directory, size_t max_mb, float high_water)
+      : ring(_ring),
+        reader(_reader),
+        frame_bytes(_ring->frame_size()),
+        stride(round_up(_ring->frame_size(), FrameSlab::SLOT_ALIGN)) {
+    high = std::max<size_t>(size_t(ring->capacity() * high_water), 1);
+    low = high / 2;
+    ring_next = ring->cursor(reader);
+    if (max_mb == 0) return;
+
+    nslots = max_mb * 1024 * 1024 / stride;
+    if (nslots == 0) {
+      spdlog::error("Spill file of {} MB cannot hold one {} byte frame",
+                    max_mb, frame_bytes);
+      return;
+    }
+    // One per recording, and several cameras may record at once.
+    static std::atomic<unsigned> files = 0;
+    const std::string path = directory + "/.astrocapture-spill-" +
+                             std::to_string(getpid()) + "-" +
+                             std::to_string(files++) + ".tmp";
+    const size_t size = nslots * stride;
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+      spdlog::critical("Failed to create spill file {}: {}", path,
+                       std::strerror(errno));
+      nslots = 0;
+      return;
+    }
+    int err = posix_fallocate(fd, 0, size);
+    if (err == 0) {
+      void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (p != MAP_FAILED) base = static_cast<uint8_t*>(p);
+      else err = errno;
+    }
+    unlink(path.c_str());
+    if (base == nullptr) {
+      spdlog::critical("Failed to reserve {} MB spill file in {}: {}",
+                       size / 1024 / 1024, directory, std::strerror(err));
+      close(fd);
+      fd = -1;
+      nslots = 0;
+      return;
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+    metas.resize(nslots);
+    ahead = std::clamp<size_t>(PREFAULT_BYTES / stride, 2, nslots);
+    spdlog::info(
+        "Spill file: {} frames ({} MB) in {}, spilling above {}/{} ring "
+        "frames",
+        nslots, size / 1024 / 1024, directory, high, ring->capacity());
+    spiller = std::thread(&SpillTier::SpillLoop, this);
+  }
+
+  ~SpillTier() {
+    stop = true;
+    if (spiller.joinable()) spiller.join();
+    if (base != nullptr) munmap(base, nslots * stride);
+    if (fd >= 0) close(fd);
+    if (nslots)
+      spdlog::info("Spill file released: {} frames spilled, {} drained",
+                   spilled, drained);
+  }
+
+  // Recorder: the next frame in sequence order, false if there is none yet.
+  // May be called again before release() to hold several frames.
+  bool acquire(Frame& f) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spill_read < spill_tail) {
+      const size_t idx = spill_read++ % nslots;
+      held.push_back({true, idx});
+      f.data = base + idx * stride;
+      f.meta = metas[idx];
+      f.spilled = true;
+      return true;
+    }
+    // A frame that is still being copied out comes before ring_next.
+    if (copying != NO_SEQ) return false;
+    const uint8_t* src = next_from_ring();
+    if (src == nullptr) return false;
+    held.push_back({false, ring_next});
+    f.data = src;
+    f.meta = ring->meta(src);
+    f.spilled = false;
+    ring_next++;
+    return true;
+  }
+  // Recorder: hand back the oldest frame from acquire(). Returns false if
+  // OverwriteOldest reclaimed an in-place frame while it was being used.
+  bool release() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (held.empty()) return true;
+    const Held h = held.front();
+    held.pop_front();
+    bool ok = true;
+    if (h.spilled) {
+      // Already on disk or about to be; drop it from the page cache.
+      madvise(base + h.value * stride, stride, MADV_DONTNEED);
+      posix_fadvise(fd, h.value * stride, stride, POSIX_FADV_DONTNEED);
+      spill_head++;
+      drained++;
+    } else {
+      ok = ring->intact(h.value);
+    }
+    update_cursor();
+    return ok;
+  }
+
+  // Recorder: block until acquire() may have a frame, or timeout_ms passed.
+  // Returns false on timeout. The capture thread wakes it on commit.
+  bool wait(uint32_t timeout_ms) {
+    uint64_t next;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (spill_read < spill_tail) return true;
+      if (copying != NO_SEQ) {
+        // the spill thread is one memcpy away from publishing it
+        next = NO_SEQ;
+      } else {
+        next = ring_next;
+      }
+    }
+    if (next == NO_SEQ) {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      return true;
+    }
+    return ring->wait_committed(next, timeout_ms);
+  }
+
+  SpillStats stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    SpillStats s;
+    s.depth = spill_tail - spill_head;
+    s.capacity = nslots;
+    s.spilled = spilled;
+    s.drained = drained;
+    s.lost = lost;
+    s.spilling = spilling;
+    return s;
+  }
+
+ private:
+  static constexpr uint64_t NO_SEQ = UINT64_MAX;
+  static constexpr size_t PREFAULT_BYTES = 64 * 1024 * 1024;
+
+  // A frame the recorder holds: a scratch slot, or a ring sequence number.
+  struct Held {
+    bool spilled;
+    uint64_t value;
+  };
+
+  static size_t round_up(size_t v, size_t a) { return (v + a - 1) / a * a; }
+
+  // Caller holds the mutex. Skips frames OverwriteOldest already reclaimed.
+  const uint8_t* next_from_ring() {
+    const uint8_t* src = ring->peek(reader, ring_next);
+    if (src == nullptr && ring_next < ring->committed() &&
+        !ring->intact(ring_next)) {
+      const uint64_t o = ring->oldest();
+      ring->mark_overwritten(o - ring_next);
+      lost += o - ring_next;
+      ring_next = o;
+      src = ring->peek(reader, ring_next);
+    }
+    return src;
+  }
+  // Caller holds the mutex. Everything before the oldest frame still in use
+  // goes back to the producer.
+  void update_cursor() {
+    uint64_t c = std::min(ring_next, copying);
+    for (const Held& h : held)
+      if (!h.spilled) {
+        c = std::min(c, h.value);
+        break;
+      }
+    ring->advance(reader, c);
+  }
+
+  // Fault in the next free scratch slot, so the first frames of a spill are a
+  // plain memcpy instead of page faults and block allocation on the scratch
+  // disk. Returns false once `ahead` free slots are ready.
+  bool prefault() {
+    size_t idx;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      prefaulted = std::max(prefaulted, spill_tail);
+      if (prefaulted >= spill_tail + ahead || prefaulted >= spill_head + nslots)
+        return false;
+      idx = prefaulted++ % nslots;
+    }
+    // Free slots are only touched by this thread.
+    uint8_t* p = base + idx * stride;
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(p, stride, MADV_POPULATE_WRITE) == 0) return true;
+#endif
+    for (size_t i = 0; i < stride; i += 4096) p[i] = 0;
+    return true;
+  }
+
+  void SpillLoop() {
+    spdlog::info("Spill thread started");
+    while (!stop) {
+      const uint8_t* src = nullptr;
+      uint64_t seq = 0;
+      size_t idx = 0;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        const uint64_t pending = ring->committed() - ring->cursor(reader);
+        if (!spilling && pending >= high) {
+          spilling = true;
+          spdlog::warn("Recorder is {} frames behind, spilling to disk",
+                       pending);
+        } else if (spilling && pending <= low) {
+          spilling = false;
+          spdlog::info("Recorder caught up, {} frames left on disk",
+                       spill_tail - spill_head);
+        }
+        if (spilling && spill_tail - spill_head < nslots &&
+            (src = next_from_ring()) != nullptr) {
+          seq = ring_next++;
+          copying = seq;
+          idx = spill_tail % nslots;
+        }
+      }
+      if (src == nullptr) {
+        if (!prefault()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
+      }
+      // The slot is ours until spill_tail moves, and the ring cannot reuse
+      // seq while copying holds the cursor back.
+      std::memcpy(base + idx * stride, src, frame_bytes);
+      const FrameMeta m = ring->meta(src);
+      sync_file_range(fd, idx * stride, stride, SYNC_FILE_RANGE_WRITE);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (ring->intact(seq)) {
+        metas[idx] = m;
+        spill_tail++;
+        spilled++;
+      } else {
+        ring->mark_overwritten(1);
+        lost++;
+      }
+      copying = NO_SEQ;
+      update_cursor();
+    }
+  }
+
+  std::shared_ptr<Ring> ring;
+  const int reader;
+  const size_t frame_bytes;
+  const size_t stride;
+  size_t high = 1;
+  size_t low = 0;
+
+  // Scratch file; slot i of the FIFO is at base + i * stride.
+  int fd = -1;
+  uint8_t* base = nullptr;
+  size_t nslots = 0;
+  size_t ahead = 0;  // free slots kept faulted in
+  std::vector<FrameMeta> metas;
+
+  std::mutex mutex;  // guards everything below
+  uint64_t ring_next = 0;      // next ring frame nobody has taken yet
+  uint64_t copying = NO_SEQ;   // ring frame being spilled right now
+  std::deque<Held> held;       // frames the recorder holds, oldest first
+  uint64_t spill_head = 0;     // oldest scratch entry not yet released
+  uint64_t spill_read = 0;     // next scratch entry for the recorder
+  uint64_t spill_tail = 0;     // next scratch entry to fill
+  uint64_t prefaulted = 0;     // scratch entries faulted in ahead of tail
+  uint64_t spilled = 0;
+  uint64_t drained = 0;
+  uint64_t lost = 0;
+  bool spilling = false;
+
+  std::atomic_bool stop = false;
+  std::thread spiller;
+};
+
+#endif
@@ -0,0 +1,422 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "camera_base.hpp"
+#include "hello_imgui/hello_imgui.h"
+#include "synthetic_frames.hpp"
+#include "timer.hpp"
+
+// Sensor a SyntheticCamera pretends to have; applied on Connect().
+struct SyntheticSensor {
+  uint32_t width = 1920;
+  uint32_t height = 1080;
+  bool color = true;
+  ASI_BAYER_PATTERN pattern = ASI_BAYER_RG;
+  int bit_depth = 12;
+};
+
+//-------------------------------------------------------------------
+// A camera that makes its frames up, for benchmarking and testing the
+// capture pipeline on a machine without one. It behaves like a ZWO camera
+// with the configured sensor: RAW8, RAW16 and (in colour) RGB24, binning,
+// ROI, exposure and gain, and the same path into the streamingFrames ring,
+// RGB24 reordering included. The picture is a Synthetic::Scene, rendered
+// when a capture starts; exposure and gain set its brightness.
+//
+// The rate goes up to thousands of fps. Drops and timing jitter can be
+// injected: a dropped frame is one the "camera" lost, counted like the
+// SDK's dropped frames, and jitter moves each frame off its slot without
+// changing the mean rate.
+//-------------------------------------------------------------------
+class SyntheticCamera : public CameraBase {
+ public:
+  explicit SyntheticCamera(const std::string &cameraName)
+      : CameraBase("Synthetic") {
+    mCameraName = cameraName;
+    mCameraInfo = ASI_CAMERA_INFO();
+  }
+  ~SyntheticCamera() { Disconnect(); }
+
+  // Changes take effect on the next Connect().
+  SyntheticSensor sensor;
+  // These may be changed while capturing.
+  std::atomic<float> fps = 100;  // 0 for as fast as the ring takes them
+  std::atomic<float> drop_percent = 0;
+  std::atomic<float> jitter_us = 0;  // standard deviation
+
+  bool Connect() {
+    spdlog::info("Attempting to open {}...", mCameraName);
+    DescribeSensor();
+    stillFrame.buffer = std::make_unique<uint8_t[]>(
+        mCameraInfo.MaxHeight * mCameraInfo.MaxWidth * 3 * 2);
+    is_connected = true;
+    spdlog::info("Successfully opened {}...", mCameraName);
+    return true;
+  }
+  bool Disconnect() {
+    if (!is_connected) return true;
+    if (is_running) {
+      AbortExposure();
+      for (int i = 0; i < 100 && is_running; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    is_connected = false;
+    spdlog::info("Camera is offline.");
+    return true;
+  }
+  bool CreateControls() {
+    mControlCaps.assign(2, CONTROL_CAPS_CAST());
+    CONTROL_CAPS_CAST &expo = mControlCaps[0];
+    snprintf(expo.Name, sizeof(expo.Name), "Exposure");
+    snprintf(expo.Description, sizeof(expo.Description), "Exposure Time(ms)");
+    expo.MinValue = 1;
+    expo.MaxValue = 100000;
+    expo.DefaultValue = expo.current_value = 10;
+    expo.ControlType = ASI_EXPOSURE;
+    CONTROL_CAPS_CAST &gain = mControlCaps[1];
+    snprintf(gain.Name, sizeof(gain.Name), "Gain");
+    snprintf(gain.Description, sizeof(gain.Description),
+             "Gain, 0.1 dB a step");
+    gain.MaxValue = 400;
+    gain.DefaultValue = gain.current_value = 100;
+    gain.ControlType = ASI_GAIN;
+    for (auto &cap : mControlCaps) {
+      cap.IsAutoSupported = ASI_FALSE;
+      cap.IsWritable = ASI_TRUE;
+    }
+    mExposureCap = &expo;
+    mGainCap = &gain;
+    return true;
+  }
+  // The controls are the camera's state; there is nothing to send or fetch.
+  bool RetrieveControls(bool is_create = false) {
+    (void)is_create;
+    return true;
+  }
+  bool UpdateControls() { return true; }
+  void AbortExposure() {
+    if (!is_running) {
+      spdlog::warn("Camera not runing...");
+    }
+    do_abort = true;
+    spdlog::debug("Aaborted signal submitted...");
+  }
+
+  void DoVCaptureHelper(size_t _size = 1 * 1024) {
+    max_buffer_size = _size;
+    std::thread([this] {
+      ThreadProfile::Apply(ThreadProfile::Role::Capture);
+      DoVideoCapture();
+    }).detach();
+    HelloImGui::Log(HelloImGui::LogLevel::Debug,
+                    "DoVideoCapture command issued %d.", max_buffer_size);
+  }
+  void DoCaptureHelper() {
+    std::thread([this] {
+      ThreadProfile::Apply(ThreadProfile::Role::Capture);
+      DoCapture();
+    }).detach();
+    HelloImGui::Log(HelloImGui::LogLevel::Debug, "DoCapture command issued.");
+  }
+
+  bool DoVideoCapture() {
+    if (is_running || !is_connected) {
+      spdlog::debug("camera is busy IsRunning: {} IsStill: {}", is_running,
+                    is_still);
+      HelloImGui::Log(HelloImGui::LogLevel::Error, "camera is busy");
+      return false;
+    }
+    SetCCDBin(BinNumber);
+    if (!SetCCDROI()) {
+      spdlog::critical("Failed to set ROI");
+      return false;
+    }
+    auto imgFormat = getImageFormat(mCurrentStillFormat);
+    size_t nTotalBytes = std::get<1>(imgFormat)[0] * std::get<1>(imgFormat)[1] *
+                         std::get<1>(imgFormat)[2] * std::get<2>(imgFormat);
+    const Synthetic::Scene scene(SceneFor(mCurrentStillFormat, imgFormat, 16));
+
+    streamingFrames.buffer.reset();
+    streamingFrames.buffer = std::make_shared<Circular_Buffer<uint8_t>>(
+        std::max<size_t>(max_buffer_size * 1024 * 1024 / nTotalBytes, 2),
+        nTotalBytes);
+    Stats().diag.start(*streamingFrames.buffer);
+    streamingFrames.size = nTotalBytes;
+    streamingFrames.ch = std::get<1>(imgFormat)[2];
+    streamingFrames.byte_channel = std::get<2>(imgFormat);
+    streamingFrames.format = FrameFormat(mCurrentStillFormat);
+    streamingFrames.currentFormat = mCurrentStillFormat;
+    streamingFrames.adc_bits = mCameraInfo.BitDepth;
+    streamingFrames.dim = {std::get<1>(imgFormat)[0], std::get<1>(imgFormat)[1],
+                           std::get<1>(imgFormat)[2]};
+    spdlog::info("Started video capture {} MB", max_buffer_size);
+    HelloImGui::Log(HelloImGui::LogLevel::Debug, "Started video capture");
+    is_still = false;
+    is_running = true;
+    streamingFrames.is_active = true;
+
+    Timer escaped;
+    Timer timer;
+    escaped.Start();
+    timer.Start();
+    size_t count = 0;
+    uint32_t sdkDropped = 0;
+    m_dropped_frames = 0;
+    const uint32_t expoUs = uint32_t(mExposureCap->current_value * 1000);
+    const uint32_t gain = uint32_t(mGainCap->current_value);
+    std::mt19937 rng(std::random_device{}());
+    std::uniform_real_distribution<float> percent(0, 100);
+    std::normal_distribution<double> jitter(0, 1);
+    // The scene is interleaved BGR for RGB24, as the SDK delivers it.
+    std::unique_ptr<FrameStage> stage =
+        MakeConvertStage(imgFormat, nTotalBytes);
+    const bool convert_here = !stage && mCurrentStillFormat == ASI_IMG_RGB24;
+    // Frame i is due at base + (i - base_idx) * period, moved by jitter; the
+    // schedule starts over whenever the rate is changed.
+    float rate = -1;
+    uint64_t base = 0, base_idx = 0, period = 0, due = 0;
+    for (uint64_t i = 0;; i++) {
+      if (rate != fps) {
+        rate = fps;
+        period = rate > 0 ? uint64_t(1e9 / rate) : 0;
+        base = monotonic_ns();
+        base_idx = i;
+      }
+      const double sd = jitter_us * 1e3;
+      const double off =
+          sd > 0 ? std::clamp(jitter(rng) * sd, -0.5 * period, 4.0 * sd) : 0;
+      due = std::max<uint64_t>(due, base + (i - base_idx) * period + off);
+      if (!sleep_until_ns(due, do_abort)) break;
+
+      if (timer.Finish() > 500) {
+        m_fps = float(count) * 1000. / float(timer.Finish());
+        m_vc_escape = escaped.Finish();
+        timer.Start();
+        spdlog::debug("Capturing at {} fps. Dropped frame {}", m_fps,
+                      m_dropped_frames);
+        Stats().update(m_fps, *streamingFrames.buffer,
+                       streamingFrames.overflow_policy);
+        Stats().diag.sdk_dropped = m_dropped_frames;
+        count = 0;
+      }
+      const float drop = drop_percent;
+      if (drop > 0 && percent(rng) < drop) {
+        m_dropped_frames = ++sdkDropped;
+        continue;
+      }
+      uint8_t *targetFrame =
+          stage ? stage->claim()
+                : streamingFrames.buffer->claim(
+                      streamingFrames.overflow_policy,
+                      streamingFrames.block_timeout_ms);
+      if (targetFrame == nullptr) {
+        streamingFrames.buffer->mark_dropped();
+        continue;
+      }
+      if (convert_here)
+        RGB24::ToPlanar(targetFrame, scene.Frame(i),
+                        std::get<1>(imgFormat)[1], std::get<1>(imgFormat)[0]);
+      else
+        std::memcpy(targetFrame, scene.Frame(i), nTotalBytes);
+      FrameMeta &meta = stage ? stage->claimed_meta()
+                              : streamingFrames.buffer->claimed_meta();
+      meta.capture_ns = monotonic_ns();
+      meta.utc_ns = realtime_ns();
+      meta.exposure_us = expoUs;
+      meta.gain = gain;
+      meta.sdk_dropped = sdkDropped;
+      meta.ring_dropped =
+          streamingFrames.buffer->get_counters().dropped.load(
+              std::memory_order_relaxed);
+      if (stage)
+        stage->commit();
+      else
+        streamingFrames.buffer->commit();
+      count++;
+    }
+    spdlog::info("aborting .");
+    stage.reset();  // publishes what it still holds
+    is_running = false;
+    do_abort = false;
+    streamingFrames.do_record = false;
+    streamingFrames.is_active = false;
+    spdlog::info("Exiting {}.", __func__);
+    return true;
+  }
+
+  // A still takes the exposure time, then delivers a frame of the scene.
+  bool DoCapture() {
+    if (is_running || !is_connected) {
+      spdlog::debug("camera is busy IsRunning: {} IsStill: {}", is_running,
+                    is_still);
+      HelloImGui::Log(HelloImGui::LogLevel::Error, "camera is busy");
+      return false;
+    }
+    SetCCDBin(BinNumber);
+    if (!SetCCDROI()) {
+      spdlog::critical("Failed to set ROI");
+      return false;
+    }
+    is_running = true;
+    is_still = true;
+    const int32_t expo_ms = mExposureCap->current_value;
+    const uint64_t start = monotonic_ns();
+    const uint64_t done = start + uint64_t(expo_ms) * 1000000;
+    while (monotonic_ns() < done && !do_abort) {
+      m_expo_escape = uint32_t((done - monotonic_ns()) / 1000000);
+      sleep_until_ns(std::min<uint64_t>(done, monotonic_ns() + 50000000),
+                     do_abort);
+    }
+    m_expo_escape = 0;
+    if (do_abort) {
+      spdlog::info("aborting .");
+      is_running = false;
+      do_abort = false;
+      return true;
+    }
+    std::lock_guard<std::mutex> lock(stillFrame.mutex);
+    stillFrame.currentFormat = mCurrentStillFormat;
+    auto imgFormat = getImageFormat(stillFrame.currentFormat);
+    size_t nTotalBytes = std::get<1>(imgFormat)[0] * std::get<1>(imgFormat)[1] *
+                         std::get<1>(imgFormat)[2] * std::get<2>(imgFormat);
+    const Synthetic::Scene scene(
+        SceneFor(stillFrame.currentFormat, imgFormat, 1));
+    if (stillFrame.currentFormat == ASI_IMG_RGB24)
+      RGB24::ToPlanar(stillFrame.buffer.get(), scene.Frame(0),
+                      std::get<1>(imgFormat)[1], std::get<1>(imgFormat)[0]);
+    else
+      std::memcpy(stillFrame.buffer.get(), scene.Frame(0), nTotalBytes);
+    stillFrame.size = nTotalBytes;
+    stillFrame.ch = std::get<1>(imgFormat)[2];
+    stillFrame.byte_channel = std::get<2>(imgFormat);
+    stillFrame.format = FrameFormat(stillFrame.currentFormat);
+    stillFrame.dim = {std::get<1>(imgFormat)[0], std::get<1>(imgFormat)[1],
+                      std::get<1>(imgFormat)[2]};
+    stillFrame.is_new = true;
+    is_running = false;
+    return true;
+  }
+
+ private:
+  void DescribeSensor() {
+    sensor.width = std::max<uint32_t>(sensor.width - sensor.width % 8, 8);
+    sensor.height = std::max<uint32_t>(sensor.height - sensor.height % 2, 2);
+    sensor.bit_depth = std::clamp(sensor.bit_depth, 8, 16);
+    mCameraInfo = ASI_CAMERA_INFO();
+    snprintf(mCameraInfo.Name, sizeof(mCameraInfo.Name), "%s",
+             mCameraName.c_str());
+    mCameraInfo.CameraID = -1;
+    mCameraInfo.MaxHeight = sensor.height;
+    mCameraInfo.MaxWidth = sensor.width;
+    mCameraInfo.IsColorCam = sensor.color ? ASI_TRUE : ASI_FALSE;
+    mCameraInfo.BayerPattern = sensor.pattern;
+    const int bins[] = {1, 2, 3, 4};
+    std::copy(std::begin(bins), std::end(bins), mCameraInfo.SupportedBins);
+    const ASI_IMG_TYPE color[] = {ASI_IMG_RAW8, ASI_IMG_RGB24, ASI_IMG_RAW16,
+                                  ASI_IMG_END};
+    const ASI_IMG_TYPE mono[] = {ASI_IMG_RAW8, ASI_IMG_RAW16, ASI_IMG_END};
+    if (sensor.color)
+      std::copy(std::begin(color), std::end(color),
+                mCameraInfo.SupportedVideoFormat);
+    else
+      std::copy(std::begin(mono), std::end(mono),
+                mCameraInfo.SupportedVideoFormat);
+    mCameraInfo.PixelSize = 2.9;
+    mCameraInfo.BitDepth = sensor.bit_depth;
+
+    m_supportedFormat.clear();
+    m_supportedFormat_str.clear();
+    for (size_t i = 0; i < 8; i++) {
+      if (mCameraInfo.SupportedVideoFormat[i] == ASI_IMG_END) break;
+      m_supportedFormat.push_back(mCameraInfo.SupportedVideoFormat[i]);
+      m_supportedFormat_str.push_back(
+          ASIHelpers::toPrettyString(mCameraInfo.SupportedVideoFormat[i]));
+    }
+    m_supportedBin.clear();
+    for (int b : bins) m_supportedBin.push_back(std::to_string(b));
+    const int dims[2] = {int(sensor.height), int(sensor.width)};
+    for (size_t i = 0; i < 2; i++) {
+      m_frame[i].MaxValue = m_frame[i].DefaultValue = dims[i];
+      m_frame[i].CurrentValue = m_frame[i].BinnedValue = dims[i];
+      m_frame[i].MinValue = 0;
+      m_frame[i].AxisOffset = m_frame[i].BinndedAxisOffset = 0;
+      m_frame[i].Bin = 1;
+    }
+    BinNumber = 1;
+    mCurrentStillFormat = ASI_IMG_RAW8;
+  }
+
+  // The ROI checks and rounding of ASIBase::SetCCDROI, without an SDK.
+  bool SetCCDROI() {
+    const uint32_t bin = m_frame[1].Bin;
+    uint32_t subW = m_frame[1].BinnedValue, subH = m_frame[0].BinnedValue;
+    if (subW + m_frame[1].BinndedAxisOffset > mCameraInfo.MaxWidth / bin ||
+        subH + m_frame[0].BinndedAxisOffset > mCameraInfo.MaxHeight / bin) {
+      spdlog::critical("Invalid ROI request : {}x{} @ {}x{}", subW, subH,
+                       m_frame[1].BinndedAxisOffset,
+                       m_frame[0].BinndedAxisOffset);
+      return false;
+    }
+    subW -= subW % 8;
+    subH -= subH % 2;
+    if (subW == 0 || subH == 0) {
+      spdlog::critical("Invalid ROI request : {}x{}", subW, subH);
+      return false;
+    }
+    m_frame[1].BinnedValue = subW;
+    m_frame[0].BinnedValue = subH;
+    return true;
+  }
+
+  // What the frames of a capture in type look like in the ring.
+  SER::BAYER FrameFormat(ASI_IMG_TYPE type) const {
+    if (type == ASI_IMG_RGB24) return SER::COLOR_RGB;
+    if (!mCameraInfo.IsColorCam) return SER::COLOR_MONO;
+    switch (mCameraInfo.BayerPattern) {
+      case ASI_BAYER_BG:
+        return SER::COLOR_BAYER_BGGR;
+      case ASI_BAYER_GR:
+        return SER::COLOR_BAYER_GRBG;
+      case ASI_BAYER_GB:
+        return SER::COLOR_BAYER_GBRG;
+      default:
+        return SER::COLOR_BAYER_RGGB;
+    }
+  }
+
+  // The scene as the SDK would deliver it: RGB24 comes interleaved BGR.
+  // Exposure and gain scale the brightness, 10 ms at gain 100 being the
+  // scene's own level.
+  Synthetic::SceneConfig SceneFor(
+      ASI_IMG_TYPE type,
+      const std::tuple<ASIHelpers::PIXEL_FORMAT, std::array<uint16_t, 3>,
+                       size_t> &imgFormat,
+      uint32_t frames) const {
+    Synthetic::SceneConfig c;
+    c.height = std::get<1>(imgFormat)[0];
+    c.width = std::get<1>(imgFormat)[1];
+    c.color = type == ASI_IMG_RGB24 ? SER::COLOR_BGR : FrameFormat(type);
+    c.bytes = std::get<2>(imgFormat);
+    c.adc_bits = c.bytes == 2 ? mCameraInfo.BitDepth : 8;
+    const double gain = std::pow(10.0, (mGainCap->current_value - 100) / 200.0);
+    c.level = float(std::min(
+        0.6 * mExposureCap->current_value / 10.0 * gain, 1.0));
+    c.noise = float(0.02 * gain);
+    // Keep the pool to a few hundred MB however large the frames are.
+    const size_t bytes = size_t(c.width) * c.height *
+                         std::get<1>(imgFormat)[2] * c.bytes;
+    c.frames = uint32_t(std::clamp<size_t>(256 * 1024 * 1024 / bytes, 1,
+                                           frames));
+    return c;
+  }
+};
@@ -0,0 +1,131 @@
+#ifndef __SYNTHETIC_FRAMES__
+#define __SYNTHETIC_FRAMES__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "SERProcessor.hpp"
+
+//-------------------------------------------------------------------
+// Frames of a made-up planetary video, for running the capture pipeline
+// without a camera: a limb-darkened disk circling the middle of the frame
+// over a dark sky, with noise. Frames are rendered once into a pool and
+// handed out in turn, so a source can run at thousands of fps and what is
+// measured is the pipeline, not the renderer.
+//
+//   Synthetic::Scene scene({1920, 1080, SER::COLOR_BAYER_RGGB, 2, 12});
+//   memcpy(slot, scene.Frame(i), scene.FrameBytes());
+//-------------------------------------------------------------------
+namespace Synthetic {
+
+struct SceneConfig {
+  uint32_t width = 640;
+  uint32_t height = 480;
+  // MONO, a Bayer pattern, or RGB/BGR for three interleaved channels.
+  SER::BAYER color = SER::COLOR_MONO;
+  uint32_t bytes = 1;  // per sample, 1 or 2
+  // Significant bits; 16-bit samples carry them at the top, as ZWO
+  // cameras deliver them.
+  int adc_bits = 8;
+  float level = 0.6;    // disk centre, as a fraction of full scale
+  float noise = 0.02;   // peak noise, the same
+  uint32_t frames = 16; // pool size; the disk goes round once per pool
+};
+
+class Scene {
+ public:
+  explicit Scene(const SceneConfig &_cfg) : cfg(_cfg) {
+    cfg.bytes = cfg.bytes == 2 ? 2 : 1;
+    cfg.adc_bits = std::clamp(cfg.adc_bits, 1, int(cfg.bytes * 8));
+    cfg.frames = std::max<uint32_t>(cfg.frames, 1);
+    ch = cfg.color >= SER::COLOR_RGB ? 3 : 1;
+    frame_bytes = size_t(cfg.width) * cfg.height * ch * cfg.bytes;
+    pool.resize(frame_bytes * cfg.frames);
+    for (uint32_t i = 0; i < cfg.frames; i++) Render(i);
+  }
+
+  size_t FrameBytes() const { return frame_bytes; }
+  size_t Channels() const { return ch; }
+  const SceneConfig &Config() const { return cfg; }
+  // Frame idx of the video; the pool repeats.
+  const uint8_t *Frame(uint64_t idx) const {
+    return pool.data() + (idx % cfg.frames) * frame_bytes;
+  }
+
+ private:
+  SceneConfig cfg;
+  size_t ch = 1;
+  size_t frame_bytes = 0;
+  std::vector<uint8_t> pool;
+
+  // Colour filter over pixel (x, y): 0 red, 1 green, 2 blue.
+  int Filter(uint32_t x, uint32_t y) const {
+    static const int cfa[4][4] = {
+        {0, 1, 1, 2},  // RGGB
+        {1, 0, 2, 1},  // GRBG
+        {1, 2, 0, 1},  // GBRG
+        {2, 1, 1, 0},  // BGGR
+    };
+    const int p = cfg.color - SER::COLOR_BAYER_RGGB;
+    return cfa[p][(y & 1) * 2 + (x & 1)];
+  }
+
+  void Render(uint32_t idx) {
+    const double pi = 3.14159265358979323846;
+    const double full = double((1u << cfg.adc_bits) - 1);
+    const int shift = int(cfg.bytes * 8) - cfg.adc_bits;
+    const double a = 2 * pi * idx / cfg.frames;
+    const double small = std::min(cfg.width, cfg.height);
+    const double cx = cfg.width / 2.0 + small / 8 * std::cos(a);
+    const double cy = cfg.height / 2.0 + small / 8 * std::sin(a);
+    const double r = std::max(small / 5, 1.0);
+    const double sky = 0.02 * full, peak = cfg.level * full;
+    const double amp = cfg.noise * full;
+    // A yellowish planet: red, green, blue.
+    const double tint[3] = {1.0, 0.85, 0.6};
+    const bool bayer = cfg.color >= SER::COLOR_BAYER_RGGB &&
+                       cfg.color <= SER::COLOR_BAYER_BGGR;
+    // Interleaved channels are stored in the order SER names them.
+    const int order[3] = {cfg.color == SER::COLOR_BGR ? 2 : 0, 1,
+                          cfg.color == SER::COLOR_BGR ? 0 : 2};
+    uint32_t seed = 0x9e3779b9u * (idx + 1);
+    uint8_t *out8 = pool.data() + size_t(idx) * frame_bytes;
+    uint16_t *out16 = reinterpret_cast<uint16_t *>(out8);
+    size_t k = 0;
+    for (uint32_t y = 0; y < cfg.height; y++) {
+      const double dy = (y - cy) / r;
+      for (uint32_t x = 0; x < cfg.width; x++) {
+        const double dx = (x - cx) / r;
+        const double d2 = dx * dx + dy * dy;
+        const double disk =
+            d2 < 1 ? peak * (0.4 + 0.6 * std::sqrt(1 - d2)) : 0;
+        for (size_t c = 0; c < ch; c++) {
+          const int filter = ch == 3 ? order[c] : bayer ? Filter(x, y) : 1;
+          // Triangular noise from two xorshift draws.
+          seed ^= seed << 13;
+          seed ^= seed >> 17;
+          seed ^= seed << 5;
+          const double n = (int(seed & 0xffff) - int(seed >> 16)) / 65536.0;
+          double v = sky + disk * (cfg.color == SER::COLOR_MONO
+                                       ? 1.0
+                                       : tint[filter]) +
+                     n * amp;
+          v = std::clamp(v, 0.0, full);
+          if (cfg.bytes == 2)
+            out16[k++] = uint16_t(uint32_t(v) << shift);
+          else
+            out8[k++] = uint8_t(v);
+        }
+      }
+    }
+  }
+};
+
+}  // namespace Synthetic
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef __TELEMETRY__
+#define __TELEMETRY__
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "timer.hpp"
+
+// Resolution a telemetry series can be read back at.
+enum class TelemetryRes { Full, Minutes, Session };
+
+// Contiguous, read-only run of the newest samples of one resolution, oldest
+// first. Valid until the writer pushes another TelemetrySeries::GUARD samples.
+struct TelemetryView {
+  const float* data = nullptr;
+  int count = 0;
+};
+
+//-------------------------------------------------------------------
+// Single-writer telemetry time series (fps, CPU, RAM...).
+//
+// One thread pushes, any thread reads. push() is O(1) and never allocates:
+// every resolution is a fixed ring whose sample count is published with a
+// release store once the sample is in place. Rollups:
+//  - Full:    every sample, last full_window_s seconds
+//  - Minutes: 1 s averages, last 10 min
+//  - Session: 10 s averages, up to 24 h
+// A rollup sample is emitted when its bucket closes, so the coarse views lag
+// by at most one bucket.
+//
+// Each ring stores every sample twice (slot i and i + cap), so the newest
+// `window` samples are always contiguous and go to ImPlot as a plain pointer
+// with no copy. The view stops GUARD slots short of the ones the writer fills
+// next, so a plot that is being drawn is not written underneath.
+//-------------------------------------------------------------------
+class TelemetrySeries {
+ public:
+  static constexpr uint32_t GUARD = 8;
+  static constexpr uint32_t MINUTES_WINDOW = 10 * 60;
+  static constexpr uint32_t SESSION_WINDOW = 24 * 60 * 6;
+
+  // period_ms is how often the writer pushes; it sizes the full-rate ring.
+  explicit TelemetrySeries(uint32_t period_ms, uint32_t full_window_s = 10)
+      : full(std::max<uint32_t>(
+            full_window_s * 1000 / std::max<uint32_t>(period_ms, 1), 2)),
+        minutes(MINUTES_WINDOW),
+        session(SESSION_WINDOW),
+        minutes_acc(1000000000ull),
+        session_acc(10000000000ull) {}
+  TelemetrySeries(const TelemetrySeries&) = delete;
+  TelemetrySeries& operator=(const TelemetrySeries&) = delete;
+
+  void push(float v) { push(v, monotonic_ns()); }
+  void push(float v, uint64_t now_ns) {
+    full.push(v);
+    minutes_acc.add(v, now_ns, minutes);
+    session_acc.add(v, now_ns, session);
+    latest.store(v, std::memory_order_relaxed);
+  }
+
+  TelemetryView view(TelemetryRes res) const {
+    switch (res) {
+      case TelemetryRes::Minutes:
+        return minutes.view();
+      case TelemetryRes::Session:
+        return session.view();
+      default:
+        return full.view();
+    }
+  }
+  // Most samples view(res) can return; sparklines use it as the x range.
+  int window(TelemetryRes res) const {
+    switch (res) {
+      case TelemetryRes::Minutes:
+        return minutes.window;
+      case TelemetryRes::Session:
+        return session.window;
+      default:
+        return full.window;
+    }
+  }
+  float last() const { return latest.load(std::memory_order_relaxed); }
+
+ private:
+  class Ring {
+   public:
+    explicit Ring(uint32_t window)
+        : window(window), cap(window + GUARD), buf(2 * cap, 0.f) {}
+
+    void push(float v) {
+      uint64_t w = written.load(std::memory_order_relaxed);
+      size_t i = w % cap;
+      buf[i] = v;
+      buf[i + cap] = v;
+      written.store(w + 1, std::memory_order_release);
+    }
+    TelemetryView view() const {
+      uint64_t w = written.load(std::memory_order_acquire);
+      if (w == 0) return {};
+      int n = int(std::min<uint64_t>(w, window));
+      // the newest sample's upper copy; the n before it are contiguous
+      size_t newest = (w - 1) % cap + cap;
+      return {buf.data() + newest + 1 - n, n};
+    }
+
+    const uint32_t window;
+
+   private:
+    const uint32_t cap;
+    std::vector<float> buf;
+    std::atomic<uint64_t> written = 0;
+  };
+
+  // Averages the samples that fall into one time bucket.
+  struct Rollup {
+    explicit Rollup(uint64_t bucket_ns) : bucket_ns(bucket_ns) {}
+    void add(float v, uint64_t now_ns, Ring& out) {
+      uint64_t b = now_ns / bucket_ns;
+      if (b != bucket) {
+        if (n) out.push(float(sum / n));
+        bucket = b;
+        sum = 0;
+        n = 0;
+      }
+      sum += v;
+      n++;
+    }
+    const uint64_t bucket_ns;
+    uint64_t bucket = UINT64_MAX;
+    double sum = 0;
+    uint32_t n = 0;
+  };
+
+  Ring full;
+  Ring minutes;
+  Ring session;
+  Rollup minutes_acc;
+  Rollup session_acc;
+  std::atomic<float> latest = 0.f;
+};
+
+#endif
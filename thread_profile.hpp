@@ -0,0 +1,359 @@
+#ifndef __THREAD_PROFILE__
+#define __THREAD_PROFILE__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <pthread.h>
+#include <sched.h>
+#include <spdlog/spdlog.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//-------------------------------------------------------------------
+// CPU pinning and scheduling of the threads that move frames, by role.
+//
+// Each long-lived thread calls Apply() with its role when it starts, and
+// the ones with a loop call Refresh() in it to pick up changes; the capture
+// and conversion threads take new settings when the next capture starts.
+// The shared worker pools (RGB24 conversion, compression) are a role of
+// their own and refresh before each job. A role set to Default, with no
+// CPUs, runs as the process was started (taskset, chrt, nice); a thread
+// already like that is not touched.
+// With several cameras capturing there is a thread per camera in most roles;
+// they share the role's CPUs, and Status is of the one that applied last.
+//
+// Real-time policies need CAP_SYS_NICE or an rtprio limit (limits.conf),
+// negative nice values the same or a nice limit. Without them a thread
+// falls back to the best nice value it may have, or stays as it is; what
+// it got and why is logged and kept in Status for the statistics panel.
+//-------------------------------------------------------------------
+namespace ThreadProfile {
+
+enum class Role { Capture, Convert, Writer, Preview, Worker, Gui, COUNT };
+constexpr size_t ROLES = size_t(Role::COUNT);
+
+inline const char *RoleName(Role role) {
+  static const char *names[] = {"capture", "convert", "writer", "preview",
+                                "worker",  "gui"};
+  return names[int(role)];
+}
+
+enum class Sched { Default, Nice, FIFO, RR };
+
+struct Profile {
+  uint64_t cpus = 0;  // bit i for CPU i; 0 runs anywhere the process may
+  Sched sched = Sched::Default;
+  int priority = 0;  // 1..99 for FIFO and RR, -20..19 for Nice
+};
+
+// What the thread of a role last got.
+struct Status {
+  bool applied = false;
+  pid_t tid = 0;
+  std::string got;    // CPUs and policy in effect
+  std::string error;  // what could not be had, if anything
+};
+
+// Default leaves every thread alone. IsolateCapture gives the capture
+// thread the last core to itself under SCHED_FIFO and keeps everything
+// else off it; combine it with isolcpus= or a cpuset to keep other
+// processes off as well. Setting a role by hand makes it Custom.
+enum class Preset { Default, IsolateCapture, Custom };
+
+namespace detail {
+
+inline pid_t gettid() { return pid_t(syscall(SYS_gettid)); }
+
+struct State {
+  std::mutex mutex;
+  std::array<Profile, ROLES> profiles;
+  std::array<Status, ROLES> status;
+  Preset preset = Preset::Default;
+  std::atomic<uint32_t> generation = 1;
+  // Where and how the process ran at start, e.g. under taskset, chrt or
+  // nice; "anywhere" and Default mean this. Taken from the first thread to
+  // look, the GUI thread at the top of main().
+  cpu_set_t allowed;
+  int policy = SCHED_OTHER;
+  sched_param param{};
+  int nice = 0;
+  State() {
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+      for (unsigned i = 0; i < std::thread::hardware_concurrency(); i++)
+        CPU_SET(i, &allowed);
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    errno = 0;
+    nice = getpriority(PRIO_PROCESS, gettid());
+    if (errno != 0) nice = 0;
+  }
+};
+inline const char *PolicyName(int policy) {
+  switch (policy) {
+    case SCHED_FIFO:
+      return "SCHED_FIFO";
+    case SCHED_RR:
+      return "SCHED_RR";
+    case SCHED_OTHER:
+      return "SCHED_OTHER";
+  }
+  return "policy";
+}
+
+inline State &state() {
+  static State s;
+  return s;
+}
+
+}  // namespace detail
+
+// "0-2,5" style list of the CPUs in mask.
+inline std::string FormatCpus(uint64_t mask) {
+  std::string s;
+  for (int i = 0; i < 64; i++) {
+    if (!(mask >> i & 1)) continue;
+    int j = i;
+    while (j < 63 && (mask >> (j + 1) & 1)) j++;
+    if (!s.empty()) s += ",";
+    s += j > i ? fmt::format("{}-{}", i, j) : std::to_string(i);
+    i = j;
+  }
+  return s;
+}
+// Mask of such a list; false if it is not one.
+inline bool ParseCpus(const std::string &s, uint64_t &mask) {
+  mask = 0;
+  const char *p = s.c_str();
+  while (*p == ' ') p++;
+  while (*p != '\0') {
+    char *end;
+    const long a = std::strtol(p, &end, 10);
+    if (end == p || a < 0 || a > 63) return false;
+    long b = a;
+    p = end;
+    if (*p == '-') {
+      b = std::strtol(p + 1, &end, 10);
+      if (end == p + 1 || b < a || b > 63) return false;
+      p = end;
+    }
+    for (long i = a; i <= b; i++) mask |= uint64_t(1) << i;
+    while (*p == ' ') p++;
+    if (*p == ',') p++;
+    while (*p == ' ') p++;
+  }
+  return true;
+}
+
+inline std::string Describe(const Profile &p) {
+  std::string s = p.cpus ? "CPUs " + FormatCpus(p.cpus) : "any CPU";
+  switch (p.sched) {
+    case Sched::Default:
+      break;
+    case Sched::Nice:
+      s += fmt::format(", nice {}", p.priority);
+      break;
+    case Sched::FIFO:
+      s += fmt::format(", SCHED_FIFO {}", p.priority);
+      break;
+    case Sched::RR:
+      s += fmt::format(", SCHED_RR {}", p.priority);
+      break;
+  }
+  return s;
+}
+
+inline Profile Get(Role role) {
+  auto &st = detail::state();
+  std::lock_guard<std::mutex> lock(st.mutex);
+  return st.profiles[size_t(role)];
+}
+inline Status GetStatus(Role role) {
+  auto &st = detail::state();
+  std::lock_guard<std::mutex> lock(st.mutex);
+  return st.status[size_t(role)];
+}
+inline Preset GetPreset() {
+  auto &st = detail::state();
+  std::lock_guard<std::mutex> lock(st.mutex);
+  return st.preset;
+}
+
+inline void Set(Role role, const Profile &p) {
+  auto &st = detail::state();
+  {
+    std::lock_guard<std::mutex> lock(st.mutex);
+    st.profiles[size_t(role)] = p;
+    st.preset = Preset::Custom;
+  }
+  st.generation++;
+}
+
+inline void UsePreset(Preset preset) {
+  auto &st = detail::state();
+  std::array<Profile, ROLES> p{};
+  if (preset == Preset::IsolateCapture) {
+    int last = -1, count = 0;
+    for (int i = 0; i < 64; i++)
+      if (CPU_ISSET(i, &st.allowed)) last = i, count++;
+    if (count < 2) {
+      spdlog::warn("Only one CPU to run on; capture is not isolated");
+      preset = Preset::Default;
+    } else {
+      uint64_t rest = 0;
+      for (int i = 0; i < last; i++)
+        if (CPU_ISSET(i, &st.allowed)) rest |= uint64_t(1) << i;
+      for (auto &r : p) r.cpus = rest;
+      p[size_t(Role::Capture)] = {uint64_t(1) << last, Sched::FIFO, 50};
+      p[size_t(Role::Writer)].sched = Sched::Nice;
+      p[size_t(Role::Writer)].priority = -5;
+      p[size_t(Role::Preview)].sched = Sched::Nice;
+      p[size_t(Role::Preview)].priority = 5;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(st.mutex);
+    st.profiles = p;
+    st.preset = preset;
+  }
+  st.generation++;
+}
+
+// Puts the calling thread in its role. True if it got all of it.
+inline bool Apply(Role role) {
+  auto &st = detail::state();
+  const Profile p = Get(role);
+  const pid_t tid = detail::gettid();
+  const pthread_t self = pthread_self();
+  std::string error;
+
+  // Names show in top -H, htop and perf.
+  pthread_setname_np(self, (std::string("ac-") + RoleName(role)).c_str());
+
+  // Only what differs from the role's settings is changed, so a thread that
+  // is as the process started is left alone under Default.
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (p.cpus == 0) {
+    set = st.allowed;
+  } else {
+    for (int i = 0; i < 64; i++)
+      if (p.cpus >> i & 1) CPU_SET(i, &set);
+  }
+  cpu_set_t now;
+  if (pthread_getaffinity_np(self, sizeof(now), &now) != 0 ||
+      !CPU_EQUAL(&now, &set)) {
+    const int err = pthread_setaffinity_np(self, sizeof(set), &set);
+    if (err != 0)
+      error += fmt::format("CPUs {}: {}; ", FormatCpus(p.cpus),
+                           std::strerror(err));
+  }
+
+  sched_param param{};
+  int policy = st.policy;
+  int nice = st.nice;
+  switch (p.sched) {
+    case Sched::Default:
+      param = st.param;
+      break;
+    case Sched::Nice:
+      policy = SCHED_OTHER;
+      nice = std::clamp(p.priority, -20, 19);
+      break;
+    case Sched::FIFO:
+    case Sched::RR:
+      policy = p.sched == Sched::FIFO ? SCHED_FIFO : SCHED_RR;
+      param.sched_priority =
+          std::clamp(p.priority, sched_get_priority_min(policy),
+                     sched_get_priority_max(policy));
+      break;
+  }
+  int curPolicy = SCHED_OTHER;
+  sched_param curParam{};
+  pthread_getschedparam(self, &curPolicy, &curParam);
+  if (curPolicy != policy ||
+      curParam.sched_priority != param.sched_priority) {
+    const int err = pthread_setschedparam(self, policy, &param);
+    if (err != 0) {
+      error += fmt::format("{} {}: {}; ", detail::PolicyName(policy),
+                           param.sched_priority, std::strerror(err));
+      pthread_getschedparam(self, &policy, &param);
+      // The next best thing without real-time rights.
+      if (p.sched == Sched::FIFO || p.sched == Sched::RR) {
+        param.sched_priority = 0;
+        if (pthread_setschedparam(self, SCHED_OTHER, &param) == 0)
+          policy = SCHED_OTHER;
+        nice = -10;
+      }
+    }
+  }
+  const bool realtime = policy == SCHED_FIFO || policy == SCHED_RR;
+  errno = 0;
+  const int curNice = getpriority(PRIO_PROCESS, tid);
+  if (!realtime && errno == 0 && curNice != nice &&
+      setpriority(PRIO_PROCESS, tid, nice) != 0) {
+    error += fmt::format("nice {}: {}; ", nice, std::strerror(errno));
+    // Settle for the lowest value RLIMIT_NICE lets us set (per thread on
+    // Linux).
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NICE, &lim) == 0 && lim.rlim_cur > 0 &&
+        lim.rlim_cur != RLIM_INFINITY)
+      setpriority(PRIO_PROCESS, tid, std::max(nice, 20 - int(lim.rlim_cur)));
+  }
+
+  uint64_t mask = 0;
+  if (pthread_getaffinity_np(self, sizeof(now), &now) == 0)
+    for (int i = 0; i < 64; i++)
+      if (CPU_ISSET(i, &now)) mask |= uint64_t(1) << i;
+  std::string got = "CPUs " + FormatCpus(mask);
+  pthread_getschedparam(self, &policy, &param);
+  if (policy == SCHED_FIFO || policy == SCHED_RR)
+    got += fmt::format(", {} {}", detail::PolicyName(policy),
+                       param.sched_priority);
+  else
+    got += fmt::format(", nice {}", getpriority(PRIO_PROCESS, tid));
+  if (!error.empty()) error.resize(error.size() - 2);
+
+  {
+    std::lock_guard<std::mutex> lock(st.mutex);
+    st.status[size_t(role)] = {true, tid, got, error};
+  }
+  if (error.empty())
+    spdlog::info("Thread {} ({}): {}", RoleName(role), tid, got);
+  else
+    spdlog::warn("Thread {} ({}): wanted {}, got {} ({})", RoleName(role),
+                 tid, Describe(p), got, error);
+  return error.empty();
+}
+
+// Bumped by every change of the settings.
+inline uint32_t Generation() { return detail::state().generation.load(); }
+
+// Apply() again if the settings changed since seen (0 at first); for
+// thread loops.
+inline void Refresh(Role role, uint32_t &seen) {
+  const uint32_t g = Generation();
+  if (g == seen) return;
+  seen = g;
+  Apply(role);
+}
+// Refresh() for threads without a loop of their own, e.g. pool workers
+// before each job; the generation seen is the calling thread's.
+inline void RefreshThread(Role role) {
+  thread_local uint32_t seen = 0;
+  Refresh(role, seen);
+}
+
+}  // namespace ThreadProfile
+
+#endif
@@ -1,6 +1,42 @@
 #ifndef __TIMER__
 #define __TIMER__
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <thread>
+
+// CLOCK_MONOTONIC in ns; used to timestamp frames and measure stage latency.
+inline uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+}
+// CLOCK_REALTIME (UTC) in ns since the Unix epoch.
+inline uint64_t realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+}
+
+// Waits until CLOCK_MONOTONIC reaches due_ns, for pacing frames. Sleeps
+// while the deadline is far off and yields for the last 200 us, where a
+// sleep would overshoot; false as soon as abort is set.
+inline bool sleep_until_ns(uint64_t due_ns, const std::atomic_bool &abort) {
+    while (!abort) {
+        const uint64_t now = monotonic_ns();
+        if (now >= due_ns) return true;
+        const uint64_t left = due_ns - now;
+        if (left > 200000)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(
+                std::min<uint64_t>(left - 100000, 50000000)));
+        else
+            std::this_thread::yield();
+    }
+    return false;
+}
 
 class Timer {
 private:
@@ -0,0 +1,196 @@
+// Merges a striped recording back into one SER file.
+//
+// Reads the manifest SERStripedWriter left next to the first stripe, maps
+// every stripe file and copies the frames out in the order they were
+// recorded, with their timestamps. Compressed stripes (.serz) are decoded on
+// the way. A stripe file that has moved is looked for next to the manifest as
+// well. Stripes of a recording that was cut short have no timestamp trailer;
+// their merge has none either, and keeps the recording's start date.
+// Stripes with and without timestamps are not merged.
+//
+// usage: ser_merge <name.manifest> <out.ser>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "SERCompressed.hpp"
+#include "SERMappedReader.hpp"
+
+namespace fs = std::filesystem;
+
+struct Run {
+  uint32_t file;
+  uint64_t frames;
+};
+
+// A stripe file: mapped if plain SER, decoded into buf if compressed.
+struct Source {
+  std::unique_ptr<SER::SERMappedReader> mapped;
+  std::unique_ptr<SER::SERCompressedReader> compressed;
+  std::vector<uint8_t> buf;
+
+  bool open(const std::string &path) {
+    if (fs::path(path).extension() == ".serz") {
+      compressed = std::make_unique<SER::SERCompressedReader>(path);
+      return compressed->isOpen();
+    }
+    mapped = std::make_unique<SER::SERMappedReader>(path);
+    return mapped->isOpen();
+  }
+  const SER::SERHeader &Header() const {
+    return mapped ? mapped->Header() : compressed->Header();
+  }
+  uint32_t FrameCount() const {
+    return mapped ? mapped->FrameCount() : compressed->FrameCount();
+  }
+  // Whether the frames have capture times; a SER file without a trailer has
+  // none.
+  bool Timestamped() {
+    const uint8_t *data;
+    uint64_t utc = 0;
+    return FrameCount() > 0 && Read(0, 1, &data, &utc) && utc != 0;
+  }
+  // Frames [first, first + n) into data and utc.
+  bool Read(uint32_t first, uint32_t n, const uint8_t **data, uint64_t *utc) {
+    if (mapped) {
+      for (uint32_t i = 0; i < n; i++) {
+        SER::SERFrameView v;
+        if (!mapped->GetFrame(first + i, v)) return false;
+        data[i] = v.data;
+        utc[i] = v.utc_ns;
+      }
+      return true;
+    }
+    const size_t sz = compressed->FrameSize();
+    buf.resize(n * sz);
+    std::vector<uint8_t *> out(n);
+    for (uint32_t i = 0; i < n; i++) {
+      out[i] = buf.data() + i * sz;
+      data[i] = out[i];
+    }
+    return compressed->ReadFrames(first, n, out.data(), utc);
+  }
+};
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    spdlog::critical("usage: {} <name.manifest> <out.ser>", argv[0]);
+    return 1;
+  }
+  const fs::path manifest_path = argv[1];
+  std::ifstream manifest(manifest_path);
+  if (!manifest) {
+    spdlog::critical("Cannot open {}", manifest_path.string());
+    return 1;
+  }
+
+  std::map<uint32_t, Source> files;
+  std::vector<Run> runs;
+  uint64_t expected = 0;
+  bool complete = false;
+  std::string line;
+  while (std::getline(manifest, line)) {
+    std::istringstream in(line);
+    std::string key;
+    in >> key;
+    if (key == "file") {
+      uint32_t id;
+      std::string path;
+      in >> id >> std::ws;
+      std::getline(in, path);
+      if (!fs::exists(path))
+        path = (manifest_path.parent_path() / fs::path(path).filename())
+                   .string();
+      if (!files[id].open(path)) return 1;
+    } else if (key == "run") {
+      Run r;
+      in >> r.file >> r.frames;
+      runs.push_back(r);
+    } else if (key == "end") {
+      in >> expected;
+      complete = true;
+    }
+  }
+  if (files.empty()) {
+    spdlog::critical("{} lists no files", manifest_path.string());
+    return 1;
+  }
+  if (!complete) {
+    spdlog::warn("{} has no end line; the recording was cut short",
+                 manifest_path.string());
+    // The last run is only written once the next one starts. If a single
+    // file holds more frames than the runs account for, they are that run.
+    std::map<uint32_t, uint64_t> listed;
+    for (const Run &r : runs) listed[r.file] += r.frames;
+    std::vector<Run> extra;
+    for (const auto &[id, src] : files)
+      if (src.FrameCount() > listed[id])
+        extra.push_back({id, src.FrameCount() - listed[id]});
+    if (extra.size() == 1) {
+      spdlog::info("Taking {} more frames from file {}", extra[0].frames,
+                   extra[0].file);
+      runs.push_back(extra[0]);
+    } else if (extra.size() > 1) {
+      spdlog::warn("{} files hold frames the manifest does not place; they "
+                   "are left out",
+                   extra.size());
+    }
+  }
+
+  size_t stamped = 0, unstamped = 0;
+  for (auto &[id, src] : files)
+    if (src.FrameCount() > 0) ++(src.Timestamped() ? stamped : unstamped);
+  if (stamped > 0 && unstamped > 0) {
+    spdlog::critical("{} of {} files have no timestamps; not merging them "
+                     "with files that do",
+                     unstamped, stamped + unstamped);
+    return 1;
+  }
+  if (unstamped > 0)
+    spdlog::warn("The files have no timestamps; neither has the merge");
+
+  SER::SERWriter out(argv[2]);
+  out.prepare_header(files.begin()->second.Header());
+  out.set_timestamped(unstamped == 0);
+  if (!out.isOpen()) return 1;
+  std::map<uint32_t, uint32_t> next;  // next frame to take from each file
+  std::vector<const uint8_t *> data;
+  std::vector<uint64_t> utc;
+  uint64_t total = 0;
+  for (const Run &r : runs) {
+    auto it = files.find(r.file);
+    if (it == files.end()) {
+      spdlog::critical("Run refers to unknown file {}", r.file);
+      return 1;
+    }
+    uint32_t &idx = next[r.file];
+    for (uint64_t left = r.frames; left > 0;) {
+      const uint32_t n = uint32_t(std::min<uint64_t>(left, 64));
+      data.resize(n);
+      utc.resize(n);
+      if (!it->second.Read(idx, n, data.data(), utc.data())) {
+        spdlog::critical("File {} ends before frame {}", r.file, idx + n - 1);
+        return 1;
+      }
+      out.write_frames(data.data(), utc.data(), n);
+      idx += n;
+      left -= n;
+      total += n;
+    }
+  }
+  if (complete && total != expected) {
+    spdlog::critical("Merged {} frames, the manifest says {}", total,
+                     expected);
+    return 1;
+  }
+  spdlog::info("Merged {} frames from {} files into {}", total, files.size(),
+               argv[2]);
+  return out.isOpen() ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+// Converts a compressed or bit-packed recording (.serz) back into a plain
+// SER file.
+//
+// Frames are decoded or unpacked a batch at a time on the compression pool
+// and written with their timestamps, so the SER is what the camera would
+// have recorded uncompressed. 16-bit samples are written little endian
+// with uiLittleEndian = 1 as in the SER spec, unless an order is given:
+// true-le, legacy-le (uiLittleEndian = 0) or legacy-be.
+//
+// usage: serz_to_ser <in.serz> <out.ser> [order]
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SERCompressed.hpp"
+
+int main(int argc, char **argv) {
+  if (argc != 3 && argc != 4) {
+    spdlog::critical("usage: {} <in.serz> <out.ser> [true-le|legacy-le|"
+                     "legacy-be]",
+                     argv[0]);
+    return 1;
+  }
+  SER::SERCompressedReader in(argv[1]);
+  if (!in.isOpen()) return 1;
+  SER::SERWriter out(argv[2]);
+  if (argc == 4) {
+    const std::string order = argv[3];
+    if (order == "true-le")
+      out.set_byte_order(SER::SERByteOrder::TrueLittleEndian);
+    else if (order == "legacy-le")
+      out.set_byte_order(SER::SERByteOrder::LegacyLittleEndian);
+    else if (order == "legacy-be")
+      out.set_byte_order(SER::SERByteOrder::LegacyBigEndian);
+    else {
+      spdlog::critical("Unknown byte order {}", order);
+      return 1;
+    }
+  }
+  out.prepare_header(in.Header());
+  if (!out.isOpen()) return 1;
+
+  const size_t sz = in.FrameSize();
+  const uint32_t batch = uint32_t(
+      std::max<size_t>(64 * 1024 * 1024 / std::max<size_t>(sz, 1), 1));
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[batch * sz]);
+  std::vector<uint8_t *> frames(batch);
+  std::vector<uint64_t> utc(batch);
+  for (uint32_t i = 0; i < batch; i++) frames[i] = buf.get() + i * sz;
+
+  const auto start = std::chrono::steady_clock::now();
+  uint32_t done = 0;
+  while (done < in.FrameCount()) {
+    const uint32_t n = std::min(batch, in.FrameCount() - done);
+    if (!in.ReadFrames(done, n, frames.data(), utc.data())) return 1;
+    out.write_frames(frames.data(), utc.data(), n);
+    if (!out.isOpen()) return 1;
+    done += n;
+  }
+  const double s = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  spdlog::info("Converted {} frames into {}, {:.0f} MB/s", done, argv[2],
+               s > 0 ? double(done) * sz / s / 1024 / 1024 : 0.0);
+  return 0;
+}
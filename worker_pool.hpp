@@ -0,0 +1,103 @@
+#ifndef __WORKER_POOL__
+#define __WORKER_POOL__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//-------------------------------------------------------------------
+// Fixed set of threads for data-parallel loops.
+//
+// run(n, fn) calls fn(i) for every i in [0, n), spread over the pool threads
+// and the calling thread, and returns once all of them are done. Work is
+// handed out one index at a time, so uneven tasks balance themselves. One
+// run() at a time; concurrent callers queue up.
+//
+// prepare, if given, is called by every pool thread before each job, e.g.
+// to put it in its scheduling role.
+//-------------------------------------------------------------------
+class WorkerPool {
+ public:
+  // threads helpers besides the caller; 0 runs everything on the caller.
+  explicit WorkerPool(unsigned threads,
+                      std::function<void()> _prepare = nullptr)
+      : prepare(std::move(_prepare)) {
+    for (unsigned i = 0; i < threads; i++)
+      workers.emplace_back(&WorkerPool::Loop, this);
+  }
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    cv.notify_all();
+    for (auto &t : workers) t.join();
+  }
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  unsigned size() const { return unsigned(workers.size()) + 1; }
+
+  void run(size_t n, const std::function<void(size_t)> &fn) {
+    if (n == 0) return;
+    std::lock_guard<std::mutex> serial(run_mutex);
+    if (workers.empty() || n == 1) {
+      for (size_t i = 0; i < n; i++) fn(i);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job = &fn;
+      count = n;
+      next = 0;
+      active = workers.size();
+      generation++;
+    }
+    cv.notify_all();
+    Work();
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return active == 0; });
+    job = nullptr;
+  }
+
+ private:
+  std::function<void()> prepare;
+  std::vector<std::thread> workers;
+  std::mutex run_mutex;  // one run() at a time
+  std::mutex mutex;      // guards everything below but next
+  std::condition_variable cv;
+  std::condition_variable done;
+  const std::function<void(size_t)> *job = nullptr;
+  size_t count = 0;
+  std::atomic<size_t> next{0};
+  size_t active = 0;  // workers that have not finished the current run
+  uint64_t generation = 0;
+  bool stop = false;
+
+  void Work() {
+    for (size_t i; (i = next.fetch_add(1)) < count;) (*job)(i);
+  }
+  void Loop() {
+    uint64_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return stop || generation != seen; });
+        if (stop) return;
+        seen = generation;
+      }
+      if (prepare) prepare();
+      Work();
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--active == 0) done.notify_one();
+    }
+  }
+};
+
+#endif
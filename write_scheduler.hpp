@@ -0,0 +1,131 @@
+#ifndef __WRITE_SCHEDULER__
+#define __WRITE_SCHEDULER__
+//-------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "timer.hpp"
+
+//-------------------------------------------------------------------
+// Fair share of a disk for the recorders of several cameras.
+//
+// Recorders whose directories are on the same device take turns at it, one
+// write call at a time, and the next turn goes to the waiting recorder that
+// has been given the fewest bytes (start-time fair queueing). One that
+// starts, or comes back from idle, starts level with the others instead of
+// with credit for the time it was away. While a device is shared a turn is
+// at most QUANTUM bytes, so a camera with small frames waits for one slice
+// of a fast camera's batch, not all of it, and two fast ones split the disk
+// evenly. Recorders on different devices never wait for each other, and a
+// recorder alone on its device never waits at all.
+//
+// A striped recording is placed by its main directory.
+//
+//   WriteScheduler::Client disk(directory);   // one per recording
+//   n = frames that fit in disk.quantum();
+//   disk.acquire(n * frame_bytes);            // ns waited for the turn
+//   writer->write_frames(..., n);
+//   disk.release();
+//-------------------------------------------------------------------
+namespace WriteScheduler {
+
+constexpr size_t QUANTUM = 8 * 1024 * 1024;
+
+namespace detail {
+
+struct Device {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<size_t> clients = 0;
+  bool busy = false;
+  // Bytes given out, as the start tag of the turn given last.
+  uint64_t vtime = 0;
+  // Start tag and client id of the recorders waiting, next turn first.
+  std::set<std::pair<uint64_t, uint64_t>> waiting;
+};
+
+inline std::shared_ptr<Device> device(const std::string &directory) {
+  static std::mutex mutex;
+  static std::map<dev_t, std::shared_ptr<Device>> devices;
+  struct stat st;
+  if (stat(directory.c_str(), &st) != 0) {
+    spdlog::warn("Cannot tell which disk {} is on; it is not shared fairly",
+                 directory);
+    return std::make_shared<Device>();
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &d = devices[st.st_dev];
+  if (d == nullptr) d = std::make_shared<Device>();
+  return d;
+}
+
+}  // namespace detail
+
+class Client {
+ public:
+  explicit Client(const std::string &directory)
+      : dev(detail::device(directory)), id(next_id()) {
+    dev->clients++;
+  }
+  ~Client() { dev->clients--; }
+  Client(const Client &) = delete;
+  Client &operator=(const Client &) = delete;
+
+  // Most bytes to ask for at once.
+  size_t quantum() const {
+    return dev->clients > 1 ? QUANTUM : std::numeric_limits<size_t>::max();
+  }
+
+  // Blocks until it is this recorder's turn to write bytes; returns how long
+  // that took, in ns. Every acquire() is followed by a release().
+  uint64_t acquire(size_t bytes) {
+    const uint64_t t0 = monotonic_ns();
+    std::unique_lock<std::mutex> lock(dev->mutex);
+    const auto key = std::make_pair(std::max(dev->vtime, finish), id);
+    dev->waiting.insert(key);
+    dev->cv.wait(lock, [&] {
+      return !dev->busy && *dev->waiting.begin() == key;
+    });
+    dev->waiting.erase(dev->waiting.begin());
+    dev->busy = true;
+    dev->vtime = key.first;
+    finish = key.first + bytes;
+    return monotonic_ns() - t0;
+  }
+  void release() {
+    {
+      std::lock_guard<std::mutex> lock(dev->mutex);
+      dev->busy = false;
+    }
+    dev->cv.notify_all();
+  }
+
+ private:
+  std::shared_ptr<detail::Device> dev;
+  const uint64_t id;
+  // Start tag plus the bytes of this recorder's last turn.
+  uint64_t finish = 0;
+
+  static uint64_t next_id() {
+    static std::atomic<uint64_t> ids = 0;
+    return ids++;
+  }
+};
+
+}  // namespace WriteScheduler
+
+#endif